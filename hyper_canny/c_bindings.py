@@ -1,4 +1,6 @@
-from ctypes import (c_float, c_uint, c_uint8, POINTER, cdll, util, c_size_t, c_int)
+from ctypes import (
+    c_float, c_uint, c_uint8, c_uint16, c_uint64, POINTER, cdll, util,
+    c_size_t, c_int, c_int32, c_double, c_void_p, byref)
 import numpy as np
 
 libhypercanny_path = util.find_library("hyper-canny")
@@ -15,6 +17,12 @@ c_smooth_sobel.argtypes = [
     c_uint, c_float, POINTER(c_float)]
 c_smooth_sobel.restype = None
 
+c_smooth_sobel_recursive = libhypercanny.smooth_sobel_recursive
+c_smooth_sobel_recursive.argtypes = [
+    c_uint, POINTER(c_uint), POINTER(c_float),
+    c_float, POINTER(c_float)]
+c_smooth_sobel_recursive.restype = None
+
 c_edge_thinning = libhypercanny.thin_edges
 c_edge_thinning.argtypes = [
     c_uint, POINTER(c_uint), POINTER(c_float),
@@ -26,6 +34,77 @@ c_double_threshold.argtypes = [
     c_uint, POINTER(c_uint), POINTER(c_float), POINTER(c_uint8),
     c_float, c_float, POINTER(c_uint8)]
 
+c_smooth_sobel_16 = libhypercanny.smooth_sobel_16
+c_smooth_sobel_16.argtypes = [
+    c_uint, POINTER(c_uint), POINTER(c_uint16),
+    c_uint, c_float, POINTER(c_uint16), c_uint]
+c_smooth_sobel_16.restype = None
+
+c_smooth_sobel_recursive_16 = libhypercanny.smooth_sobel_recursive_16
+c_smooth_sobel_recursive_16.argtypes = [
+    c_uint, POINTER(c_uint), POINTER(c_uint16),
+    c_float, POINTER(c_uint16), c_uint]
+c_smooth_sobel_recursive_16.restype = None
+
+c_edge_thinning_16 = libhypercanny.thin_edges_16
+c_edge_thinning_16.argtypes = [
+    c_uint, POINTER(c_uint), POINTER(c_uint16),
+    POINTER(c_uint8), c_uint]
+c_edge_thinning_16.restype = None
+
+c_double_threshold_16 = libhypercanny.double_threshold_16
+c_double_threshold_16.argtypes = [
+    c_uint, POINTER(c_uint), POINTER(c_uint16), POINTER(c_uint8),
+    c_float, c_float, POINTER(c_uint8), c_uint]
+
+c_edge_thinning_packed = libhypercanny.thin_edges_packed
+c_edge_thinning_packed.argtypes = [
+    c_uint, POINTER(c_uint), POINTER(c_float),
+    POINTER(c_uint64)]
+c_edge_thinning_packed.restype = None
+
+c_edge_thinning_interpolated = libhypercanny.thin_edges_interpolated
+c_edge_thinning_interpolated.argtypes = [
+    c_uint, POINTER(c_uint), POINTER(c_float),
+    POINTER(c_uint8), POINTER(c_float)]
+c_edge_thinning_interpolated.restype = None
+
+c_thin_and_threshold = libhypercanny.thin_and_threshold
+c_thin_and_threshold.argtypes = [
+    c_uint, POINTER(c_uint), POINTER(c_float),
+    c_float, c_float, c_uint, POINTER(c_uint8)]
+c_thin_and_threshold.restype = None
+
+c_label_edges = libhypercanny.label_edges
+c_label_edges.argtypes = [
+    c_uint, POINTER(c_uint), POINTER(c_float), POINTER(c_uint8),
+    POINTER(c_int32), POINTER(POINTER(c_double))]
+c_label_edges.restype = c_size_t
+
+c_free_component_stats = libhypercanny.free_component_stats
+c_free_component_stats.argtypes = [POINTER(c_double)]
+c_free_component_stats.restype = None
+
+c_hysteresis_index_new = libhypercanny.hysteresis_index_new
+c_hysteresis_index_new.argtypes = [
+    c_uint, POINTER(c_uint), POINTER(c_float), POINTER(c_uint8)]
+c_hysteresis_index_new.restype = c_void_p
+
+c_hysteresis_index_free = libhypercanny.hysteresis_index_free
+c_hysteresis_index_free.argtypes = [c_void_p]
+c_hysteresis_index_free.restype = None
+
+c_hysteresis_index_query = libhypercanny.hysteresis_index_query
+c_hysteresis_index_query.argtypes = [
+    c_void_p, c_size_t, POINTER(c_float), POINTER(c_float),
+    POINTER(c_uint8)]
+c_hysteresis_index_query.restype = None
+
+c_double_threshold_packed = libhypercanny.double_threshold_packed
+c_double_threshold_packed.argtypes = [
+    c_uint, POINTER(c_uint), POINTER(c_float), POINTER(c_uint64),
+    c_float, c_float, POINTER(c_uint64)]
+
 c_smooth_gaussian = libhypercanny.smooth_gaussian
 c_smooth_gaussian.argtypes = [
     c_uint,
@@ -33,6 +112,56 @@ c_smooth_gaussian.argtypes = [
     POINTER(c_uint), c_size_t, POINTER(c_int), c_size_t, POINTER(c_float),
     c_uint, c_float]
 
+c_smooth_gaussian_recursive = libhypercanny.smooth_gaussian_recursive
+c_smooth_gaussian_recursive.argtypes = [
+    c_uint,
+    POINTER(c_uint), c_size_t, POINTER(c_int), c_size_t, POINTER(c_float),
+    POINTER(c_uint), c_size_t, POINTER(c_int), c_size_t, POINTER(c_float),
+    c_float]
+
+
+# Sixteen bit storage formats, see `storage_format` in `module.hh`.
+STORAGE_FLOAT16 = 0
+STORAGE_BFLOAT16 = 1
+
+
+def storage_format(data):
+    """Find the sixteen bit storage format of an array.
+
+    :param data: nd-Array.
+    :return: `None` for single precision data, `STORAGE_FLOAT16` for
+    `float16` data, and `STORAGE_BFLOAT16` for `bfloat16` data, as given
+    by the `ml_dtypes` package. Raw bfloat16 bit patterns in a `uint16`
+    array should be viewed as that type first, since they cannot be told
+    apart from integer data.
+    :raises ValueError: for any other type."""
+    if data.dtype == np.float32:
+        return None
+    if data.dtype == np.float16:
+        return STORAGE_FLOAT16
+    if data.dtype.name == 'bfloat16':
+        return STORAGE_BFLOAT16
+    raise ValueError(
+        "unsupported data type {}: use float32, float16 or the bfloat16 "
+        "of ml_dtypes.".format(data.dtype))
+
+
+def packed_words(shape):
+    """Number of 64-bit words in a packed mask of the given shape."""
+    return (int(np.prod(shape)) + 63) // 64
+
+
+def unpack_mask(packed, shape):
+    """Unpack a mask returned with `packed=True`.
+
+    :param packed: uint8 array, as returned by `edge_thinning` or
+    `double_threshold`.
+    :param shape: shape of the mask.
+    :return: uint8 array of zeros and ones."""
+    count = int(np.prod(shape))
+    return np.unpackbits(packed, count=count, bitorder='little') \
+        .reshape(shape)
+
 
 def raw(data):
     if data.base is None:
@@ -41,21 +170,27 @@ def raw(data):
         return data.base
 
 
-def smooth_gaussian(data, n, sigma):
+def smooth_gaussian(data, n, sigma, method='direct'):
     """Smooth with Gaussian kernel.
 
     :param data: nd-Array of single precision floating point data.
-    :param n: Half kernel window size.
+    :param n: Half kernel window size, ignored by the recursive method.
     :param sigma: std dev of Gaussian kernel.
+    :param method: 'direct' to convolve with a kernel of size 2*n + 1,
+    'recursive' for a recursive filter of which the cost does not depend
+    on sigma (needs sigma >= 0.5).
     :return: nd-Array with smoothed data."""
+    if method not in ('direct', 'recursive'):
+        raise ValueError("method should be 'direct' or 'recursive'.")
+
     shape = data.shape
-    stride = np.array(data.strides, dtype='int') // data.dtype.itemsize
+    stride = np.array(data.strides, dtype='int32') // data.dtype.itemsize
     offset = (data.ctypes.data - raw(data).ctypes.data) // data.dtype.itemsize
 
     outp = np.zeros(shape, dtype='float32')
-    out_stride = np.array(outp.strides, dtype='int') // outp.dtype.itemsize
+    out_stride = np.array(outp.strides, dtype='int32') // outp.dtype.itemsize
 
-    c_smooth_gaussian(
+    arrays = (
         len(data.shape),
 
         data.ctypes.shape_as(c_uint),
@@ -68,42 +203,121 @@ def smooth_gaussian(data, n, sigma):
         c_size_t(0),
         out_stride.ctypes.data_as(POINTER(c_int)),
         c_size_t(outp.size),
-        outp.ctypes.data_as(POINTER(c_float)),
+        outp.ctypes.data_as(POINTER(c_float)))
 
-        c_uint(n),
-        c_float(sigma))
+    if method == 'recursive':
+        c_smooth_gaussian_recursive(*arrays, c_float(sigma))
+    else:
+        c_smooth_gaussian(*arrays, c_uint(n), c_float(sigma))
 
     return outp
 
 
-def smooth_sobel(data, n, sigma):
+def smooth_sobel(data, n, sigma, method='direct'):
     """Smooth Sobel operator.
 
-    :param data: nd-Array of single precision floating point data.
+    :param data: nd-Array of single precision floating point data, or of
+    sixteen bit data (see `storage_format`); the computation is done in
+    single precision in either case.
     :param n: Half kernel window size, a value close to 2*sigma should be Ok.
-    The real kernel size will be 2*n + 1.
+    The real kernel size will be 2*n + 1. Ignored by the recursive method.
     :param sigma: std dev of the Gaussian kernel.
+    :param method: 'direct' or 'recursive', see `smooth_gaussian`.
     :return: (n+1)d-Array containing normalized homogeneous output of Sobel
-    operator, the inverse response function is stored in the last slice."""
+    operator, the inverse response function is stored in the last slice.
+    The output has the same storage type as the input."""
+    if method not in ('direct', 'recursive'):
+        raise ValueError("method should be 'direct' or 'recursive'.")
+
     output_shape = data.shape + (len(data.shape)+1,)
+    fmt = storage_format(data)
+
+    if fmt is not None:
+        data = np.ascontiguousarray(data)
+        output_data = np.zeros(output_shape, dtype=data.dtype)
+        if method == 'recursive':
+            c_smooth_sobel_recursive_16(
+                len(data.shape), data.ctypes.shape_as(c_uint),
+                data.ctypes.data_as(POINTER(c_uint16)), c_float(sigma),
+                output_data.ctypes.data_as(POINTER(c_uint16)), c_uint(fmt))
+        else:
+            c_smooth_sobel_16(
+                len(data.shape), data.ctypes.shape_as(c_uint),
+                data.ctypes.data_as(POINTER(c_uint16)), c_uint(n),
+                c_float(sigma), output_data.ctypes.data_as(POINTER(c_uint16)),
+                c_uint(fmt))
+        return output_data
+
     output_data = np.zeros(output_shape, dtype='float32')
 
-    c_smooth_sobel(
-        len(data.shape), data.ctypes.shape_as(c_uint),
-        data.ctypes.data_as(POINTER(c_float)), c_uint(n), c_float(sigma),
-        output_data.ctypes.data_as(POINTER(c_float)))
+    if method == 'recursive':
+        c_smooth_sobel_recursive(
+            len(data.shape), data.ctypes.shape_as(c_uint),
+            data.ctypes.data_as(POINTER(c_float)), c_float(sigma),
+            output_data.ctypes.data_as(POINTER(c_float)))
+    else:
+        c_smooth_sobel(
+            len(data.shape), data.ctypes.shape_as(c_uint),
+            data.ctypes.data_as(POINTER(c_float)), c_uint(n), c_float(sigma),
+            output_data.ctypes.data_as(POINTER(c_float)))
 
     return output_data
 
 
-def edge_thinning(data):
+def edge_thinning(data, packed=False, method='rounded', offset=False):
     """Thin the edges.
 
     :param data: Should be output of `smooth_sobel` function.
-    :return: boolean array."""
+    :param packed: if True, return the mask packed to bits, as
+    `np.packbits(mask, bitorder='little')` would (padded to a multiple
+    of eight bytes); see `unpack_mask`. Only for single precision data.
+    :param method: 'rounded' compares each pixel with the neighbours
+    nearest to the gradient direction, 'interpolated' interpolates the
+    neighbours across the gradient. Only for single precision data.
+    :param offset: if True (implies 'interpolated'), also return the
+    sub-voxel position of each edge along the unit gradient.
+    :return: boolean array, or a tuple of the boolean array and the
+    offsets."""
     output_shape = data.shape[0:-1]
-    output_data = np.zeros(output_shape, dtype='uint8')
     shape_array = np.array(output_shape, dtype='uint32')
+    fmt = storage_format(data)
+
+    if method not in ('rounded', 'interpolated'):
+        raise ValueError("unknown thinning method: {}".format(method))
+    if offset or method == 'interpolated':
+        if fmt is not None or packed:
+            raise ValueError(
+                "interpolated thinning needs single precision data "
+                "and a byte mask.")
+        output_data = np.zeros(output_shape, dtype='uint8')
+        offset_data = np.zeros(output_shape, dtype='float32') \
+            if offset else None
+        c_edge_thinning_interpolated(
+            len(output_shape), shape_array.ctypes.data_as(POINTER(c_uint)),
+            data.ctypes.data_as(POINTER(c_float)),
+            output_data.ctypes.data_as(POINTER(c_uint8)),
+            offset_data.ctypes.data_as(POINTER(c_float))
+            if offset else None)
+        return (output_data, offset_data) if offset else output_data
+
+    if packed:
+        if fmt is not None:
+            raise ValueError("packed masks need single precision data.")
+        output_words = np.zeros(packed_words(output_shape), dtype='uint64')
+        c_edge_thinning_packed(
+            len(output_shape), shape_array.ctypes.data_as(POINTER(c_uint)),
+            data.ctypes.data_as(POINTER(c_float)),
+            output_words.ctypes.data_as(POINTER(c_uint64)))
+        return output_words.view('uint8')
+
+    output_data = np.zeros(output_shape, dtype='uint8')
+
+    if fmt is not None:
+        c_edge_thinning_16(
+            len(output_shape), shape_array.ctypes.data_as(POINTER(c_uint)),
+            data.ctypes.data_as(POINTER(c_uint16)),
+            output_data.ctypes.data_as(POINTER(c_uint8)), c_uint(fmt))
+        return output_data
 
     c_edge_thinning(
         len(output_shape), shape_array.ctypes.data_as(POINTER(c_uint)),
@@ -113,17 +327,43 @@ def edge_thinning(data):
     return output_data
 
 
-def double_threshold(data, mask, a, b):
+def double_threshold(data, mask, a, b, packed=False):
     """Double threshold step.
 
     :param data: output of `smooth_sobel` function.
     :param mask: boolean array, output of `edge_thinning`.
     :param a: lower threshold.
     :param b: upper threshold.
+    :param packed: if True, `mask` is packed, and so is the result; see
+    `edge_thinning`.
     :return: new boolean array."""
     output_shape = data.shape[0:-1]
-    output_data = np.zeros(output_shape, dtype='uint8')
     shape_array = np.array(output_shape, dtype='uint32')
+    fmt = storage_format(data)
+
+    if packed:
+        if fmt is not None:
+            raise ValueError("packed masks need single precision data.")
+        mask_words = np.ascontiguousarray(mask).view('uint64')
+        if mask_words.size != packed_words(output_shape):
+            raise ValueError("packed mask does not match the data shape.")
+        output_words = np.zeros(packed_words(output_shape), dtype='uint64')
+        c_double_threshold_packed(
+            len(output_shape), shape_array.ctypes.data_as(POINTER(c_uint)),
+            data.ctypes.data_as(POINTER(c_float)),
+            mask_words.ctypes.data_as(POINTER(c_uint64)), c_float(a),
+            c_float(b), output_words.ctypes.data_as(POINTER(c_uint64)))
+        return output_words.view('uint8')
+
+    output_data = np.zeros(output_shape, dtype='uint8')
+
+    if fmt is not None:
+        c_double_threshold_16(
+            len(output_shape), shape_array.ctypes.data_as(POINTER(c_uint)),
+            data.ctypes.data_as(POINTER(c_uint16)),
+            mask.ctypes.data_as(POINTER(c_uint8)), c_float(a), c_float(b),
+            output_data.ctypes.data_as(POINTER(c_uint8)), c_uint(fmt))
+        return output_data
 
     c_double_threshold(
         len(output_shape), shape_array.ctypes.data_as(POINTER(c_uint)),
@@ -132,3 +372,126 @@ def double_threshold(data, mask, a, b):
         output_data.ctypes.data_as(POINTER(c_uint8)))
 
     return output_data
+
+
+def thin_and_threshold(data, a, b, method='rounded'):
+    """Edge thinning and double threshold in one step; gives the same as
+    `double_threshold(data, edge_thinning(data, method=method), a, b)`,
+    but reads `data` only once.
+
+    :param data: output of `smooth_sobel` function, single precision.
+    :param a: lower threshold.
+    :param b: upper threshold.
+    :param method: 'rounded' or 'interpolated', see `edge_thinning`.
+    :return: new boolean array."""
+    methods = {'rounded': 0, 'interpolated': 1}
+    if method not in methods:
+        raise ValueError("unknown thinning method: {}".format(method))
+    if storage_format(data) is not None:
+        raise ValueError("thin_and_threshold needs single precision data.")
+
+    output_shape = data.shape[0:-1]
+    shape_array = np.array(output_shape, dtype='uint32')
+    output_data = np.zeros(output_shape, dtype='uint8')
+    c_thin_and_threshold(
+        len(output_shape), shape_array.ctypes.data_as(POINTER(c_uint)),
+        data.ctypes.data_as(POINTER(c_float)), c_float(a), c_float(b),
+        c_uint(methods[method]), output_data.ctypes.data_as(POINTER(c_uint8)))
+    return output_data
+
+
+def label_edges(data, mask):
+    """Label the connected components of an edge mask, with periodic
+    boundaries and all 3^dim - 1 neighbours, as `double_threshold` follows
+    edges. Labels are numbered from 1 in C order of the first pixel of each
+    component. Components that touch across the edges of the array are
+    merged, so the labels differ from those of `scipy.ndimage.label`
+    wherever that happens.
+
+    :param data: output of `smooth_sobel` function, single precision.
+    :param mask: boolean array, output of `double_threshold`.
+    :return: tuple of the int32 label array and a dictionary of per
+    component statistics, where row `l - 1` belongs to label `l`: 'size'
+    (int64), 'magnitude' (mean gradient magnitude) and 'bbox', of shape
+    (n, 2, dim), holding the smallest and largest index along each axis.
+    A component that wraps around the array spans the whole axis."""
+    if storage_format(data) is not None:
+        raise ValueError("label_edges needs single precision data.")
+
+    output_shape = data.shape[0:-1]
+    dim = len(output_shape)
+    shape_array = np.array(output_shape, dtype='uint32')
+    mask_data = np.ascontiguousarray(mask, dtype='uint8')
+    labels = np.zeros(output_shape, dtype='int32')
+    stats_ptr = POINTER(c_double)()
+
+    n = c_label_edges(
+        dim, shape_array.ctypes.data_as(POINTER(c_uint)),
+        data.ctypes.data_as(POINTER(c_float)),
+        mask_data.ctypes.data_as(POINTER(c_uint8)),
+        labels.ctypes.data_as(POINTER(c_int32)), byref(stats_ptr))
+
+    try:
+        if n > 0:
+            stats = np.ctypeslib.as_array(
+                stats_ptr, shape=(n, 2 + 2 * dim)).copy()
+        else:
+            stats = np.zeros((0, 2 + 2 * dim))
+    finally:
+        c_free_component_stats(stats_ptr)
+
+    return labels, {
+        'size': stats[:, 0].astype('int64'),
+        'magnitude': stats[:, 1],
+        'bbox': stats[:, 2:].reshape(n, 2, dim).astype('int64')}
+
+
+class HysteresisIndex:
+    """Precomputed index for `double_threshold` with many pairs of
+    thresholds on the same edges, with periodic boundaries. Building it
+    takes about as long as a few calls to `double_threshold`; after that
+    each pair takes time in proportion to the number of edges found.
+
+        index = HysteresisIndex(sobel, edge_thinning(sobel))
+        edges = index(a, b)
+        sweep = index.sweep([(a1, b1), (a2, b2)])
+
+    :param data: output of `smooth_sobel` function, single precision.
+    :param mask: boolean array, output of `edge_thinning`."""
+    def __init__(self, data, mask):
+        if storage_format(data) is not None:
+            raise ValueError("HysteresisIndex needs single precision data.")
+
+        self.shape = data.shape[0:-1]
+        shape_array = np.array(self.shape, dtype='uint32')
+        mask_data = np.ascontiguousarray(mask, dtype='uint8')
+        self._index = c_hysteresis_index_new(
+            len(self.shape), shape_array.ctypes.data_as(POINTER(c_uint)),
+            data.ctypes.data_as(POINTER(c_float)),
+            mask_data.ctypes.data_as(POINTER(c_uint8)))
+
+    def __del__(self):
+        if getattr(self, '_index', None):
+            c_hysteresis_index_free(self._index)
+            self._index = None
+
+    def __call__(self, a, b):
+        """Same as `double_threshold(data, mask, a, b)`."""
+        return self.sweep([(a, b)])[0]
+
+    def sweep(self, thresholds):
+        """Double threshold for each pair `(a, b)` in `thresholds`,
+        computed in parallel.
+
+        :return: uint8 array of shape `(len(thresholds),) + shape`."""
+        pairs = np.array(thresholds, dtype='float32').reshape(-1, 2)
+        if np.any(pairs[:, 0] > pairs[:, 1]):
+            raise ValueError("lower threshold should not be above the upper.")
+        a = np.ascontiguousarray(pairs[:, 0])
+        b = np.ascontiguousarray(pairs[:, 1])
+        output_data = np.zeros((len(pairs),) + self.shape, dtype='uint8')
+        c_hysteresis_index_query(
+            self._index, len(pairs), a.ctypes.data_as(POINTER(c_float)),
+            b.ctypes.data_as(POINTER(c_float)),
+            output_data.ctypes.data_as(POINTER(c_uint8)))
+        return output_data
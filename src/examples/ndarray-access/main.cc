@@ -0,0 +1,128 @@
+/* Copyright 2017 Netherlands eScience Center
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+/* Micro-benchmark of indexed element access to NdArray.
+ *
+ * The loop is the one at the heart of double_threshold(): test a mask
+ * and compare a value, for every pixel. It is timed with `operator[]` on
+ * the arrays, through the type-erased NdArrayRef (a virtual call per
+ * access, as every NdArray access was when the container was reached
+ * through a virtual function), and on raw pointers.
+ *
+ *     ndarray-access [n_pixels [n_repeats]]
+ */
+#include "../../numeric/ndarray.hh"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <random>
+
+using namespace HyperCanny;
+using numeric::NdArray;
+using numeric::NdArrayBase;
+using numeric::NdArrayRef;
+
+template <typename Mask, typename Value>
+__attribute__((noinline))
+size_t count_indexed(Mask const &mask, Value const &value, float threshold)
+{
+    size_t count = 0;
+    for (size_t i = 0; i < value.size(); ++i)
+        count += (mask[i] != 0) & (value[i] <= threshold);
+    return count;
+}
+
+__attribute__((noinline))
+size_t count_erased(NdArrayBase<uint8_t, 1> const &mask,
+                    NdArrayBase<float, 1> const &value, float threshold)
+{
+    size_t count = 0, n = value.shape()[0];
+    for (size_t i = 0; i < n; ++i)
+        count += (mask.const_container()[i] != 0)
+               & (value.const_container()[i] <= threshold);
+    return count;
+}
+
+__attribute__((noinline))
+size_t count_pointer(uint8_t const *mask, float const *value, size_t n, float threshold)
+{
+    size_t count = 0;
+    for (size_t i = 0; i < n; ++i)
+        count += (mask[i] != 0) & (value[i] <= threshold);
+    return count;
+}
+
+template <typename F>
+double best_time(unsigned repeats, F f, size_t &result)
+{
+    double best = std::numeric_limits<double>::infinity();
+    for (unsigned r = 0; r < repeats; ++r)
+    {
+        auto start = std::chrono::steady_clock::now();
+        result = f();
+        std::chrono::duration<double> t = std::chrono::steady_clock::now() - start;
+        best = std::min(best, t.count());
+    }
+    return best;
+}
+
+int main(int argc, char **argv)
+{
+    size_t n = (argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1 << 24);
+    unsigned repeats = (argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 10);
+
+    NdArray<float, 1> value({n});
+    NdArray<uint8_t, 1> mask({n});
+    std::mt19937 random;
+    std::uniform_real_distribution<float> uniform(0.0, 1.0);
+    for (size_t i = 0; i < n; ++i)
+    {
+        value[i] = uniform(random);
+        mask[i] = (uniform(random) < 0.5);
+    }
+
+    NdArrayRef<NdArray<uint8_t, 1>> mask_ref(mask);
+    NdArrayRef<NdArray<float, 1>> value_ref(value);
+
+    size_t expected, count;
+    double t_pointer = best_time(repeats, [&] {
+        return count_pointer(mask.const_container().data(),
+                             value.const_container().data(), n, 0.5f); }, expected);
+
+    std::cout << "# " << n << " pixels, best of " << repeats << " runs\n"
+              << std::setw(12) << "access" << std::setw(12) << "ns/pixel"
+              << std::setw(12) << "vs pointer" << "\n";
+    auto report = [&] (char const *name, double t)
+    {
+        if (count != expected)
+            std::cerr << name << ": counted " << count << " instead of " << expected << "\n";
+        std::cout << std::setw(12) << name
+                  << std::setw(12) << std::setprecision(3) << t / n * 1e9
+                  << std::setw(12) << std::setprecision(3) << t / t_pointer << "\n";
+    };
+
+    count = expected;
+    report("pointer", t_pointer);
+    report("indexed", best_time(repeats, [&] {
+        return count_indexed(mask, value, 0.5f); }, count));
+    report("erased", best_time(repeats, [&] {
+        return count_erased(mask_ref, value_ref, 0.5f); }, count));
+
+    return EXIT_SUCCESS;
+}
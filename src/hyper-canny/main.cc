@@ -67,7 +67,8 @@ int main(int argc, char **argv)
             Option("-f", "input file", "", false),
             Option("-lower", "lower threshold", "100.0"),
             Option("-upper", "upper threshold", "200.0"),
-            Option("-sigma", "pre smoothing width", "2.4")
+            Option("-sigma", "pre smoothing width", "2.4"),
+            Option("-recursive", "use recursive Gaussian smoothing")
         });
 
     try
@@ -101,8 +102,11 @@ int main(int argc, char **argv)
     timer.start("Sobel operator");
     float sigma = args.get<float>("-sigma", 2.4);
     int filter_width = static_cast<int>(ceil(2 * sigma));
+    auto method = (*args.get<bool>("-recursive")
+        ? filter::GaussianMethod::recursive
+        : filter::GaussianMethod::direct);
     auto sobel_filtered = filter::smooth_sobel(
-        *data, filter_width, sigma);
+        *data, filter_width, sigma, method);
     timer.stop();
 
     timer.start("Thinning edges");
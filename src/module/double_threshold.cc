@@ -18,8 +18,8 @@
 
 using namespace HyperCanny;
 
-template <typename real_t, unsigned D>
-void do_double_threshold(unsigned *shape_p, real_t *input_p, uint8_t *mask_p, float a, float b, uint8_t *output_p)
+template <typename real_t, unsigned D, typename Word = uint8_t>
+void do_double_threshold(unsigned *shape_p, real_t *input_p, Word *mask_p, float a, float b, Word *output_p)
 {
     using namespace numeric;
     using namespace filter;
@@ -28,27 +28,93 @@ void do_double_threshold(unsigned *shape_p, real_t *input_p, uint8_t *mask_p, fl
     std::copy(shape_p, shape_p + D, shape.rbegin());
 
     using input_type = NdArray<real_t, D+1, pointer_range<real_t>>;
+    using mask_type = EdgeMask<D, Word, pointer_range<Word>>;
 
     Slice<D+1> input_slice(extend_one(shape, D+1));
-    Slice<D>   output_slice(shape);
-
     input_type input(
         input_slice, pointer_range<real_t>(input_p, input_slice.size));
 
-    NdArray<bool, D> mask(shape);
-    std::copy(mask_p, mask_p + output_slice.size, mask.begin());
-    auto result = double_threshold(input, mask, a, b);
-    std::copy(result.begin(), result.end(), output_p);
+    size_t n_words = mask_type::words_for(calc_size<D>(shape));
+    mask_type mask(shape, pointer_range<Word>(mask_p, n_words));
+    mask_type output(shape, pointer_range<Word>(output_p, n_words));
+    double_threshold(input, mask, a, b, output);
+}
+
+template <typename real_t, typename Word>
+void double_threshold_dim(
+    unsigned dim, unsigned *shape, real_t *input, Word *mask, float a, float b, Word *output)
+{
+    switch (dim)
+    {
+        case 2: do_double_threshold<real_t, 2>(shape, input, mask, a, b, output); break;
+        case 3: do_double_threshold<real_t, 3>(shape, input, mask, a, b, output); break;
+        case 4: do_double_threshold<real_t, 4>(shape, input, mask, a, b, output); break;
+        case 5: do_double_threshold<real_t, 5>(shape, input, mask, a, b, output); break;
+    }
 }
 
 extern "C" void double_threshold(
     unsigned dim, unsigned *shape, float *input, uint8_t *mask, float a, float b, uint8_t *output)
 {
+    double_threshold_dim(dim, shape, input, mask, a, b, output);
+}
+
+extern "C" void double_threshold_16(
+    unsigned dim, unsigned *shape, uint16_t *input, uint8_t *mask, float a, float b, uint8_t *output,
+    unsigned format)
+{
+    switch (format)
+    {
+        case storage_float16: double_threshold_dim(
+                dim, shape, reinterpret_cast<numeric::half *>(input), mask, a, b, output); break;
+        case storage_bfloat16: double_threshold_dim(
+                dim, shape, reinterpret_cast<numeric::bfloat16 *>(input), mask, a, b, output); break;
+        default: throw Exception("Invalid storage format.");
+    }
+}
+
+extern "C" void double_threshold_packed(
+    unsigned dim, unsigned *shape, float *input, uint64_t *mask, float a, float b, uint64_t *output)
+{
+    double_threshold_dim(dim, shape, input, mask, a, b, output);
+}
+
+template <unsigned D>
+void do_thin_and_threshold(
+    unsigned *shape_p, float *input_p, float a, float b, unsigned method, uint8_t *output_p)
+{
+    using namespace numeric;
+    using namespace filter;
+
+    shape_t<D> shape;
+    std::copy(shape_p, shape_p + D, shape.rbegin());
+
+    using input_type = NdArray<float, D+1, pointer_range<float>>;
+    using output_type = EdgeMask<D, uint8_t, pointer_range<uint8_t>>;
+
+    Slice<D+1> input_slice(extend_one(shape, D+1));
+    input_type input(
+        input_slice, pointer_range<float>(input_p, input_slice.size));
+    size_t size = calc_size<D>(shape);
+    output_type output(shape, pointer_range<uint8_t>(output_p, size));
+
+    thin_and_threshold(
+        input, a, b, output,
+        (method == 1 ? ThinningMethod::interpolated : ThinningMethod::rounded));
+}
+
+extern "C" void thin_and_threshold(
+    unsigned dim, unsigned *shape, float *input, float a, float b, unsigned method,
+    uint8_t *output)
+{
+    if (method > 1)
+        throw Exception("Invalid thinning method.");
+
     switch (dim)
     {
-        case 2: do_double_threshold<float, 2>(shape, input, mask, a, b, output); break;
-        case 3: do_double_threshold<float, 3>(shape, input, mask, a, b, output); break;
-        case 4: do_double_threshold<float, 4>(shape, input, mask, a, b, output); break;
-        case 5: do_double_threshold<float, 5>(shape, input, mask, a, b, output); break;
+        case 2: do_thin_and_threshold<2>(shape, input, a, b, method, output); break;
+        case 3: do_thin_and_threshold<3>(shape, input, a, b, method, output); break;
+        case 4: do_thin_and_threshold<4>(shape, input, a, b, method, output); break;
+        case 5: do_thin_and_threshold<5>(shape, input, a, b, method, output); break;
     }
 }
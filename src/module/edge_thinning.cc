@@ -18,8 +18,8 @@
 
 using namespace HyperCanny;
 
-template <typename real_t, unsigned D>
-void do_edge_thinning(unsigned *shape_p, real_t *input_p, uint8_t *output_p)
+template <typename real_t, unsigned D, typename Word = uint8_t>
+void do_edge_thinning(unsigned *shape_p, real_t *input_p, Word *output_p)
 {
     using namespace numeric;
     using namespace filter;
@@ -27,28 +27,96 @@ void do_edge_thinning(unsigned *shape_p, real_t *input_p, uint8_t *output_p)
     shape_t<D> shape;
     std::copy(shape_p, shape_p + D, shape.rbegin());
 
-    using output_type = NdArray<uint8_t, D, pointer_range<uint8_t>>;
     using input_type = NdArray<real_t, D+1, pointer_range<real_t>>;
+    using output_type = EdgeMask<D, Word, pointer_range<Word>>;
 
     Slice<D+1> input_slice(extend_one(shape, D+1));
-    Slice<D>   output_slice(shape);
-    output_type output(
-        output_slice, pointer_range<uint8_t>(output_p, output_slice.size));
     input_type input(
         input_slice, pointer_range<real_t>(input_p, input_slice.size));
+    size_t n_words = output_type::words_for(calc_size<D>(shape));
+    output_type output(shape, pointer_range<Word>(output_p, n_words));
+
+    filter::edge_thinning(input, output);
+}
+
+template <unsigned D>
+void do_edge_thinning_interpolated(
+    unsigned *shape_p, float *input_p, uint8_t *output_p, float *offset_p)
+{
+    using namespace numeric;
+    using namespace filter;
+
+    shape_t<D> shape;
+    std::copy(shape_p, shape_p + D, shape.rbegin());
+
+    using input_type = NdArray<float, D+1, pointer_range<float>>;
+    using output_type = EdgeMask<D, uint8_t, pointer_range<uint8_t>>;
+    using offset_type = NdArray<float, D, pointer_range<float>>;
+
+    Slice<D+1> input_slice(extend_one(shape, D+1));
+    input_type input(
+        input_slice, pointer_range<float>(input_p, input_slice.size));
+    Slice<D> output_slice(shape);
+    output_type output(
+        shape, pointer_range<uint8_t>(output_p, output_slice.size));
+
+    if (offset_p == nullptr)
+    {
+        filter::edge_thinning(input, output, ThinningMethod::interpolated);
+        return;
+    }
 
-    auto mask = filter::edge_thinning(input);
-    std::copy(mask.begin(), mask.end(), output.begin());
+    offset_type offset(
+        output_slice, pointer_range<float>(offset_p, output_slice.size));
+    filter::edge_thinning(input, output, offset);
+}
+
+template <typename real_t, typename Word>
+void edge_thinning_dim(
+    unsigned dim, unsigned *shape, real_t *input, Word *output)
+{
+    switch (dim)
+    {
+        case 2: do_edge_thinning<real_t, 2>(shape, input, output); break;
+        case 3: do_edge_thinning<real_t, 3>(shape, input, output); break;
+        case 4: do_edge_thinning<real_t, 4>(shape, input, output); break;
+        case 5: do_edge_thinning<real_t, 5>(shape, input, output); break;
+    }
 }
 
 extern "C" void thin_edges(
     unsigned dim, unsigned *shape, float *input, uint8_t *output)
+{
+    edge_thinning_dim(dim, shape, input, output);
+}
+
+extern "C" void thin_edges_16(
+    unsigned dim, unsigned *shape, uint16_t *input, uint8_t *output, unsigned format)
+{
+    switch (format)
+    {
+        case storage_float16: edge_thinning_dim(
+                dim, shape, reinterpret_cast<numeric::half *>(input), output); break;
+        case storage_bfloat16: edge_thinning_dim(
+                dim, shape, reinterpret_cast<numeric::bfloat16 *>(input), output); break;
+        default: throw Exception("Invalid storage format.");
+    }
+}
+
+extern "C" void thin_edges_packed(
+    unsigned dim, unsigned *shape, float *input, uint64_t *output)
+{
+    edge_thinning_dim(dim, shape, input, output);
+}
+
+extern "C" void thin_edges_interpolated(
+    unsigned dim, unsigned *shape, float *input, uint8_t *output, float *offset)
 {
     switch (dim)
     {
-        case 2: do_edge_thinning<float, 2>(shape, input, output); break;
-        case 3: do_edge_thinning<float, 3>(shape, input, output); break;
-        case 4: do_edge_thinning<float, 4>(shape, input, output); break;
-        case 5: do_edge_thinning<float, 5>(shape, input, output); break;
+        case 2: do_edge_thinning_interpolated<2>(shape, input, output, offset); break;
+        case 3: do_edge_thinning_interpolated<3>(shape, input, output, offset); break;
+        case 4: do_edge_thinning_interpolated<4>(shape, input, output, offset); break;
+        case 5: do_edge_thinning_interpolated<5>(shape, input, output, offset); break;
     }
 }
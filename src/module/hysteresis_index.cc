@@ -0,0 +1,78 @@
+/* Copyright 2017 Netherlands eScience Center
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#include "module.hh"
+#include "base/pointer_range.hh"
+#include "numeric/hysteresis_index.hh"
+
+using namespace HyperCanny;
+using numeric::filter::HysteresisIndex;
+
+template <unsigned D>
+HysteresisIndex *do_hysteresis_index_new(unsigned *shape_p, float *input_p, uint8_t *mask_p)
+{
+    using namespace numeric;
+
+    shape_t<D> shape;
+    std::copy(shape_p, shape_p + D, shape.rbegin());
+
+    using input_type = NdArray<float, D+1, pointer_range<float>>;
+    using mask_type = EdgeMask<D, uint8_t, pointer_range<uint8_t>>;
+
+    Slice<D+1> input_slice(extend_one(shape, D+1));
+    input_type input(
+        input_slice, pointer_range<float>(input_p, input_slice.size));
+    mask_type mask(shape, pointer_range<uint8_t>(mask_p, calc_size<D>(shape)));
+
+    return new HysteresisIndex(input, mask);
+}
+
+extern "C" void *hysteresis_index_new(
+    unsigned dim, unsigned *shape, float *input, uint8_t *mask)
+{
+    switch (dim)
+    {
+        case 2: return do_hysteresis_index_new<2>(shape, input, mask);
+        case 3: return do_hysteresis_index_new<3>(shape, input, mask);
+        case 4: return do_hysteresis_index_new<4>(shape, input, mask);
+        case 5: return do_hysteresis_index_new<5>(shape, input, mask);
+    }
+    return nullptr;
+}
+
+extern "C" void hysteresis_index_free(void *index)
+{
+    delete static_cast<HysteresisIndex *>(index);
+}
+
+extern "C" void hysteresis_index_query(
+    void *index_p, size_t n, float *a, float *b, uint8_t *output)
+{
+    auto const &index = *static_cast<HysteresisIndex const *>(index_p);
+    size_t const size = index.n_pixels();
+
+    for (size_t j = 0; j < n; ++j)
+        if (a[j] > b[j])
+            throw Exception("The hysteresis index needs `lower` not above `upper`.");
+
+    #pragma omp parallel
+    {
+        #pragma omp for schedule(dynamic) nowait
+        for (size_t j = 0; j < n; ++j)
+        {
+            uint8_t *o = output + j * size;
+            index.for_each_edge(a[j], b[j], [o] (size_t i) { o[i] = 1; });
+        }
+    }
+}
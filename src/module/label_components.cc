@@ -0,0 +1,81 @@
+/* Copyright 2017 Netherlands eScience Center
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#include "module.hh"
+#include "base/pointer_range.hh"
+#include "numeric/canny.hh"
+
+using namespace HyperCanny;
+
+template <unsigned D>
+size_t do_label_edges(
+    unsigned *shape_p, float *input_p, uint8_t *mask_p, int32_t *labels_p, double **stats)
+{
+    using namespace numeric;
+    using namespace filter;
+
+    shape_t<D> shape;
+    std::copy(shape_p, shape_p + D, shape.rbegin());
+
+    using input_type = NdArray<float, D+1, pointer_range<float>>;
+    using mask_type = EdgeMask<D, uint8_t, pointer_range<uint8_t>>;
+    using labels_type = NdArray<int32_t, D, pointer_range<int32_t>>;
+
+    Slice<D+1> input_slice(extend_one(shape, D+1));
+    input_type input(
+        input_slice, pointer_range<float>(input_p, input_slice.size));
+    Slice<D> slice(shape);
+    mask_type mask(shape, pointer_range<uint8_t>(mask_p, slice.size));
+    labels_type labels(slice, pointer_range<int32_t>(labels_p, slice.size));
+
+    auto components = label_components(input, mask, labels);
+
+    // records of size, mean magnitude, lower and upper corner, with the
+    // axes in the order of the caller
+    size_t const record = 2 + 2 * D;
+    *stats = new double[components.size() * record];
+    for (size_t l = 0; l < components.size(); ++l)
+    {
+        auto const &c = components[l];
+        double *r = *stats + l * record;
+        r[0] = double(c.size);
+        r[1] = c.magnitude;
+        for (unsigned k = 0; k < D; ++k)
+        {
+            r[2 + k] = double(c.lower[D - 1 - k]);
+            r[2 + D + k] = double(c.upper[D - 1 - k]);
+        }
+    }
+    return components.size();
+}
+
+extern "C" size_t label_edges(
+    unsigned dim, unsigned *shape, float *input, uint8_t *mask, int32_t *labels,
+    double **stats)
+{
+    switch (dim)
+    {
+        case 2: return do_label_edges<2>(shape, input, mask, labels, stats);
+        case 3: return do_label_edges<3>(shape, input, mask, labels, stats);
+        case 4: return do_label_edges<4>(shape, input, mask, labels, stats);
+        case 5: return do_label_edges<5>(shape, input, mask, labels, stats);
+    }
+    *stats = nullptr;
+    return 0;
+}
+
+extern "C" void free_component_stats(double *stats)
+{
+    delete[] stats;
+}
@@ -21,6 +21,13 @@
 #include "numeric/ndarray.hh"
 #include "numeric/convolution.hh"
 #include "numeric/canny.hh"
+#include "numeric/half.hh"
+
+/*! \brief Storage formats of the `*_16` functions, which take arrays of
+ *  sixteen bit floating point numbers. The computation is done in single
+ *  precision.
+ */
+enum storage_format { storage_float16 = 0, storage_bfloat16 = 1 };
 
 extern "C" void smooth_gaussian(
     unsigned dim,
@@ -28,11 +35,91 @@ extern "C" void smooth_gaussian(
     unsigned *o_shape, size_t o_offset, int *o_stride, size_t o_size, float *output,
     unsigned filter_width, float sigma);
 
+extern "C" void smooth_gaussian_recursive(
+    unsigned dim,
+    unsigned *i_shape, size_t i_offset, int *i_stride, size_t i_size, float *input,
+    unsigned *o_shape, size_t o_offset, int *o_stride, size_t o_size, float *output,
+    float sigma);
+
 extern "C" void smooth_sobel(
     unsigned dim, unsigned *shape, float *input, unsigned filter_width, float sigma, float *output);
 
+extern "C" void smooth_sobel_recursive(
+    unsigned dim, unsigned *shape, float *input, float sigma, float *output);
+
+extern "C" void smooth_sobel_16(
+    unsigned dim, unsigned *shape, uint16_t *input, unsigned filter_width, float sigma,
+    uint16_t *output, unsigned format);
+
+extern "C" void smooth_sobel_recursive_16(
+    unsigned dim, unsigned *shape, uint16_t *input, float sigma, uint16_t *output,
+    unsigned format);
+
 extern "C" void thin_edges(
     unsigned dim, unsigned *shape, float *input, uint8_t *output);
 
+extern "C" void thin_edges_16(
+    unsigned dim, unsigned *shape, uint16_t *input, uint8_t *output, unsigned format);
+
+/*! \brief Edge thinning into a packed mask of `(n + 63) / 64` words for
+ *  `n` pixels, least significant bit first.
+ */
+extern "C" void thin_edges_packed(
+    unsigned dim, unsigned *shape, float *input, uint64_t *output);
+
+/*! \brief Edge thinning that interpolates the neighbours across the
+ *  gradient. If `offset` is not null, it receives the sub-voxel position of
+ *  each edge along the unit gradient, zero elsewhere.
+ */
+extern "C" void thin_edges_interpolated(
+    unsigned dim, unsigned *shape, float *input, uint8_t *output, float *offset);
+
 extern "C" void double_threshold(
     unsigned dim, unsigned *shape, float *input, uint8_t *mask, float a, float b, uint8_t *output);
+
+extern "C" void double_threshold_16(
+    unsigned dim, unsigned *shape, uint16_t *input, uint8_t *mask, float a, float b, uint8_t *output,
+    unsigned format);
+
+/*! \brief Edge thinning and double threshold in one call, reading the Sobel
+ *  output once for both. `method` is 0 for rounded and 1 for interpolated
+ *  thinning.
+ */
+extern "C" void thin_and_threshold(
+    unsigned dim, unsigned *shape, float *input, float a, float b, unsigned method,
+    uint8_t *output);
+
+/*! \brief Connected-component labelling of the edges in `mask`, with
+ *  periodic boundaries. Writes labels 1 to n into `labels`, zero outside
+ *  the mask, and returns n. `*stats` is set to n records of 2 + 2 dim
+ *  doubles: the size, the mean gradient magnitude, and the smallest and
+ *  largest index along each axis. Release them with
+ *  `free_component_stats`.
+ */
+extern "C" size_t label_edges(
+    unsigned dim, unsigned *shape, float *input, uint8_t *mask, int32_t *labels,
+    double **stats);
+
+extern "C" void free_component_stats(double *stats);
+
+/*! \brief Build a hysteresis index over the edges in `mask`, with periodic
+ *  boundaries, for fast double thresholds with many pairs of thresholds.
+ *  Release it with `hysteresis_index_free`.
+ */
+extern "C" void *hysteresis_index_new(
+    unsigned dim, unsigned *shape, float *input, uint8_t *mask);
+
+extern "C" void hysteresis_index_free(void *index);
+
+/*! \brief Double threshold for `n` pairs `a[j]`, `b[j]`, with `a[j]` not
+ *  above `b[j]`, run in parallel. The mask for pair `j` is written at
+ *  offset `j` times the number of pixels of `output`, which should be
+ *  zeroed beforehand; only the edges are written.
+ */
+extern "C" void hysteresis_index_query(
+    void *index, size_t n, float *a, float *b, uint8_t *output);
+
+/*! \brief Double threshold on packed masks, see `thin_edges_packed`.
+ */
+extern "C" void double_threshold_packed(
+    unsigned dim, unsigned *shape, float *input, uint64_t *mask, float a, float b, uint64_t *output);
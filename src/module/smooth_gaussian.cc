@@ -18,12 +18,13 @@
 #include <cassert>
 
 using namespace HyperCanny;
+using numeric::filter::GaussianMethod;
 
 template <typename real_t, unsigned D>
 void do_smooth_gaussian(
         unsigned *i_shape_p, size_t i_offset, int *i_stride_p, size_t i_size, real_t *input_p,
         unsigned *o_shape_p, size_t o_offset, int *o_stride_p, size_t o_size, real_t *output_p,
-        unsigned n, float sigma)
+        unsigned n, float sigma, GaussianMethod method)
 {
     using namespace numeric;
     using namespace filter;
@@ -52,8 +53,7 @@ void do_smooth_gaussian(
     input_type input(
         input_slice, pointer_range<real_t>(input_p, i_size));
 
-    auto result = gaussian(input, n, sigma);
-    std::copy(result.begin(), result.end(), output.begin());
+    gaussian(input, n, sigma, output, method);
 }
 
 extern "C" void smooth_gaussian(
@@ -67,19 +67,47 @@ extern "C" void smooth_gaussian(
         case 2: do_smooth_gaussian<float, 2>(
                     i_shape, i_offset, i_stride, i_size, input,
                     o_shape, o_offset, o_stride, o_size, output,
-                    filter_width, sigma); break;
+                    filter_width, sigma, GaussianMethod::direct); break;
         case 3: do_smooth_gaussian<float, 3>(
                     i_shape, i_offset, i_stride, i_size, input,
                     o_shape, o_offset, o_stride, o_size, output,
-                    filter_width, sigma); break;
+                    filter_width, sigma, GaussianMethod::direct); break;
         case 4: do_smooth_gaussian<float, 4>(
                     i_shape, i_offset, i_stride, i_size, input,
                     o_shape, o_offset, o_stride, o_size, output,
-                    filter_width, sigma); break;
+                    filter_width, sigma, GaussianMethod::direct); break;
         case 5: do_smooth_gaussian<float, 5>(
                     i_shape, i_offset, i_stride, i_size, input,
                     o_shape, o_offset, o_stride, o_size, output,
-                    filter_width, sigma); break;
+                    filter_width, sigma, GaussianMethod::direct); break;
+        default: throw Exception("Invalid dimenension, must be number between 2 and 5.");
+    }
+}
+
+extern "C" void smooth_gaussian_recursive(
+    unsigned dim,
+    unsigned *i_shape, size_t i_offset, int *i_stride, size_t i_size, float *input,
+    unsigned *o_shape, size_t o_offset, int *o_stride, size_t o_size, float *output,
+    float sigma)
+{
+    switch (dim)
+    {
+        case 2: do_smooth_gaussian<float, 2>(
+                    i_shape, i_offset, i_stride, i_size, input,
+                    o_shape, o_offset, o_stride, o_size, output,
+                    0, sigma, GaussianMethod::recursive); break;
+        case 3: do_smooth_gaussian<float, 3>(
+                    i_shape, i_offset, i_stride, i_size, input,
+                    o_shape, o_offset, o_stride, o_size, output,
+                    0, sigma, GaussianMethod::recursive); break;
+        case 4: do_smooth_gaussian<float, 4>(
+                    i_shape, i_offset, i_stride, i_size, input,
+                    o_shape, o_offset, o_stride, o_size, output,
+                    0, sigma, GaussianMethod::recursive); break;
+        case 5: do_smooth_gaussian<float, 5>(
+                    i_shape, i_offset, i_stride, i_size, input,
+                    o_shape, o_offset, o_stride, o_size, output,
+                    0, sigma, GaussianMethod::recursive); break;
         default: throw Exception("Invalid dimenension, must be number between 2 and 5.");
     }
 }
@@ -17,9 +17,12 @@
 #include "numeric/canny.hh"
 
 using namespace HyperCanny;
+using numeric::filter::GaussianMethod;
 
 template <typename real_t, unsigned D>
-void do_smooth_sobel(unsigned *shape_p, real_t *input_p, unsigned n, float sigma, real_t *output_p)
+void do_smooth_sobel(
+        unsigned *shape_p, real_t *input_p, unsigned n, float sigma, real_t *output_p,
+        GaussianMethod method)
 {
     using namespace numeric;
     using namespace filter;
@@ -30,12 +33,6 @@ void do_smooth_sobel(unsigned *shape_p, real_t *input_p, unsigned n, float sigma
     using output_type = NdArray<real_t, D+1, pointer_range<real_t>>;
     using input_type = NdArray<real_t, D, pointer_range<real_t>>;
 
-    auto G = gaussian_kernel<real_t>(n, sigma);
-    auto smooth_kernel = convolve_padding_zero(
-            NdArray<real_t, 1>({3}, {0.25, 0.50, 0.25}), G);
-    auto gradient_kernel = convolve_padding_zero(
-            NdArray<real_t, 1>({3}, {0.5, 0.0, -0.5}), G);
-
     Slice<D>   input_slice(shape);
     Slice<D+1> output_slice(extend_one(shape, D+1));
     output_type output(
@@ -43,24 +40,65 @@ void do_smooth_sobel(unsigned *shape_p, real_t *input_p, unsigned n, float sigma
     input_type input(
         input_slice, pointer_range<real_t>(input_p, input_slice.size));
 
-    for (unsigned k = 0; k < D; ++k)
+    smooth_sobel(input, n, sigma, output, method);
+}
+
+template <typename real_t>
+void smooth_sobel_dim(
+        unsigned dim, unsigned *shape, real_t *input, unsigned n, float sigma, real_t *output,
+        GaussianMethod method)
+{
+    switch (dim)
     {
-        auto outs = output.sel(0, k);
-        outs = sobel(input, k, smooth_kernel, gradient_kernel);
+        case 2: do_smooth_sobel<real_t, 2>(shape, input, n, sigma, output, method); break;
+        case 3: do_smooth_sobel<real_t, 3>(shape, input, n, sigma, output, method); break;
+        case 4: do_smooth_sobel<real_t, 4>(shape, input, n, sigma, output, method); break;
+        case 5: do_smooth_sobel<real_t, 5>(shape, input, n, sigma, output, method); break;
+        default: throw Exception("Invalid dimenension, must be number between 2 and 5.");
     }
+}
+
+void smooth_sobel_storage(
+        unsigned dim, unsigned *shape, uint16_t *input, unsigned n, float sigma, uint16_t *output,
+        GaussianMethod method, unsigned format)
+{
+    using numeric::half;
+    using numeric::bfloat16;
 
-    normalize_homogeneous_vectors(output);
+    switch (format)
+    {
+        case storage_float16: smooth_sobel_dim(
+                dim, shape, reinterpret_cast<half *>(input), n, sigma,
+                reinterpret_cast<half *>(output), method); break;
+        case storage_bfloat16: smooth_sobel_dim(
+                dim, shape, reinterpret_cast<bfloat16 *>(input), n, sigma,
+                reinterpret_cast<bfloat16 *>(output), method); break;
+        default: throw Exception("Invalid storage format.");
+    }
 }
 
 extern "C" void smooth_sobel(
     unsigned dim, unsigned *shape, float *input, unsigned filter_width, float sigma, float *output)
 {
-    switch (dim)
-    {
-        case 2: do_smooth_sobel<float, 2>(shape, input, filter_width, sigma, output); break;
-        case 3: do_smooth_sobel<float, 3>(shape, input, filter_width, sigma, output); break;
-        case 4: do_smooth_sobel<float, 4>(shape, input, filter_width, sigma, output); break;
-        case 5: do_smooth_sobel<float, 5>(shape, input, filter_width, sigma, output); break;
-        default: throw Exception("Invalid dimenension, must be number between 2 and 5.");
-    }
+    smooth_sobel_dim(dim, shape, input, filter_width, sigma, output, GaussianMethod::direct);
+}
+
+extern "C" void smooth_sobel_recursive(
+    unsigned dim, unsigned *shape, float *input, float sigma, float *output)
+{
+    smooth_sobel_dim(dim, shape, input, 0, sigma, output, GaussianMethod::recursive);
+}
+
+extern "C" void smooth_sobel_16(
+    unsigned dim, unsigned *shape, uint16_t *input, unsigned filter_width, float sigma,
+    uint16_t *output, unsigned format)
+{
+    smooth_sobel_storage(dim, shape, input, filter_width, sigma, output, GaussianMethod::direct, format);
+}
+
+extern "C" void smooth_sobel_recursive_16(
+    unsigned dim, unsigned *shape, uint16_t *input, float sigma, uint16_t *output,
+    unsigned format)
+{
+    smooth_sobel_storage(dim, shape, input, 0, sigma, output, GaussianMethod::recursive, format);
 }
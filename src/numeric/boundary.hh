@@ -0,0 +1,88 @@
+/* Copyright 2017 Netherlands eScience Center
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#pragma once
+
+/*! \file numeric/boundary.hh
+ *  \brief Boundary conditions, chosen per axis.
+ */
+
+#include "types.hh"
+
+#include <array>
+
+namespace HyperCanny {
+namespace numeric {
+    /*! \brief How samples beyond the edge of an array are found.
+     *
+     *  For an axis of length 4 holding `a b c d`, the samples on either
+     *  side are
+     *
+     *  | mode       | left      | right     |
+     *  |------------|-----------|-----------|
+     *  | `periodic` | `a b c d` | `a b c d` |
+     *  | `reflect`  | `d c b a` | `d c b a` |
+     *  | `nearest`  | `a a a a` | `d d d d` |
+     *  | `zero`     | `0 0 0 0` | `0 0 0 0` |
+     *
+     *  Periodic boundaries suit longitude, the others suit latitude and
+     *  time.
+     */
+    enum class Boundary { periodic, reflect, nearest, zero };
+
+    /*! \brief One boundary mode for each axis of an array.
+     */
+    template <unsigned D>
+    using boundary_t = std::array<Boundary, D>;
+
+    /*! \brief The same boundary mode for every axis.
+     */
+    template <unsigned D>
+    boundary_t<D> uniform_boundary(Boundary mode = Boundary::periodic)
+    {
+        boundary_t<D> result;
+        result.fill(mode);
+        return result;
+    }
+
+    /*! \brief Find the sample that stands in for index `i` on an axis of
+     *  length `n`.
+     *
+     *  Indices inside the axis are returned as they are. This is only
+     *  meant to be called near the edges of an array; interior loops
+     *  should not pay for it.
+     *
+     *  \return An index in `[0, n)`, or -1 if the sample is zero.
+     */
+    inline ptrdiff_t boundary_index(Boundary mode, ptrdiff_t i, ptrdiff_t n)
+    {
+        if (i >= 0 && i < n)
+            return i;
+
+        switch (mode)
+        {
+            case Boundary::periodic:
+                return (i % n + n) % n;
+            case Boundary::reflect:
+            {
+                ptrdiff_t p = (i % (2 * n) + 2 * n) % (2 * n);
+                return (p < n ? p : 2 * n - 1 - p);
+            }
+            case Boundary::nearest:
+                return (i < 0 ? 0 : n - 1);
+            default:
+                return -1;
+        }
+    }
+}} // namespace HyperCanny::numeric
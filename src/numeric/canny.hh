@@ -19,79 +19,227 @@
  */
 
 #include "filters.hh"
+#include "edge_mask.hh"
+
+#include <atomic>
+#include <functional>
+#include <unordered_map>
 
 namespace HyperCanny {
 namespace numeric {
 namespace filter {
+    /*! \brief Memory layout of the homogeneous vectors in the output of
+     *  the Sobel filter, an NdArray<real_t,D+1> with shape
+     *  <D+1, n_1, ..., n_D>.
+     *
+     *  `interleaved` stores the D+1 values of each pixel next to each
+     *  other, so the component axis is the fastest. `planar` stores one
+     *  contiguous plane of pixels per component, the inverse magnitude
+     *  last, so the component axis is the slowest and every pass over one
+     *  component has unit stride. All functions that take the Sobel
+     *  output accept either; they read the layout from its strides.
+     */
+    enum class VectorLayout { interleaved, planar };
+
+    /*! \brief Slice of the Sobel output of a D-dimensional array of
+     *  `shape`, in the given layout.
+     */
+    template <unsigned long D>
+    Slice<D+1> vector_slice(shape_t<D> const &shape, VectorLayout layout)
+    {
+        shape_t<D+1> vector_shape = extend_one(shape, D+1);
+        if (layout == VectorLayout::interleaved)
+            return Slice<D+1>(vector_shape);
+
+        stride_t<D> plane = calc_stride<D>(shape);
+        stride_t<D+1> stride = extend_one(plane, ptrdiff_t(calc_size<D>(shape)));
+        return Slice<D+1>(0, vector_shape, stride);
+    }
+
+    /*! \brief New array for the Sobel output of a D-dimensional array of
+     *  `shape`, in the given layout.
+     */
+    template <typename T, unsigned D>
+    NdArray<T, D+1> vector_array(shape_t<D> const &shape, VectorLayout layout)
+    {
+        Slice<D+1> slice = vector_slice<D>(shape, layout);
+        return NdArray<T, D+1>(slice, std::vector<T>(slice.size));
+    }
+
+    /*! \brief Copy of a Sobel output in the given layout, for callers
+     *  that need one or the other.
+     */
+    template <typename Input>
+    NdArray<typename array_traits<Input>::value_type, array_traits<Input>::dimension>
+    with_layout(Input const &input, VectorLayout layout)
+    {
+        constexpr unsigned D = array_traits<Input>::dimension - 1;
+        using value_type = typename array_traits<Input>::value_type;
+
+        Slice<D> const source = input.slice().sel(0, 0);
+        auto result = vector_array<value_type, D>(source.shape, layout);
+        Slice<D> const target = result.slice().sel(0, 0);
+
+        ptrdiff_t const from = input.slice().stride[0],
+                        to = result.slice().stride[0];
+        auto const *src = input.const_container().data();
+        auto *dst = result.container().data();
+        Slice<D> const grid(source.shape);
+        size_t const n = grid.shape[0];
+        ptrdiff_t const src_step = source.stride[0], dst_step = target.stride[0];
+        size_t const n_lines = (n > 0 ? grid.size / n : 0);
+
+        #pragma omp parallel
+        {
+            #pragma omp for nowait
+            for (size_t line = 0; line < n_lines; ++line)
+            {
+                shape_t<D> index = grid.index(line * n);
+                auto const *s = src + source.flat_index(index);
+                auto *d = dst + target.flat_index(index);
+                for (unsigned k = 0; k <= D; ++k)
+                    for (size_t i = 0; i < n; ++i)
+                        d[k * to + i * dst_step] = s[k * from + i * src_step];
+            }
+        }
+        return result;
+    }
+
     /*! \brief Normalize homogeneous vectors
      *
      *  The output of the Sobel filter is stored in an array of
      *  homogeneous vectors. These vectors have one extra dimension to
      *  store an extra scaling factor. This function puts the
-     *  homogeneous coordinates in a normalised form.
+     *  homogeneous coordinates in a normalised form. Both layouts of
+     *  `VectorLayout` are accepted; pixels are visited along the first
+     *  spatial axis.
      */
     template <typename Input>
     void normalize_homogeneous_vectors(Input &input)
     {
         constexpr unsigned D = array_traits<Input>::dimension - 1;
-        using real_t = typename array_traits<Input>::value_type;
+        using real_t = compute_t<typename array_traits<Input>::value_type>;
+
+        Slice<D> const spatial = input.slice().sel(0, 0);
+        ptrdiff_t const component = input.slice().stride[0];
+        auto *data = input.container().data();
+        Slice<D> const grid(spatial.shape);
+        size_t const n = grid.shape[0];
+        ptrdiff_t const step = spatial.stride[0];
+        size_t const n_lines = (n > 0 ? grid.size / n : 0);
 
-        auto vec_view = input.template view_reduced_to<D + 1>();
         #pragma omp parallel
         {
             #pragma omp for nowait
-            for (size_t i = 0; i < vec_view.size(); ++i)
+            for (size_t line = 0; line < n_lines; ++line)
             {
-                auto &x = vec_view[i];
+                auto *v = data + spatial.flat_index(grid.index(line * n));
+                for (size_t i = 0; i < n; ++i)
+                {
+                    auto *x = v + i * step;
 
-                real_t l2 = 0.0;
-                for (unsigned k = 0; k < D; ++k)
-                    l2 += x[k]*x[k];
+                    real_t l2 = 0.0;
+                    for (unsigned k = 0; k < D; ++k)
+                    {
+                        real_t c = x[k * component];
+                        l2 += c*c;
+                    }
 
-                if (l2 == 0.0)
-                {
-                    x[D] = std::numeric_limits<real_t>::infinity();
-                    continue;
-                }
+                    if (l2 == 0.0)
+                    {
+                        x[D * component] = std::numeric_limits<real_t>::infinity();
+                        continue;
+                    }
 
-                x[D] = 1. / sqrt(l2);
-                for (unsigned k = 0; k < D; ++k)
-                    x[k] *= x[D];
+                    real_t inverse = 1. / sqrt(l2);
+                    x[D * component] = inverse;
+                    for (unsigned k = 0; k < D; ++k)
+                        x[k * component] = x[k * component] * inverse;
+                }
             }
         }
     }
 
     /*! \brief Gaussian smoothing and sobel operator.
      *
-     *  Calls the sobel() function with kernels that have been
+     *  Calls the sobel_components() function with kernels that have been
      *  convolved with a specified Gaussian. This provides smoothing
      *  and Sobel filtering in one go. Since the resulting filter has
      *  a size of the sum of the specified Gaussian and sobel operators,
      *  this version may actually be slower than having a separate
      *  Gaussian filter step.
+     *
+     *  With `GaussianMethod::recursive`, the input is first smoothed with
+     *  the recursive Gaussian, after which the plain Sobel operator is
+     *  applied; `n` is then ignored and the cost does not depend on
+     *  `sigma`.
+     *
+     *  The result is written to `output`, of rank one higher than
+     *  `input`, which may wrap memory owned by the caller. Besides the
+     *  output, two scratch arrays of the size of the input are allocated.
+     *  These have the value type of the output, so with an output of
+     *  `half` or `bfloat16` (see numeric/half.hh) all intermediate arrays
+     *  take half the memory; the filters still compute in `float`.
+     *
+     *  `boundary` gives the boundary mode for each axis; the recursive
+     *  method only supports periodic boundaries.
      */
-    template <typename Input>
-    NdArray<typename array_traits<Input>::value_type, array_traits<Input>::dimension+1>
-    smooth_sobel(Input const &input, unsigned n, double sigma)
+    template <typename Input, typename Output>
+    void smooth_sobel(Input const &input, unsigned n, double sigma,
+                      Output &output,
+                      GaussianMethod method = GaussianMethod::direct,
+                      boundary_t<array_traits<Input>::dimension> const &boundary =
+                          uniform_boundary<array_traits<Input>::dimension>())
     {
         constexpr unsigned D = array_traits<Input>::dimension;
-        using real_t = typename array_traits<Input>::value_type;
-        using output_type = NdArray<real_t, D+1>;
+        using real_t = compute_t<typename array_traits<Input>::value_type>;
+        using buffer_type = NdArray<
+            typename array_traits<Output>::value_type, D>;
 
-        auto G = gaussian_kernel<real_t>(n, sigma);
-        auto smooth_kernel = convolve_padding_zero(
-                NdArray<real_t, 1>({3}, {0.25, 0.50, 0.25}), G);
-        auto gradient_kernel = convolve_padding_zero(
-                NdArray<real_t, 1>({3}, {0.5, 0.0, -0.5}), G);
+        buffer_type buffer_a(input.shape()), buffer_b(input.shape());
 
-        output_type output(extend_one(input.shape(), D+1));
-        for (unsigned k = 0; k < D; ++k)
+        if (method == GaussianMethod::recursive)
+        {
+            gaussian(input, n, sigma, buffer_a, method, boundary);
+            sobel_components(
+                buffer_a,
+                NdArray<real_t, 1>({3}, {0.25, 0.50, 0.25}),
+                NdArray<real_t, 1>({3}, {0.5, 0.0, -0.5}),
+                output, buffer_b, boundary);
+        }
+        else
         {
-            auto outs = output.sel(0, k);
-            outs = sobel(input, k, smooth_kernel, gradient_kernel);
+            auto G = gaussian_kernel<real_t>(n, sigma);
+            auto smooth_kernel = convolve_padding_zero(
+                    NdArray<real_t, 1>({3}, {0.25, 0.50, 0.25}), G);
+            auto gradient_kernel = convolve_padding_zero(
+                    NdArray<real_t, 1>({3}, {0.5, 0.0, -0.5}), G);
+
+            sobel_components(
+                input, smooth_kernel, gradient_kernel, output,
+                buffer_a, buffer_b, boundary);
         }
 
         normalize_homogeneous_vectors(output);
+    }
+
+    /*! \brief Gaussian smoothing and sobel operator.
+     *
+     *  As above, returning a new array in the given layout.
+     */
+    template <typename Input>
+    NdArray<typename array_traits<Input>::value_type, array_traits<Input>::dimension+1>
+    smooth_sobel(Input const &input, unsigned n, double sigma,
+                 GaussianMethod method = GaussianMethod::direct,
+                 boundary_t<array_traits<Input>::dimension> const &boundary =
+                     uniform_boundary<array_traits<Input>::dimension>(),
+                 VectorLayout layout = VectorLayout::interleaved)
+    {
+        constexpr unsigned D = array_traits<Input>::dimension;
+        using value_type = typename array_traits<Input>::value_type;
+
+        auto output = vector_array<value_type, D>(input.shape(), layout);
+        smooth_sobel(input, n, sigma, output, method, boundary);
         return output;
     }
 
@@ -105,82 +253,789 @@ namespace filter {
      */
     template <typename Input>
     NdArray<typename array_traits<Input>::value_type, array_traits<Input>::dimension+1>
-    sobel(Input const &input)
+    sobel(Input const &input, VectorLayout layout = VectorLayout::interleaved)
     {
         constexpr unsigned D = array_traits<Input>::dimension;
-        using real_t = typename array_traits<Input>::value_type;
-        using output_type = NdArray<real_t, D+1>;
+        using value_type = typename array_traits<Input>::value_type;
+        using real_t = compute_t<value_type>;
 
-        output_type output(extend_one(input.shape(), D+1));
-        for (unsigned k = 0; k < D; ++k)
-        {
-            auto outs = output.sel(0, k);
-            outs = sobel(input, k);
-        }
+        auto output = vector_array<value_type, D>(input.shape(), layout);
+        sobel_components(
+            input,
+            NdArray<real_t, 1>({3}, {0.25, 0.50, 0.25}),
+            NdArray<real_t, 1>({3}, {0.5, 0.0, -0.5}),
+            output);
 
         normalize_homogeneous_vectors(output);
         return output;
     }
 
 
-    /*! \brief Edge thinning by non-maximum supression.
+    /*! \brief Method of non-maximum suppression.
      *
-     *  This assumes that the input consists of homogeneous n-vectors in
-     *  normalised form. By rounding a unit-vector to 0/1 values the
-     *  neighbouring pixels up and down the gradient direction are found. If
-     *  the vector magnitude of the center pixel is larger than both selected
-     *  neighbouring pixels, it is kept as an edge pixel.
-     *
-     *  \param input NdArray<real_t,D+1> with shape <D+1, n_1, ..., n_D>
-     *  \return bit mask NdArray<bool,D> with shape <n_1, ..., n_D>
-     *
-     *  The loop in this function is not parallel, because writing to a boolean
-     *  array is not safe, and overhead for an omp critical write is too much.
+     *  `rounded` rounds the unit gradient to -1/0/1 along each axis, and
+     *  compares with the two nearest lattice neighbours along it.
+     *  `interpolated` samples the inverse magnitude one step along the
+     *  gradient, where a step ends on the faces of the 3^D neighbourhood,
+     *  by multilinear interpolation between the 2^(D-1) nearest corners.
+     *  Since \f$1/x\f$ is convex, the interpolated inverse is never less
+     *  than the inverse of the interpolated magnitude, so this keeps every
+     *  pixel that interpolating the magnitude itself would keep, plus some
+     *  near ties.
      */
-    template <typename Input>
-    NdArray<bool, array_traits<Input>::dimension - 1>
-    edge_thinning(Input const &input)
+    enum class ThinningMethod { rounded, interpolated };
+
+    namespace detail
     {
-        using real_t = typename array_traits<Input>::value_type;
-        constexpr unsigned D = array_traits<Input>::dimension - 1;
+#ifdef HYPER_CANNY_X86_SIMD
+        /*! \brief Interpolated non-maximum suppression of `count` pixels
+         *  of a line, eight at a time, for `float` input.
+         *
+         *  `x` points to the first component of the first pixel, pixels are
+         *  `step` apart and components `component` apart; `plus` and
+         *  `minus` hold the memory offsets of one step forward and back
+         *  along each axis, which near the border follow the boundary mode.
+         *  All offsets should fit in 32 bits. The arithmetic follows the
+         *  scalar version step by step, so the results are the same.
+         *  Returns the number of pixels done, a multiple of eight.
+         */
+        template <unsigned D>
+        __attribute__((target("avx2")))
+        size_t thin_interpolated_avx2(
+                float const *x, int32_t step, int32_t component,
+                std::array<int32_t, D> const &plus,
+                std::array<int32_t, D> const &minus, size_t count,
+                uint8_t *o, float *sub)
+        {
+            constexpr size_t C = size_t(1) << (D - 1);
+            __m256 const zero = _mm256_setzero_ps();
+            __m256 const one = _mm256_set1_ps(1.0f);
+            __m256 const sign = _mm256_set1_ps(-0.0f);
+            __m256 const infinity = _mm256_set1_ps(std::numeric_limits<float>::infinity());
+            __m256i const lanes = _mm256_mullo_epi32(
+                _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32(step));
+            float const *m = x + D * component;
 
-        auto vec_view = input.template const_view_reduced_to<D + 1>();
-        shape_t<D> window_shape;
-        window_shape.fill(3);
+            size_t i = 0;
+            for (; i + 8 <= count; i += 8)
+            {
+                __m256i index = _mm256_add_epi32(
+                    lanes, _mm256_set1_epi32(int32_t(i) * step));
 
-        auto output_shape = reduce_one(input.shape(), 0);
-        NdArray<bool, D> output(output_shape);
+                // in the planar layout the pixel itself is a plain load
+                __m256 g[D], abs_g[D];
+                for (unsigned k = 0; k < D; ++k)
+                {
+                    g[k] = (step == 1 ? _mm256_loadu_ps(x + k * component + i)
+                                      : _mm256_i32gather_ps(x + k * component, index, 4));
+                    abs_g[k] = _mm256_andnot_ps(sign, g[k]);
+                }
+                __m256 value = (step == 1 ? _mm256_loadu_ps(m + i)
+                                          : _mm256_i32gather_ps(m, index, 4));
 
-        auto outbit = output.begin();
-        for (auto i = vec_view.begin(); i != vec_view.end(); ++i)
+                // axis of the largest component, its steps and sign
+                __m256i a = _mm256_setzero_si256();
+                __m256 big = abs_g[0], g_a = g[0];
+                __m256i plus_a = _mm256_set1_epi32(plus[0]);
+                __m256i minus_a = _mm256_set1_epi32(minus[0]);
+                for (unsigned k = 1; k < D; ++k)
+                {
+                    __m256 larger = _mm256_cmp_ps(abs_g[k], big, _CMP_GT_OQ);
+                    __m256i l = _mm256_castps_si256(larger);
+                    big = _mm256_blendv_ps(big, abs_g[k], larger);
+                    g_a = _mm256_blendv_ps(g_a, g[k], larger);
+                    a = _mm256_blendv_epi8(a, _mm256_set1_epi32(k), l);
+                    plus_a = _mm256_blendv_epi8(plus_a, _mm256_set1_epi32(plus[k]), l);
+                    minus_a = _mm256_blendv_epi8(minus_a, _mm256_set1_epi32(minus[k]), l);
+                }
+                __m256 scale = _mm256_div_ps(one, big);
+
+                // corners ahead `d` and behind `e`, with weights `w`
+                __m256 w[C];
+                __m256i d[C], e[C];
+                w[0] = one;
+                __m256i positive = _mm256_castps_si256(_mm256_cmp_ps(g_a, zero, _CMP_GT_OQ));
+                d[0] = _mm256_blendv_epi8(minus_a, plus_a, positive);
+                e[0] = _mm256_blendv_epi8(plus_a, minus_a, positive);
+                for (unsigned l = 0; l + 1 < D; ++l)
+                {
+                    // axis l, or l + 1 at and beyond the largest axis
+                    __m256i beyond = _mm256_cmpgt_epi32(_mm256_set1_epi32(l + 1), a);
+                    __m256 abs_k = _mm256_blendv_ps(
+                        abs_g[l], abs_g[l + 1], _mm256_castsi256_ps(beyond));
+                    __m256 g_k = _mm256_blendv_ps(
+                        g[l], g[l + 1], _mm256_castsi256_ps(beyond));
+                    __m256i plus_k = _mm256_blendv_epi8(
+                        _mm256_set1_epi32(plus[l]), _mm256_set1_epi32(plus[l + 1]), beyond);
+                    __m256i minus_k = _mm256_blendv_epi8(
+                        _mm256_set1_epi32(minus[l]), _mm256_set1_epi32(minus[l + 1]), beyond);
+
+                    __m256 t = _mm256_mul_ps(abs_k, scale);
+                    __m256 u = _mm256_sub_ps(one, t);
+                    __m256i positive_k = _mm256_castps_si256(_mm256_cmp_ps(g_k, zero, _CMP_GT_OQ));
+                    __m256i s = _mm256_blendv_epi8(minus_k, plus_k, positive_k);
+                    __m256i r = _mm256_blendv_epi8(plus_k, minus_k, positive_k);
+                    size_t n = size_t(1) << l;
+                    for (size_t j = 0; j < n; ++j)
+                    {
+                        d[j + n] = _mm256_add_epi32(d[j], s);
+                        e[j + n] = _mm256_add_epi32(e[j], r);
+                        w[j + n] = _mm256_mul_ps(w[j], t);
+                        w[j] = _mm256_mul_ps(w[j], u);
+                    }
+                }
+
+                __m256 ahead = zero, behind = zero;
+                for (size_t j = 0; j < C; ++j)
+                {
+                    __m256 used = _mm256_cmp_ps(w[j], zero, _CMP_GT_OQ);
+                    __m256 f = _mm256_i32gather_ps(m, _mm256_add_epi32(index, d[j]), 4);
+                    __m256 b = _mm256_i32gather_ps(m, _mm256_add_epi32(index, e[j]), 4);
+                    ahead = _mm256_add_ps(ahead, _mm256_and_ps(used, _mm256_mul_ps(w[j], f)));
+                    behind = _mm256_add_ps(behind, _mm256_and_ps(used, _mm256_mul_ps(w[j], b)));
+                }
+
+                __m256 finite = _mm256_cmp_ps(_mm256_andnot_ps(sign, value), infinity, _CMP_LT_OQ);
+                __m256 edge = _mm256_and_ps(finite, _mm256_and_ps(
+                    _mm256_cmp_ps(value, ahead, _CMP_LE_OQ),
+                    _mm256_cmp_ps(value, behind, _CMP_LE_OQ)));
+                int bits = _mm256_movemask_ps(edge);
+                for (unsigned j = 0; j < 8; ++j)
+                    o[i + j] = (bits >> j) & 1;
+
+                if (sub)
+                {
+                    __m256 two = _mm256_set1_ps(2.0f);
+                    __m256 rb = _mm256_div_ps(one, behind);
+                    __m256 rh = _mm256_div_ps(one, value);
+                    __m256 ra = _mm256_div_ps(one, ahead);
+                    __m256 curvature = _mm256_add_ps(
+                        _mm256_sub_ps(rb, _mm256_mul_ps(two, rh)), ra);
+                    __m256 vertex = _mm256_div_ps(
+                        _mm256_mul_ps(scale, _mm256_sub_ps(rb, ra)),
+                        _mm256_mul_ps(two, curvature));
+                    __m256 keep = _mm256_and_ps(edge, _mm256_cmp_ps(curvature, zero, _CMP_LT_OQ));
+                    _mm256_storeu_ps(sub + i, _mm256_and_ps(keep, vertex));
+                }
+            }
+            return i;
+        }
+
+        /*! \brief Positions in [0, count) of the values at most `cutoff`,
+         *  compared eight at a time, for `float` input. Values are `step`
+         *  apart. Returns the number of positions written to `out`.
+         */
+        __attribute__((target("avx2")))
+        inline size_t select_below_avx2(
+                float const *x, int32_t step, size_t count, float cutoff,
+                uint32_t *out)
         {
-            shape_t<D> index = i.index();
-            stride_t<D> window_offset = index - window_shape / 2;
-            NdArray<real_t, D> window(window_shape);
-            window = input.sel(0, D).const_periodic_view(window_offset, window_shape);
+            __m256i const lanes = _mm256_mullo_epi32(
+                _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32(step));
+            __m256 const c = _mm256_set1_ps(cutoff);
 
-            shape_t<D> wia, wib;
+            size_t i = 0, n = 0;
+            for (; i + 8 <= count; i += 8)
+            {
+                __m256 value = (step == 1 ? _mm256_loadu_ps(x + i) : _mm256_i32gather_ps(
+                    x, _mm256_add_epi32(lanes, _mm256_set1_epi32(int32_t(i) * step)), 4));
+                unsigned bits = _mm256_movemask_ps(_mm256_cmp_ps(value, c, _CMP_LE_OQ));
+                for (; bits != 0; bits &= bits - 1)
+                    out[n++] = uint32_t(i + __builtin_ctz(bits));
+            }
+            for (; i < count; ++i)
+            {
+                out[n] = uint32_t(i);
+                n += (x[i * step] <= cutoff);
+            }
+            return n;
+        }
+#endif
+
+        /*! \brief Positions in [0, count) of the values at most `cutoff`.
+         *  Values are `step` apart. Returns the number of positions written
+         *  to `out`.
+         */
+        template <typename T>
+        size_t select_below(
+                T const *x, ptrdiff_t step, size_t count, double cutoff,
+                uint32_t *out)
+        {
+            size_t n = 0;
+            for (size_t i = 0; i < count; ++i)
+            {
+                out[n] = uint32_t(i);
+                n += (compute_t<T>(x[i * step]) <= cutoff);
+            }
+            return n;
+        }
+
+        /*! \brief Number of pixels in the blocks that are thinned in
+         *  parallel; a whole number of words of any mask.
+         */
+        constexpr size_t thinning_block = 4096;
+
+        /*! \brief Non-maximum suppression of `input`, one byte per pixel.
+         *
+         *  The pixels are divided over OpenMP threads in blocks of
+         *  `thinning_block`. Each block of pixels [first, last) is written
+         *  to `bytes + first`, or to a buffer if `bytes` is null, after
+         *  which `block(first, last, o)` is called, on the same thread,
+         *  with a pointer `o` to the bytes of the block. With the
+         *  interpolated method, `offset` may point to a contiguous array,
+         *  which receives the sub-voxel position of each edge.
+         *
+         *  Pixels with a value above `cutoff` are never edges. With a
+         *  finite cutoff, each piece of a line first selects the pixels
+         *  at or below it and only those are compared with their
+         *  neighbours, which pays when the cutoff is the upper threshold
+         *  and most pixels are above it.
+         */
+        template <ThinningMethod method, typename Input, typename Block>
+        void edge_thinning(
+                Input const &input, uint8_t *bytes, float *offset,
+                boundary_t<array_traits<Input>::dimension - 1> const &boundary,
+                double cutoff, Block block)
+        {
+            constexpr unsigned D = array_traits<Input>::dimension - 1;
+            using real_t = compute_t<typename array_traits<Input>::value_type>;
+            constexpr bool interpolated = (method == ThinningMethod::interpolated);
+            constexpr size_t C = size_t(1) << (D - 1);
+
+            Slice<D> const spatial = input.slice().sel(0, 0);
+            ptrdiff_t const component = input.slice().stride[0];
+            auto const *data = input.const_container().data();
+
+            shape_t<D> const shape = spatial.shape;
+            Slice<D> const grid(shape);
+            if (grid.size == 0)
+                return;
+
+            // memory offset for each rounded direction d, stored at
+            // sum_k (d_k + 1) 3^k
+            size_t table_size = 1;
             for (unsigned k = 0; k < D; ++k)
+                table_size *= 3;
+            std::vector<ptrdiff_t> offsets(table_size);
+            for (size_t j = 0; j < table_size; ++j)
             {
-                unsigned d = round((*i)[k]);
-                wia[k] = 1 - d;
-                wib[k] = 1 + d;
+                ptrdiff_t offset = 0;
+                size_t q = j;
+                for (unsigned k = 0; k < D; ++k, q /= 3)
+                    offset += (ptrdiff_t(q % 3) - 1) * spatial.stride[k];
+                offsets[j] = offset;
             }
 
-            real_t value = (*i)[D];
-            real_t a = window[wia];
-            real_t b = window[wib];
+            // std::round for components in [-1, 1], plus one
+            auto round_one = [] (real_t x)
+            {
+                return 1 + int(x >= real_t(0.5)) - int(x <= real_t(-0.5));
+            };
 
-            if (not std::isfinite(value))
-                *outbit = false;
-            else
-                *outbit = (value <= a) && (value <= b);
-            ++outbit;
+            // Corners of the interpolated sample one step along the
+            // gradient, as steps of -1/0/1 along each axis, and their
+            // weights; the step back uses the opposite corners. Returns
+            // the length of the step.
+            using corners_t = std::array<std::array<int, D>, C>;
+            auto corners = [] (std::array<real_t, D> const &g,
+                               corners_t &d, std::array<real_t, C> &w)
+            {
+                unsigned a = 0;
+                for (unsigned k = 1; k < D; ++k)
+                    if (std::abs(g[k]) > std::abs(g[a]))
+                        a = k;
+                real_t scale = 1 / std::abs(g[a]);
+
+                w[0] = 1;
+                d[0].fill(0);
+                d[0][a] = (g[a] > 0 ? 1 : -1);
+                size_t n = 1;
+                for (unsigned k = 0; k < D; ++k)
+                {
+                    if (k == a)
+                        continue;
+                    real_t t = std::abs(g[k]) * scale;
+                    for (size_t j = 0; j < n; ++j)
+                    {
+                        d[j + n] = d[j];
+                        d[j + n][k] = (g[k] > 0 ? 1 : -1);
+                        w[j + n] = w[j] * t;
+                        w[j] *= 1 - t;
+                    }
+                    n *= 2;
+                }
+                return scale;
+            };
+
+            // the same, as memory offsets, for pixels away from the border
+            auto corner_offsets = [&] (std::array<real_t, D> const &g,
+                                       std::array<ptrdiff_t, C> &d,
+                                       std::array<real_t, C> &w)
+            {
+                unsigned a = 0;
+                for (unsigned k = 1; k < D; ++k)
+                    if (std::abs(g[k]) > std::abs(g[a]))
+                        a = k;
+                real_t scale = 1 / std::abs(g[a]);
+
+                w[0] = 1;
+                d[0] = (g[a] > 0 ? spatial.stride[a] : -spatial.stride[a]);
+                for (unsigned l = 0; l + 1 < D; ++l)
+                {
+                    unsigned k = l + (l >= a);
+                    size_t n = size_t(1) << l;
+                    real_t t = std::abs(g[k]) * scale;
+                    ptrdiff_t s = (g[k] > 0 ? spatial.stride[k] : -spatial.stride[k]);
+                    for (size_t j = 0; j < n; ++j)
+                    {
+                        d[j + n] = d[j] + s;
+                        w[j + n] = w[j] * t;
+                        w[j] *= 1 - t;
+                    }
+                }
+                return scale;
+            };
+
+            // weighted sum, where zero weights mask infinite values
+            auto weighted = [] (real_t w, real_t v)
+            {
+                return (w > 0 ? w * v : real_t(0));
+            };
+
+            // Sub-voxel position of the maximum of the parabola through
+            // the magnitudes one step back, here and one step ahead.
+            auto vertex = [] (real_t back, real_t here, real_t ahead, real_t step)
+            {
+                real_t b = 1 / back, h = 1 / here, a = 1 / ahead;
+                real_t curvature = b - 2 * h + a;
+                return (curvature < 0 ? step * (b - a) / (2 * curvature) : real_t(0));
+            };
+
+            // Memory offsets of the positions -1, 0 and 1 steps along each
+            // axis from a pixel near the border, found by boundary mode.
+            using near_t = std::array<std::array<ptrdiff_t, 3>, D>;
+            constexpr ptrdiff_t outside = std::numeric_limits<ptrdiff_t>::min();
+            auto near_axis = [&] (near_t &near, unsigned k, size_t i)
+            {
+                for (int s = -1; s <= 1; ++s)
+                {
+                    ptrdiff_t q = boundary_index(
+                        boundary[k], ptrdiff_t(i) + s, shape[k]);
+                    near[k][s + 1] = (q < 0 ? outside : q * spatial.stride[k]);
+                }
+            };
+
+            // inverse magnitude at a step `d` away
+            auto neighbour = [&] (near_t const &near, std::array<int, D> const &d)
+            {
+                ptrdiff_t flat = spatial.offset + D * component;
+                for (unsigned k = 0; k < D; ++k)
+                {
+                    ptrdiff_t q = near[k][d[k] + 1];
+                    if (q == outside)
+                        return std::numeric_limits<real_t>::infinity();
+                    flat += q;
+                }
+                return real_t(data[flat]);
+            };
+
+            size_t const n = shape[0];
+            ptrdiff_t const step = spatial.stride[0];
+
+            // the AVX2 kernel takes float input with 32-bit offsets
+            constexpr bool vector_kernel = interpolated && std::is_same<
+                typename array_traits<Input>::value_type, float>::value;
+            ptrdiff_t extent = D * std::abs(component);
+            for (unsigned k = 0; k < D; ++k)
+                extent += std::abs(spatial.stride[k]) * ptrdiff_t(shape[k]);
+            bool const use_vector_kernel = vector_kernel
+                && extent < std::numeric_limits<int32_t>::max()
+                && simd::level() >= simd::Level::avx2;
+
+            // Pruning by cutoff; the vector compare takes float input, with
+            // the cutoff rounded down to the nearest float.
+            bool const prune = (cutoff < std::numeric_limits<double>::infinity());
+            constexpr bool float_input = std::is_same<
+                typename array_traits<Input>::value_type, float>::value;
+            bool const use_vector_select = float_input
+                && extent < std::numeric_limits<int32_t>::max()
+                && simd::level() >= simd::Level::avx2;
+            float cutoff_f = float(cutoff);
+            if (double(cutoff_f) > cutoff)
+                cutoff_f = std::nextafter(cutoff_f, -std::numeric_limits<float>::infinity());
+
+            // pixels [i0, i1) of a line, written to o[0 .. i1 - i0); with
+            // pruning, `candidates` has room for i1 - i0 positions
+            auto thin_line = [&] (size_t line, size_t i0, size_t i1, uint8_t *o,
+                                  uint32_t *candidates)
+            {
+                shape_t<D> index = grid.index(line * n);
+                bool inside = (n > 2);
+                for (unsigned k = 1; k < D; ++k)
+                    inside = inside && index[k] >= 1 && index[k] + 1 < shape[k];
+
+                size_t begin = std::max(i0, std::min(i1, size_t(inside ? 1 : n)));
+                size_t end = std::max(begin, std::min(i1, inside ? n - 1 : n));
+                auto const *v = data + spatial.flat_index(index);
+                float *sub = (offset ? offset + line * n : nullptr);
+
+                near_t near;
+                for (unsigned k = 1; k < D; ++k)
+                    near_axis(near, k, index[k]);
+
+                auto border = [&] (size_t i)
+                {
+                    auto const *x = v + i * step;
+                    real_t value = x[D * component];
+                    if (not std::isfinite(value))
+                    {
+                        o[i - i0] = 0;
+                        if (sub)
+                            sub[i] = 0;
+                        return;
+                    }
+
+                    near_axis(near, 0, i);
+                    if constexpr (interpolated)
+                    {
+                        std::array<real_t, D> g;
+                        for (unsigned k = 0; k < D; ++k)
+                            g[k] = x[k * component];
+                        corners_t d, back;
+                        std::array<real_t, C> w;
+                        real_t length = corners(g, d, w);
+
+                        real_t ahead = 0, behind = 0;
+                        for (size_t j = 0; j < C; ++j)
+                        {
+                            for (unsigned k = 0; k < D; ++k)
+                                back[j][k] = -d[j][k];
+                            ahead += weighted(w[j], neighbour(near, d[j]));
+                            behind += weighted(w[j], neighbour(near, back[j]));
+                        }
+                        bool edge = (value <= ahead) && (value <= behind);
+                        o[i - i0] = edge;
+                        if (sub)
+                            sub[i] = (edge ? vertex(behind, value, ahead, length) : 0);
+                    }
+                    else
+                    {
+                        std::array<int, D> d, back;
+                        for (unsigned k = 0; k < D; ++k)
+                        {
+                            d[k] = round_one(x[k * component]) - 1;
+                            back[k] = -d[k];
+                        }
+                        o[i - i0] = (value <= neighbour(near, back))
+                                 && (value <= neighbour(near, d));
+                    }
+                };
+
+                auto interior = [&] (size_t i)
+                {
+                    auto const *x = v + i * step;
+                    real_t value = x[D * component];
+                    if (not std::isfinite(value))
+                    {
+                        o[i - i0] = 0;
+                        if (sub)
+                            sub[i] = 0;
+                        return;
+                    }
+
+                    auto const *m = x + D * component;
+                    if constexpr (interpolated)
+                    {
+                        std::array<real_t, D> g;
+                        for (unsigned k = 0; k < D; ++k)
+                            g[k] = x[k * component];
+                        std::array<ptrdiff_t, C> d;
+                        std::array<real_t, C> w;
+                        real_t length = corner_offsets(g, d, w);
+
+                        real_t ahead = 0, behind = 0;
+                        for (size_t j = 0; j < C; ++j)
+                            ahead += weighted(w[j], real_t(m[d[j]]));
+                        if (value > ahead)
+                        {
+                            o[i - i0] = 0;
+                            if (sub)
+                                sub[i] = 0;
+                            return;
+                        }
+                        for (size_t j = 0; j < C; ++j)
+                            behind += weighted(w[j], real_t(m[-d[j]]));
+                        bool edge = (value <= behind);
+                        o[i - i0] = edge;
+                        if (sub)
+                            sub[i] = (edge ? vertex(behind, value, ahead, length) : 0);
+                    }
+                    else
+                    {
+                        size_t j = 0;
+                        for (unsigned k = D; k-- > 0; )
+                            j = 3 * j + round_one(x[k * component]);
+                        ptrdiff_t offset = offsets[j];
+
+                        o[i - i0] = (value <= real_t(m[-offset]))
+                                 && (value <= real_t(m[offset]));
+                    }
+                };
+
+                // Sparse candidates are thinned one by one. Dense ones
+                // go through the whole line, which is faster than picking
+                // them from it, above one in eight for the vector kernel
+                // and one in two otherwise; then the others are cleared.
+                size_t count = 0;
+                if (prune)
+                {
+                    auto const *m = v + i0 * step + D * component;
+#ifdef HYPER_CANNY_X86_SIMD
+                    if constexpr (float_input)
+                        if (use_vector_select)
+                            count = select_below_avx2(
+                                m, int32_t(step), i1 - i0, cutoff_f, candidates);
+                        else
+                            count = select_below(m, step, i1 - i0, cutoff, candidates);
+                    else
+#endif
+                        count = select_below(m, step, i1 - i0, cutoff, candidates);
+
+                    if (count * (use_vector_kernel ? 8 : 2) <= i1 - i0)
+                    {
+                        std::fill(o, o + (i1 - i0), uint8_t(0));
+                        if (sub)
+                            std::fill(sub + i0, sub + i1, 0.0f);
+                        for (size_t c = 0; c < count; ++c)
+                        {
+                            size_t i = i0 + candidates[c];
+                            if (i < begin || i >= end)
+                                border(i);
+                            else
+                                interior(i);
+                        }
+                        return;
+                    }
+                }
+
+                // Pixels [skip, skip_end) away from the border along the
+                // first axis go to the vector kernel; on lines near the
+                // border along other axes as well, unless a step leaves the
+                // array.
+                size_t skip = i0, skip_end = i0;
+#ifdef HYPER_CANNY_X86_SIMD
+                if constexpr (vector_kernel)
+                {
+                    std::array<int32_t, D> plus, minus;
+                    bool steps = use_vector_kernel && n > 2;
+                    for (unsigned k = 0; k < D && steps; ++k)
+                    {
+                        if (k == 0 || inside)
+                        {
+                            plus[k] = int32_t(spatial.stride[k]);
+                            minus[k] = int32_t(-spatial.stride[k]);
+                            continue;
+                        }
+                        steps = (near[k][0] != outside && near[k][2] != outside);
+                        if (!steps)
+                            break;
+                        ptrdiff_t here = ptrdiff_t(index[k]) * spatial.stride[k];
+                        plus[k] = int32_t(near[k][2] - here);
+                        minus[k] = int32_t(near[k][0] - here);
+                    }
+                    if (steps)
+                    {
+                        skip = std::max(i0, std::min(i1, size_t(1)));
+                        size_t last = std::max(skip, std::min(i1, n - 1));
+                        skip_end = skip + thin_interpolated_avx2<D>(
+                            v + skip * step, step, component, plus, minus,
+                            last - skip, o + (skip - i0),
+                            (sub ? sub + skip : nullptr));
+                    }
+                }
+#endif
+
+                for (size_t i = i0; i < begin; ++i)
+                    if (i < skip || i >= skip_end)
+                        border(i);
+
+                for (size_t i = std::max(begin, skip_end); i < end; ++i)
+                    interior(i);
+
+                for (size_t i = end; i < i1; ++i)
+                    border(i);
+
+                if (prune)
+                    for (size_t i = i0, c = 0; i < i1; ++i)
+                    {
+                        if (c < count && candidates[c] == i - i0)
+                        {
+                            ++c;
+                            continue;
+                        }
+                        o[i - i0] = 0;
+                        if (sub)
+                            sub[i] = 0;
+                    }
+            };
+
+            size_t const n_blocks = (grid.size + thinning_block - 1) / thinning_block;
+
+            #pragma omp parallel
+            {
+                std::vector<uint8_t> buffer(bytes ? 0 : thinning_block);
+                std::vector<uint32_t> candidates(prune ? thinning_block : 0);
+
+                #pragma omp for nowait
+                for (size_t b = 0; b < n_blocks; ++b)
+                {
+                    size_t first = b * thinning_block;
+                    size_t last = std::min(grid.size, first + thinning_block);
+                    uint8_t *o = (bytes ? bytes + first : buffer.data());
+                    for (size_t line = first / n; line * n < last; ++line)
+                    {
+                        size_t i0 = std::max(first, line * n) - line * n;
+                        size_t i1 = std::min(last, line * n + n) - line * n;
+                        thin_line(line, i0, i1, o + (line * n + i0 - first),
+                                  candidates.data());
+                    }
+                    block(first, last, o);
+                }
+            }
         }
 
+        /*! \brief Non-maximum suppression of `input` into `output`.
+         */
+        template <ThinningMethod method, typename Input,
+                  unsigned D, typename Word, typename Container>
+        void edge_thinning(
+                Input const &input, EdgeMask<D, Word, Container> &output,
+                float *offset,
+                boundary_t<array_traits<Input>::dimension - 1> const &boundary)
+        {
+            using mask_type = EdgeMask<D, Word, Container>;
+            static_assert(array_traits<Input>::dimension == D + 1,
+                          "Input should have one more dimension than the mask.");
+
+            if (output.shape() != input.slice().sel(0, 0).shape)
+                throw Exception("Shapes of input and mask do not match.");
+
+            edge_thinning<method>(
+                input, (mask_type::packed ? nullptr : output.bytes()),
+                offset, boundary, std::numeric_limits<double>::infinity(),
+                [&] (size_t first, size_t last, uint8_t const *o)
+            {
+                if (mask_type::packed)
+                    output.assign(first, o, last - first);
+            });
+        }
+    }
+
+    /*! \brief Edge thinning by non-maximum supression.
+     *
+     *  This assumes that the input consists of homogeneous n-vectors in
+     *  normalised form. Along the gradient direction, neighbouring
+     *  values of the magnitude are found (see `ThinningMethod`). If
+     *  the vector magnitude of the center pixel is larger than both
+     *  neighbouring values, it is kept as an edge pixel.
+     *
+     *  Neighbours beyond the edges of the array are found according to
+     *  `boundary`. With `Boundary::zero` there is no gradient outside the
+     *  array, so such a neighbour never suppresses the center pixel.
+     *  Lines along the first axis are split into an interior part, where
+     *  neighbour offsets are looked up in a table of the 3^D steps of
+     *  -1/0/1 along each axis, and the border pixels. Interpolated
+     *  thinning of `float` input gathers eight pixels at a time with AVX2,
+     *  where available. The input may be stored as `half` or `bfloat16`.
+     *
+     *  The pixels are divided over OpenMP threads in blocks of whole
+     *  words of the output mask, so the output may be packed.
+     *
+     *  \param input NdArray<real_t,D+1> with shape <D+1, n_1, ..., n_D>
+     *  \param output EdgeMask with shape <n_1, ..., n_D>
+     *  \param method Rounded or interpolated neighbours.
+     *  \param boundary Boundary mode for each of the D spatial axes.
+     */
+    template <typename Input, unsigned D, typename Word, typename Container>
+    void edge_thinning(
+            Input const &input, EdgeMask<D, Word, Container> &output,
+            ThinningMethod method,
+            boundary_t<array_traits<Input>::dimension - 1> const &boundary =
+                uniform_boundary<array_traits<Input>::dimension - 1>())
+    {
+        if (method == ThinningMethod::interpolated)
+            detail::edge_thinning<ThinningMethod::interpolated>(
+                input, output, nullptr, boundary);
+        else
+            detail::edge_thinning<ThinningMethod::rounded>(
+                input, output, nullptr, boundary);
+    }
+
+    template <typename Input, unsigned D, typename Word, typename Container>
+    void edge_thinning(
+            Input const &input, EdgeMask<D, Word, Container> &output,
+            boundary_t<array_traits<Input>::dimension - 1> const &boundary =
+                uniform_boundary<array_traits<Input>::dimension - 1>())
+    {
+        edge_thinning(input, output, ThinningMethod::rounded, boundary);
+    }
+
+    /*! \brief Interpolated edge thinning, that also finds the position of
+     *  each edge to sub-voxel precision.
+     *
+     *  A parabola is fitted to the magnitudes one step back, at the pixel
+     *  and one step ahead along the gradient. The position of its
+     *  maximum, as a distance in pixels from the pixel center along the
+     *  unit gradient, is written to `offset`; it lies within half a step.
+     *  Pixels that are not an edge get zero.
+     *
+     *  \param offset Contiguous NdArray<float,D> with shape <n_1, ..., n_D>
+     */
+    template <typename Input, unsigned D, typename Word, typename Container,
+              typename OffsetContainer>
+    void edge_thinning(
+            Input const &input, EdgeMask<D, Word, Container> &output,
+            NdArray<float, D, OffsetContainer> &offset,
+            boundary_t<array_traits<Input>::dimension - 1> const &boundary =
+                uniform_boundary<array_traits<Input>::dimension - 1>())
+    {
+        if (offset.shape() != output.shape())
+            throw Exception("Shapes of mask and offset do not match.");
+        detail::edge_thinning<ThinningMethod::interpolated>(
+            input, output, offset.container().data(), boundary);
+    }
+
+    /*! \brief Edge thinning by non-maximum supression, see above.
+     *
+     *  \param input NdArray<real_t,D+1> with shape <D+1, n_1, ..., n_D>
+     *  \param method Rounded or interpolated neighbours.
+     *  \param boundary Boundary mode for each of the D spatial axes.
+     *  \return byte mask EdgeMask<D> with shape <n_1, ..., n_D>
+     */
+    template <typename Input>
+    EdgeMask<array_traits<Input>::dimension - 1>
+    edge_thinning(
+            Input const &input, ThinningMethod method,
+            boundary_t<array_traits<Input>::dimension - 1> const &boundary =
+                uniform_boundary<array_traits<Input>::dimension - 1>())
+    {
+        constexpr unsigned D = array_traits<Input>::dimension - 1;
+
+        EdgeMask<D> output(input.slice().sel(0, 0).shape);
+        edge_thinning(input, output, method, boundary);
         return output;
     }
 
+    template <typename Input>
+    EdgeMask<array_traits<Input>::dimension - 1>
+    edge_thinning(
+            Input const &input,
+            boundary_t<array_traits<Input>::dimension - 1> const &boundary =
+                uniform_boundary<array_traits<Input>::dimension - 1>())
+    {
+        return edge_thinning(input, ThinningMethod::rounded, boundary);
+    }
+
     /*! \brief Generic queue based floodfill algorithm
      *
      *  \param predicate Predicate neighbour locations need to pass before
@@ -212,11 +1067,393 @@ namespace filter {
         }
     }
 
+    /*! \brief Class of a pixel after edge thinning and double threshold.
+     */
+    enum class EdgeClass : uint8_t { none, weak, strong };
+
+    namespace detail
+    {
+        /*! \brief Finds the 3^D - 1 neighbours of a pixel.
+         *
+         *  Neighbours are found across the edges of the array according to
+         *  `boundary`; with `Boundary::zero` there are none across the
+         *  edge. Pixels away from the border find their neighbours from a
+         *  fixed table of memory offsets.
+         */
+        template <unsigned D>
+        class Neighbourhood
+        {
+            Slice<D> m_slice;
+            boundary_t<D> m_boundary;
+            Slice<D> m_window;
+            std::vector<ptrdiff_t> m_offsets;
+            std::vector<uint8_t> m_digits;
+            std::vector<uint8_t> m_inside;
+            std::vector<size_t> m_neighbours;
+
+            public:
+                Neighbourhood(shape_t<D> const &shape, boundary_t<D> const &boundary)
+                    : m_slice(shape)
+                    , m_boundary(boundary)
+                {
+                    shape_t<D> window_shape;
+                    window_shape.fill(3);
+                    m_window = Slice<D>(window_shape);
+                    for (size_t j = 0; j < m_window.size; ++j)
+                    {
+                        shape_t<D> w = m_window.index(j);
+                        for (unsigned k = 0; k < D; ++k)
+                            m_digits.push_back(uint8_t(w[k]));
+                        ptrdiff_t offset = 0;
+                        for (unsigned k = 0; k < D; ++k)
+                            offset += (ptrdiff_t(w[k]) - 1) * m_slice.stride[k];
+                        if (offset != 0)
+                            m_offsets.push_back(offset);
+                    }
+                    m_neighbours.reserve(m_window.size);
+
+                    // which lines along the first axis are away from the
+                    // border of the other axes
+                    size_t n = shape[0];
+                    m_inside.assign(n > 0 ? m_slice.size / n : 0, 0);
+                    for (size_t line = 0; line < m_inside.size(); ++line)
+                    {
+                        shape_t<D> index = m_slice.index(line * n);
+                        bool inside = (n > 2);
+                        for (unsigned k = 1; k < D; ++k)
+                            inside = inside && index[k] >= 1 && index[k] + 1 < shape[k];
+                        m_inside[line] = inside;
+                    }
+                }
+
+                /*! \brief Call `f` with the flat index of each neighbour.
+                 */
+                template <typename F>
+                void for_each(size_t i, F f) const
+                {
+                    size_t n = m_slice.shape[0], x = i % n;
+                    if (m_inside[i / n] && x >= 1 && x + 1 < n)
+                    {
+                        for (ptrdiff_t offset : m_offsets)
+                            f(i + offset);
+                        return;
+                    }
+
+                    // memory offsets of the positions -1, 0 and 1 along
+                    // each axis, negative outside the array
+                    shape_t<D> const &shape = m_slice.shape;
+                    shape_t<D> index = m_slice.index(i);
+                    std::array<std::array<ptrdiff_t, 3>, D> near;
+                    for (unsigned k = 0; k < D; ++k)
+                        for (unsigned s = 0; s < 3; ++s)
+                        {
+                            ptrdiff_t q = boundary_index(
+                                m_boundary[k], ptrdiff_t(index[k] + s) - 1, shape[k]);
+                            near[k][s] = (q < 0 ? -1 : q * m_slice.stride[k]);
+                        }
+
+                    for (size_t j = 0; j < m_window.size; ++j)
+                    {
+                        uint8_t const *w = &m_digits[j * D];
+                        ptrdiff_t flat = 0;
+                        for (unsigned k = 0; k < D && flat >= 0; ++k)
+                            flat = (near[k][w[k]] < 0 ? -1 : flat + near[k][w[k]]);
+                        if (flat >= 0 && size_t(flat) != i)
+                            f(size_t(flat));
+                    }
+                }
+
+                std::vector<size_t> const &operator()(size_t i)
+                {
+                    m_neighbours.clear();
+                    for_each(i, [this] (size_t j) { m_neighbours.push_back(j); });
+                    return m_neighbours;
+                }
+        };
+
+        /*! \brief Disjoint sets of pixel indices, which threads may unite
+         *  concurrently.
+         *
+         *  Sets are joined by linking the larger root to the smaller one
+         *  with a compare-and-swap, so a root only ever changes from
+         *  itself to a smaller index, and `find` halves paths on the way
+         *  (Jayanti and Tarjan, 2016). Lookups and unions may run at the
+         *  same time; the roots are only final once all unions are done.
+         */
+        template <typename Index>
+        class DisjointSets
+        {
+            std::vector<std::atomic<Index>> m_parent;
+
+            public:
+                explicit DisjointSets(size_t size)
+                    : m_parent(size)
+                {}
+
+                void make_set(size_t i)
+                {
+                    m_parent[i].store(Index(i), std::memory_order_relaxed);
+                }
+
+                Index find(Index x)
+                {
+                    while (true)
+                    {
+                        Index p = m_parent[x].load(std::memory_order_relaxed);
+                        if (p == x)
+                            return x;
+                        Index q = m_parent[p].load(std::memory_order_relaxed);
+                        if (q != p)
+                            m_parent[x].compare_exchange_weak(p, q);
+                        x = q;
+                    }
+                }
+
+                void unite(Index a, Index b)
+                {
+                    while (true)
+                    {
+                        a = find(a);
+                        b = find(b);
+                        if (a == b)
+                            return;
+                        if (a < b)
+                            std::swap(a, b);
+                        Index expected = a;
+                        if (m_parent[a].compare_exchange_strong(expected, b))
+                            return;
+                    }
+                }
+        };
+
+        /*! \brief Unite every pixel for which `member(i)` holds with its
+         *  neighbours that are members too, in parallel. Each pair of
+         *  neighbours is united once, from the pixel with the larger
+         *  index; the root of each set ends up at its smallest index.
+         */
+        template <unsigned D, typename Member, typename Index>
+        void connect_neighbours(
+                shape_t<D> const &shape, boundary_t<D> const &boundary,
+                Member member, DisjointSets<Index> &sets)
+        {
+            size_t const size = calc_size<D>(shape);
+            Neighbourhood<D> const neighbourhood(shape, boundary);
+
+            #pragma omp parallel
+            {
+                #pragma omp for
+                for (size_t i = 0; i < size; ++i)
+                    sets.make_set(i);
+
+                #pragma omp for schedule(dynamic, thinning_block) nowait
+                for (size_t i = 0; i < size; ++i)
+                {
+                    if (!member(i))
+                        continue;
+                    neighbourhood.for_each(i, [&] (size_t j)
+                    {
+                        if (j < i && member(j))
+                            sets.unite(Index(i), Index(j));
+                    });
+                }
+            }
+        }
+
+        /*! \brief Hysteresis by parallel connected components.
+         *
+         *  Only the weak and strong pixels get a node, numbered in
+         *  increasing order: the candidates are kept as a bit set with a
+         *  running count per word, from which the rank of a neighbour
+         *  follows with a popcount. Every candidate is united with its
+         *  candidate neighbours, the components that contain a strong
+         *  pixel are marked, and their pixels are written to `output`.
+         *  The result is the same as flood filling from the strong
+         *  pixels, since neighbourhoods are symmetric under every boundary
+         *  mode.
+         *
+         *  \param classes An `EdgeClass` for each pixel.
+         */
+        template <typename Index, unsigned D, typename Word, typename Container>
+        void union_find_hysteresis(
+                shape_t<D> const &shape, boundary_t<D> const &boundary,
+                uint8_t const *classes, EdgeMask<D, Word, Container> &output)
+        {
+            using mask_type = EdgeMask<D, Word, Container>;
+            constexpr uint8_t none = uint8_t(EdgeClass::none);
+            constexpr uint8_t strong = uint8_t(EdgeClass::strong);
+
+            size_t const size = calc_size<D>(shape);
+            size_t const n_words = (size + 63) / 64;
+            size_t const n_blocks = (size + thinning_block - 1) / thinning_block;
+
+            // candidates, and the rank of the first candidate of each word
+            std::vector<uint64_t> bits(n_words, 0);
+            std::vector<Index> offset(n_words + 1, 0);
+            #pragma omp parallel
+            {
+                #pragma omp for nowait
+                for (size_t w = 0; w < n_words; ++w)
+                {
+                    size_t first = w * 64, last = std::min(size, first + 64);
+                    uint64_t word = 0;
+                    for (size_t i = first; i < last; ++i)
+                        word |= uint64_t(classes[i] != none) << (i - first);
+                    bits[w] = word;
+                    offset[w + 1] = Index(__builtin_popcountll(word));
+                }
+            }
+            for (size_t w = 0; w < n_words; ++w)
+                offset[w + 1] += offset[w];
+
+            auto member = [&bits] (size_t j)
+            {
+                return (bits[j / 64] >> (j % 64)) & 1;
+            };
+
+            auto rank = [&bits, &offset] (size_t j)
+            {
+                uint64_t below = (uint64_t(1) << (j % 64)) - 1;
+                return Index(offset[j / 64] + __builtin_popcountll(bits[j / 64] & below));
+            };
+
+            size_t const n_nodes = offset[n_words];
+            DisjointSets<Index> sets(n_nodes);
+            std::vector<uint8_t> keep(n_nodes, 0);
+            Neighbourhood<D> const neighbourhood(shape, boundary);
+
+            #pragma omp parallel
+            {
+                #pragma omp for
+                for (size_t r = 0; r < n_nodes; ++r)
+                    sets.make_set(r);
+
+                // each pair of neighbours is united once, from the pixel
+                // with the larger index
+                #pragma omp for schedule(dynamic, 64)
+                for (size_t w = 0; w < n_words; ++w)
+                {
+                    Index r = offset[w];
+                    for (uint64_t word = bits[w]; word != 0; word &= word - 1, ++r)
+                    {
+                        size_t i = w * 64 + __builtin_ctzll(word);
+                        neighbourhood.for_each(i, [&] (size_t j)
+                        {
+                            if (j < i && member(j))
+                                sets.unite(r, rank(j));
+                        });
+                    }
+                }
+
+                #pragma omp for
+                for (size_t w = 0; w < n_words; ++w)
+                {
+                    Index r = offset[w];
+                    for (uint64_t word = bits[w]; word != 0; word &= word - 1, ++r)
+                    {
+                        if (classes[w * 64 + __builtin_ctzll(word)] != strong)
+                            continue;
+                        Index root = sets.find(r);
+                        #pragma omp atomic write
+                        keep[root] = 1;
+                    }
+                }
+
+                // blocks of whole words of the output
+                std::vector<uint8_t> buffer(mask_type::packed ? thinning_block : 0);
+
+                #pragma omp for nowait
+                for (size_t b = 0; b < n_blocks; ++b)
+                {
+                    size_t first = b * thinning_block;
+                    size_t last = std::min(size, first + thinning_block);
+                    uint8_t *o = (mask_type::packed ? buffer.data()
+                                                    : output.bytes() + first);
+                    std::fill(o, o + (last - first), uint8_t(0));
+                    for (size_t w = first / 64; w * 64 < last; ++w)
+                    {
+                        Index r = offset[w];
+                        for (uint64_t word = bits[w]; word != 0; word &= word - 1, ++r)
+                            o[w * 64 + __builtin_ctzll(word) - first] = keep[sets.find(r)];
+                    }
+                    if (mask_type::packed)
+                        output.assign(first, o, last - first);
+                }
+            }
+        }
+
+        /*! \brief Hysteresis on `classes`, with 32-bit indices where they
+         *  suffice.
+         */
+        template <unsigned D, typename Word, typename Container>
+        void union_find_hysteresis(
+                shape_t<D> const &shape, boundary_t<D> const &boundary,
+                uint8_t const *classes, EdgeMask<D, Word, Container> &output)
+        {
+            if (calc_size<D>(shape) <= std::numeric_limits<uint32_t>::max())
+                union_find_hysteresis<uint32_t, D>(shape, boundary, classes, output);
+            else
+                union_find_hysteresis<uint64_t, D>(shape, boundary, classes, output);
+        }
+    }
+
+    namespace detail
+    {
+        /*! \brief Double threshold by serial flood fill from each strong
+         *  pixel in turn. With `lower` above `upper`, the strong pixels
+         *  that are not weak only pass when no earlier flood reached them
+         *  first, so this order is kept for that case.
+         */
+        template <unsigned D, typename Input, typename Mask,
+                  typename Word, typename Container>
+        void flood_double_threshold(
+                Input const &input, Mask const &mask, double lower, double upper,
+                EdgeMask<D, Word, Container> &output, boundary_t<D> const &boundary)
+        {
+            using real_t = compute_t<typename array_traits<Input>::value_type>;
+
+            Slice<D> slice(mask.shape());
+            EdgeMask<D> done(slice.shape);
+            output.fill(false);
+
+            std::vector<real_t> value(slice.size);
+            auto magnitude = input.sel(0, D);
+            std::copy(magnitude.begin(), magnitude.end(), value.begin());
+
+            auto predicate = [&] (size_t i)
+            {
+                if (done[i]) return false;
+
+                done.set(i);
+                return mask[i] && !output[i] && (value[i] <= upper);
+            };
+
+            auto action = [&] (size_t i)
+            {
+                output.set(i);
+            };
+
+            Neighbourhood<D> get_neighbours(slice.shape, boundary);
+
+            for (size_t i = 0; i < slice.size; ++i)
+            {
+                if (!mask[i] || done[i] || (value[i] > lower))
+                    continue;
+                floodfill(predicate, action, std::ref(get_neighbours), i);
+            }
+        }
+    }
+
     /*! \brief Apply double threshold criterium to found edges.
      *
      *  Since the inverse of the vector magnitudes are stored, the
      *  lower values mean stronger edges.
      *
+     *  Edges are followed across the edges of the array according to
+     *  `boundary`; with `Boundary::zero` they are not followed at all.
+     *  The pixels are classified in parallel, after which connected
+     *  components of edge pixels are found by parallel union-find, and
+     *  those with a strong pixel are kept.
+     *
      *  \param input Output of sobel() function.
      *  \param mask Output of edge_thinning() function.
      *  \param lower Lower bound of double threshold, everything below this
@@ -224,57 +1461,467 @@ namespace filter {
      *  \param upper Upper bound of double threshold, everything above this
      *  value is definitely *not* an edge. Everything between `upper` and
      *  `lower` is only considered an edge if it is connected to an edge.
+     *  \param output EdgeMask of the same shape as `mask`, which is
+     *  overwritten with the result.
+     *  \param boundary Boundary mode for each of the D spatial axes.
      */
-    template <typename Input, typename Mask>
-    NdArray<bool, array_traits<Input>::dimension - 1>
-    double_threshold(Input const &input, Mask const &mask, double lower, double upper)
+    template <typename Input, typename Mask,
+              unsigned D, typename Word, typename Container>
+    void double_threshold(
+            Input const &input, Mask const &mask, double lower, double upper,
+            EdgeMask<D, Word, Container> &output,
+            boundary_t<array_traits<Input>::dimension - 1> const &boundary =
+                uniform_boundary<array_traits<Input>::dimension - 1>())
     {
-        constexpr unsigned D = array_traits<Input>::dimension - 1;
+        using real_t = compute_t<typename array_traits<Input>::value_type>;
+        static_assert(array_traits<Input>::dimension == D + 1,
+                      "Input should have one more dimension than the mask.");
 
-        if (reduce_one(input.shape(), 0) != mask.shape())
+        if (reduce_one(input.shape(), 0) != mask.shape()
+                || output.shape() != mask.shape())
             throw Exception("Shapes of input and mask do not match.");
 
-        Slice<D> slice(mask.shape());
-        auto value = input.template const_view_reduced_to<D + 1>();
-        NdArray<bool, D> output(mask.shape());
-        NdArray<bool, D> done(mask.shape());
-        Grid<D> grid(mask.shape());
-        std::fill(output.begin(), output.end(), false);
-        std::fill(done.begin(), done.end(), false);
+        if (lower > upper)
+        {
+            detail::flood_double_threshold<D>(input, mask, lower, upper, output, boundary);
+            return;
+        }
 
-        shape_t<D> window_shape;
-        window_shape.fill(3);
+        Slice<D> const spatial = input.slice().sel(0, 0);
+        ptrdiff_t const component = input.slice().stride[0];
+        auto const *data = input.const_container().data() + D * component;
+        Slice<D> const grid(spatial.shape);
+        size_t const n = grid.shape[0];
+        ptrdiff_t const step = spatial.stride[0];
+        size_t const n_lines = (n > 0 ? grid.size / n : 0);
 
-        auto predicate = [&] (size_t i)
+        std::vector<uint8_t> classes(grid.size);
+        #pragma omp parallel
         {
-            if (done[i]) return false;
+            #pragma omp for nowait
+            for (size_t line = 0; line < n_lines; ++line)
+            {
+                auto const *v = data + spatial.flat_index(grid.index(line * n));
+                for (size_t x = 0; x < n; ++x)
+                {
+                    size_t i = line * n + x;
+                    real_t value = v[x * step];
+                    classes[i] = uint8_t(!mask[i] ? EdgeClass::none
+                        : (value <= lower ? EdgeClass::strong
+                        : (value <= upper ? EdgeClass::weak : EdgeClass::none)));
+                }
+            }
+        }
 
-            done[i] = true;
-            return mask[i] && !output[i] && (value[i][D] <= upper);
-        };
+        detail::union_find_hysteresis<D>(grid.shape, boundary, classes.data(), output);
+    }
+
+    /*! \brief Apply double threshold criterium to found edges, see above.
+     *
+     *  \return byte mask EdgeMask<D> of the edges that pass.
+     */
+    template <typename Input, typename Mask>
+    EdgeMask<array_traits<Input>::dimension - 1>
+    double_threshold(
+            Input const &input, Mask const &mask, double lower, double upper,
+            boundary_t<array_traits<Input>::dimension - 1> const &boundary =
+                uniform_boundary<array_traits<Input>::dimension - 1>())
+    {
+        constexpr unsigned D = array_traits<Input>::dimension - 1;
+
+        EdgeMask<D> output(mask.shape());
+        double_threshold(input, mask, lower, upper, output, boundary);
+        return output;
+    }
+
+    // # Fused thinning and threshold {{{1
+    /*! \brief Edge thinning and the classification of the double threshold
+     *  in a single sweep over the Sobel output.
+     *
+     *  Each pixel gets an `EdgeClass`: `strong` for edges with a value at
+     *  most `lower`, `weak` for the other edges with a value at most
+     *  `upper`, and `none` otherwise. Classes are computed per block of
+     *  pixels right after thinning it, while its values are still in
+     *  cache, and written in place of the thinned mask. Only the pixels
+     *  at or below `upper` are compared with their neighbours; on most
+     *  fields that is a small fraction.
+     *
+     *  \param input NdArray<real_t,D+1> with shape <D+1, n_1, ..., n_D>
+     *  \param lower Lower bound of double threshold, see double_threshold();
+     *  at most `upper`.
+     *  \param upper Upper bound of double threshold.
+     *  \param classes Contiguous NdArray<uint8_t,D> with shape
+     *  <n_1, ..., n_D>, which is overwritten with the classes.
+     *  \param method Rounded or interpolated thinning.
+     *  \param boundary Boundary mode for each of the D spatial axes.
+     *  \return the flat indices of the strong pixels, in increasing order.
+     */
+    template <typename Input, unsigned D, typename Container>
+    std::vector<size_t> classify_edges(
+            Input const &input, double lower, double upper,
+            NdArray<uint8_t, D, Container> &classes,
+            ThinningMethod method = ThinningMethod::rounded,
+            boundary_t<array_traits<Input>::dimension - 1> const &boundary =
+                uniform_boundary<array_traits<Input>::dimension - 1>())
+    {
+        using real_t = compute_t<typename array_traits<Input>::value_type>;
+        static_assert(array_traits<Input>::dimension == D + 1,
+                      "Input should have one more dimension than the classes.");
 
-        auto action = [&] (size_t i)
+        Slice<D> const spatial = input.slice().sel(0, 0);
+        ptrdiff_t const component = input.slice().stride[0];
+        auto const *data = input.const_container().data() + D * component;
+        if (classes.shape() != spatial.shape)
+            throw Exception("Shapes of input and classes do not match.");
+
+        Slice<D> const grid(spatial.shape);
+        size_t const n = grid.shape[0];
+        ptrdiff_t const step = spatial.stride[0];
+        std::vector<std::vector<size_t>> seeds(
+            (grid.size + detail::thinning_block - 1) / detail::thinning_block);
+
+        auto classify = [&] (size_t first, size_t last, uint8_t *o)
         {
-            output[i] = true;
+            std::vector<size_t> &strong = seeds[first / detail::thinning_block];
+            for (size_t line = first / n; line * n < last; ++line)
+            {
+                size_t i0 = std::max(first, line * n) - line * n;
+                size_t i1 = std::min(last, line * n + n) - line * n;
+                auto const *v = data + spatial.flat_index(grid.index(line * n));
+                uint8_t *c = o + (line * n + i0 - first);
+                for (size_t i = i0; i < i1; ++i)
+                {
+                    if (!c[i - i0])
+                        continue;
+                    real_t value = v[i * step];
+                    EdgeClass e = (value <= lower ? EdgeClass::strong
+                                : (value <= upper ? EdgeClass::weak : EdgeClass::none));
+                    c[i - i0] = uint8_t(e);
+                    if (e == EdgeClass::strong)
+                        strong.push_back(line * n + i);
+                }
+            }
         };
 
-        auto get_neighbours = [&] (size_t i)
-        {
-            shape_t<D> index = slice.index(i);
-            stride_t<D> offset;
-            for (unsigned k = 0; k < D; ++k)
-                offset[k] = (signed long)index[k] - 1;
+        uint8_t *bytes = classes.container().data();
+        if (method == ThinningMethod::interpolated)
+            detail::edge_thinning<ThinningMethod::interpolated>(
+                input, bytes, nullptr, boundary, upper, classify);
+        else
+            detail::edge_thinning<ThinningMethod::rounded>(
+                input, bytes, nullptr, boundary, upper, classify);
+
+        size_t count = 0;
+        for (auto const &s : seeds)
+            count += s.size();
+        std::vector<size_t> result;
+        result.reserve(count);
+        for (auto const &s : seeds)
+            result.insert(result.end(), s.begin(), s.end());
+        return result;
+    }
 
-            return grid.const_periodic_view(offset, window_shape);
+    /*! \brief Hysteresis on the output of classify_edges(): keeps the
+     *  strong pixels and the weak pixels connected to them.
+     *
+     *  Threads flood fill from the `seeds` in parallel, claiming each
+     *  pixel they reach in a bit set, so only the regions around the
+     *  seeds are visited and the cost is proportional to the number of
+     *  edges found.
+     *
+     *  \param classes Classes from classify_edges().
+     *  \param seeds Strong pixels from classify_edges().
+     *  \param output EdgeMask of the same shape as `classes`, which is
+     *  overwritten with the result.
+     *  \param boundary Boundary mode for each of the D spatial axes.
+     */
+    template <typename Classes, unsigned D, typename Word, typename Container>
+    void hysteresis(
+            Classes const &classes, std::vector<size_t> const &seeds,
+            EdgeMask<D, Word, Container> &output,
+            boundary_t<array_traits<Classes>::dimension> const &boundary =
+                uniform_boundary<array_traits<Classes>::dimension>())
+    {
+        using mask_type = EdgeMask<D, Word, Container>;
+        using detail::thinning_block;
+        static_assert(std::is_same<typename array_traits<Classes>::value_type, uint8_t>::value
+                      && array_traits<Classes>::dimension == D,
+                      "Classes should be bytes with the shape of the output.");
+
+        if (output.shape() != classes.shape())
+            throw Exception("Shapes of classes and mask do not match.");
+
+        size_t const size = calc_size<D>(classes.shape());
+        size_t const n_words = (size + 63) / 64;
+        size_t const n_blocks = (size + thinning_block - 1) / thinning_block;
+        auto const *c = classes.const_container().data();
+        detail::Neighbourhood<D> const neighbourhood(classes.shape(), boundary);
+
+        std::vector<std::atomic<uint64_t>> reached(n_words);
+        auto claim = [&] (size_t j)
+        {
+            uint64_t bit = uint64_t(1) << (j % 64);
+            std::atomic<uint64_t> &word = reached[j / 64];
+            return c[j] != uint8_t(EdgeClass::none)
+                && !(word.load(std::memory_order_relaxed) & bit)
+                && !(word.fetch_or(bit, std::memory_order_relaxed) & bit);
         };
 
-        for (size_t i = 0; i < grid.size(); ++i)
+        #pragma omp parallel
         {
-            if (!mask[i] || done[i] || (value[i][D] > lower))
-                continue;
-            floodfill(predicate, action, get_neighbours, i);
+            #pragma omp for
+            for (size_t w = 0; w < n_words; ++w)
+                reached[w].store(0, std::memory_order_relaxed);
+
+            // depth first; pixels are claimed when they are pushed
+            std::vector<size_t> stack;
+
+            #pragma omp for schedule(dynamic, 64)
+            for (size_t s = 0; s < seeds.size(); ++s)
+            {
+                if (!claim(seeds[s]))
+                    continue;
+                stack.push_back(seeds[s]);
+                while (not stack.empty())
+                {
+                    size_t current = stack.back();
+                    stack.pop_back();
+                    neighbourhood.for_each(current, [&] (size_t j)
+                    {
+                        if (claim(j))
+                            stack.push_back(j);
+                    });
+                }
+            }
+
+            // blocks of whole words of the output
+            std::vector<uint8_t> buffer(mask_type::packed ? thinning_block : 0);
+
+            #pragma omp for nowait
+            for (size_t b = 0; b < n_blocks; ++b)
+            {
+                size_t first = b * thinning_block;
+                size_t last = std::min(size, first + thinning_block);
+                uint8_t *o = (mask_type::packed ? buffer.data()
+                                                : output.bytes() + first);
+                for (size_t i = first; i < last; ++i)
+                    o[i - first] = (reached[i / 64].load(std::memory_order_relaxed)
+                                    >> (i % 64)) & 1;
+                if (mask_type::packed)
+                    output.assign(first, o, last - first);
+            }
         }
+    }
 
+    /*! \brief Edge thinning and double threshold: classify_edges(),
+     *  followed by hysteresis() from the strong pixels it found.
+     *
+     *  \param output EdgeMask with shape <n_1, ..., n_D>, which is
+     *  overwritten with the edges that pass.
+     */
+    template <typename Input, unsigned D, typename Word, typename Container>
+    void thin_and_threshold(
+            Input const &input, double lower, double upper,
+            EdgeMask<D, Word, Container> &output,
+            ThinningMethod method = ThinningMethod::rounded,
+            boundary_t<array_traits<Input>::dimension - 1> const &boundary =
+                uniform_boundary<array_traits<Input>::dimension - 1>())
+    {
+        shape_t<D> shape = input.slice().sel(0, 0).shape;
+        if (output.shape() != shape)
+            throw Exception("Shapes of input and mask do not match.");
+
+        NdArray<uint8_t, D> classes(shape);
+        auto seeds = classify_edges(input, lower, upper, classes, method, boundary);
+        hysteresis(classes, seeds, output, boundary);
+    }
+
+    /*! \brief Edge thinning and double threshold, see above.
+     *
+     *  \return byte mask EdgeMask<D> of the edges that pass.
+     */
+    template <typename Input>
+    EdgeMask<array_traits<Input>::dimension - 1>
+    thin_and_threshold(
+            Input const &input, double lower, double upper,
+            ThinningMethod method = ThinningMethod::rounded,
+            boundary_t<array_traits<Input>::dimension - 1> const &boundary =
+                uniform_boundary<array_traits<Input>::dimension - 1>())
+    {
+        constexpr unsigned D = array_traits<Input>::dimension - 1;
+
+        EdgeMask<D> output(input.slice().sel(0, 0).shape);
+        thin_and_threshold(input, lower, upper, output, method, boundary);
         return output;
     }
+    // }}}1
+
+    // # Connected components {{{1
+    /*! \brief Statistics of one connected component of edge pixels.
+     */
+    template <unsigned D>
+    struct EdgeComponent
+    {
+        size_t size;
+        /*! \brief Smallest and largest index along each axis. A component
+         *  that wraps around a periodic boundary spans the whole axis.
+         */
+        shape_t<D> lower, upper;
+        /*! \brief Mean gradient magnitude, the inverse of the last
+         *  component of the Sobel output.
+         */
+        double magnitude;
+    };
+
+    namespace detail
+    {
+        template <typename Index, unsigned D, typename Input, typename Mask,
+                  typename Container>
+        std::vector<EdgeComponent<D>> label_components(
+                Input const &input, Mask const &mask,
+                NdArray<int32_t, D, Container> &labels,
+                boundary_t<D> const &boundary)
+        {
+            using real_t = compute_t<typename array_traits<Input>::value_type>;
+
+            Slice<D> const spatial = input.slice().sel(0, 0);
+            ptrdiff_t const component = input.slice().stride[0];
+            auto const *data = input.const_container().data() + D * component;
+            Slice<D> const grid(spatial.shape);
+            size_t const n = grid.shape[0];
+            ptrdiff_t const step = spatial.stride[0];
+            size_t const n_lines = (n > 0 ? grid.size / n : 0);
+            int32_t *label = labels.container().data();
+
+            DisjointSets<Index> sets(grid.size);
+            connect_neighbours<D>(
+                grid.shape, boundary, [&mask] (size_t i) { return bool(mask[i]); },
+                sets);
+
+            // roots are the first pixel of each component; number them
+            // in that order
+            std::vector<size_t> first_label(n_lines + 1, 0);
+
+            #pragma omp parallel
+            {
+                #pragma omp for nowait
+                for (size_t line = 0; line < n_lines; ++line)
+                    for (size_t i = line * n; i < line * n + n; ++i)
+                        first_label[line + 1] += (mask[i] && sets.find(Index(i)) == i);
+            }
+
+            for (size_t line = 0; line < n_lines; ++line)
+                first_label[line + 1] += first_label[line];
+            if (first_label[n_lines] > size_t(std::numeric_limits<int32_t>::max()))
+                throw Exception("Too many components for 32-bit labels.");
+
+            #pragma omp parallel
+            {
+                #pragma omp for nowait
+                for (size_t line = 0; line < n_lines; ++line)
+                {
+                    int32_t next = int32_t(first_label[line]);
+                    for (size_t i = line * n; i < line * n + n; ++i)
+                        label[i] = (mask[i] && sets.find(Index(i)) == i ? ++next : 0);
+                }
+            }
+
+            // label the other pixels, while gathering statistics per
+            // thread, merged at the end
+            EdgeComponent<D> empty;
+            empty.size = 0;
+            empty.lower.fill(std::numeric_limits<size_t>::max());
+            empty.upper.fill(0);
+            empty.magnitude = 0;
+            std::vector<EdgeComponent<D>> components(first_label[n_lines], empty);
+
+            auto merge = [] (EdgeComponent<D> &a, EdgeComponent<D> const &b)
+            {
+                a.size += b.size;
+                a.magnitude += b.magnitude;
+                for (unsigned k = 0; k < D; ++k)
+                {
+                    a.lower[k] = std::min(a.lower[k], b.lower[k]);
+                    a.upper[k] = std::max(a.upper[k], b.upper[k]);
+                }
+            };
+
+            #pragma omp parallel
+            {
+                std::unordered_map<int32_t, EdgeComponent<D>> local;
+
+                #pragma omp for nowait
+                for (size_t line = 0; line < n_lines; ++line)
+                {
+                    shape_t<D> index = grid.index(line * n);
+                    auto const *v = data + spatial.flat_index(index);
+                    for (size_t x = 0; x < n; ++x)
+                    {
+                        size_t i = line * n + x;
+                        if (!mask[i])
+                            continue;
+                        Index root = sets.find(Index(i));
+                        if (root != i)
+                            label[i] = label[root];
+
+                        EdgeComponent<D> &c = local.emplace(label[i], empty).first->second;
+                        index[0] = x;
+                        EdgeComponent<D> pixel{1, index, index, 0};
+                        real_t value = v[x * step];
+                        pixel.magnitude = (value > 0 && std::isfinite(value) ? 1 / value : 0);
+                        merge(c, pixel);
+                    }
+                }
+
+                #pragma omp critical
+                for (auto const &entry : local)
+                    merge(components[entry.first - 1], entry.second);
+            }
+
+            for (auto &c : components)
+                c.magnitude /= c.size;
+            return components;
+        }
+    }
+
+    /*! \brief Connected-component labelling of edge pixels, with the
+     *  statistics of each component.
+     *
+     *  Pixels are connected to their 3^D - 1 neighbours, found across the
+     *  edges of the array according to `boundary`, as in
+     *  double_threshold(). Components are found by parallel union-find
+     *  and numbered from 1 in the order of their first pixel; pixels
+     *  outside the mask get label 0. With `Boundary::zero` on every axis
+     *  and a C-ordered NumPy array this gives the same numbering as
+     *  `scipy.ndimage.label` with a full 3^D structure; periodic
+     *  boundaries merge components across the edges of the array.
+     *
+     *  \param input Output of sobel(), for the gradient magnitudes.
+     *  \param mask Edge pixels, for instance the output of
+     *  double_threshold().
+     *  \param labels Contiguous NdArray<int32_t,D> with the shape of
+     *  `mask`, which is overwritten with the labels.
+     *  \param boundary Boundary mode for each of the D spatial axes.
+     *  \return the statistics of component `l` at index `l - 1`.
+     */
+    template <typename Input, typename Mask, unsigned D, typename Container>
+    std::vector<EdgeComponent<D>> label_components(
+            Input const &input, Mask const &mask,
+            NdArray<int32_t, D, Container> &labels,
+            boundary_t<array_traits<Input>::dimension - 1> const &boundary =
+                uniform_boundary<array_traits<Input>::dimension - 1>())
+    {
+        static_assert(array_traits<Input>::dimension == D + 1,
+                      "Input should have one more dimension than the labels.");
+
+        if (reduce_one(input.shape(), 0) != mask.shape()
+                || labels.shape() != mask.shape())
+            throw Exception("Shapes of input, mask and labels do not match.");
+
+        if (labels.size() <= std::numeric_limits<uint32_t>::max())
+            return detail::label_components<uint32_t, D>(input, mask, labels, boundary);
+        else
+            return detail::label_components<uint64_t, D>(input, mask, labels, boundary);
+    }
+    // }}}1
 }}}
@@ -21,9 +21,11 @@
 #include "base.hh"
 #include "ndarray.hh"
 #include "counter.hh"
+#include "line_convolution.hh"
 
 #include <numeric>
 #include <algorithm>
+#include <vector>
 
 namespace HyperCanny {
 namespace numeric {
@@ -33,29 +35,158 @@ namespace numeric {
      *
      * \f[(f * g)[n]\ =\ \sum f[m]\, g[n - m]\f]
      *
-     * taking the input array to be cyclic.
+     * with samples beyond the edges of the input given by a boundary
+     * mode for each axis, see `Boundary`.
+     *
+     * Lines along the first axis are split into an interior part, where
+     * the whole kernel window lies inside the array, and short border
+     * parts. The interior is computed from a table of memory offsets into
+     * the input, without any index arithmetic; only the border samples go
+     * through `boundary_index`.
      *
      * \param data Input array.
      * \param kernel Kernel array.
+     * \param output Output array, should have the same shape as input.
+     * \param boundary Boundary mode for each axis.
      * \return Convolution of input array with kernel.
      */
     template <typename C1, typename C2, typename Output>
-    Output &convolve(C1 const &data, C2 const &kernel, Output &output)
+    Output &convolve(
+            C1 const &data, C2 const &kernel, Output &output,
+            boundary_t<array_traits<C1>::dimension> const &boundary =
+                uniform_boundary<array_traits<C1>::dimension>())
     {
-        using real_t = typename array_traits<C1>::value_type;
+        using real_t = compute_t<typename array_traits<C1>::value_type>;
         constexpr unsigned D = array_traits<C1>::dimension;
 
         if (output.shape() != data.shape())
             throw Exception("Shapes do not match.");
 
-        for (auto i = output.begin(); i != output.end(); ++i)
+        Slice<D> const input = data.slice(), result = output.slice();
+        auto const *input_data = data.const_container().data();
+        auto *output_data = output.container().data();
+
+        shape_t<D> shape = data.shape(), centre = kernel.shape() / 2;
+        Slice<D> window(kernel.shape()), grid(shape);
+
+        // taps of the reversed kernel, with their offset from the centre
+        std::vector<real_t> taps(window.size);
+        std::vector<ptrdiff_t> offsets(window.size);
+        for (size_t j = 0; j < window.size; ++j)
+        {
+            shape_t<D> w = window.index(j), r;
+            offsets[j] = 0;
+            for (unsigned k = 0; k < D; ++k)
+            {
+                r[k] = window.shape[k] - 1 - w[k];
+                offsets[j] += (ptrdiff_t(w[k]) - ptrdiff_t(centre[k]))
+                            * input.stride[k];
+            }
+            taps[j] = kernel[r];
+        }
+
+        // the window fits inside along axis `k` at position `i`
+        auto interior = [&] (unsigned k, size_t i)
+        {
+            return i >= centre[k]
+                && i + window.shape[k] - centre[k] <= shape[k];
+        };
+
+        // `lookup` receives the memory offset of every window position
+        // along each axis, or -1 where the sample is zero; the window is
+        // then walked like an odometer.
+        auto border_value = [&] (shape_t<D> const &index,
+                                 std::vector<ptrdiff_t> &lookup)
         {
-            shape_t<D> index = i.index();
-            stride_t<D> window_offset = index - kernel.shape() / 2;
-            auto const window = data.periodic_view(window_offset, kernel.shape());
-            *i = std::inner_product(
-                window.begin(), window.end(),
-                kernel.reverse_all().begin(), (real_t)0.0);
+            std::array<ptrdiff_t const *, D> axis;
+            ptrdiff_t *p = lookup.data();
+            for (unsigned k = 0; k < D; ++k)
+            {
+                axis[k] = p;
+                for (size_t w = 0; w < window.shape[k]; ++w, ++p)
+                {
+                    ptrdiff_t q = boundary_index(
+                        boundary[k],
+                        ptrdiff_t(index[k] + w) - ptrdiff_t(centre[k]),
+                        shape[k]);
+                    *p = (q < 0 ? -1 : q * input.stride[k]);
+                }
+            }
+
+            real_t value = 0;
+            shape_t<D> w;
+            w.fill(0);
+            for (size_t j = 0; j < window.size; ++j)
+            {
+                ptrdiff_t flat = input.offset;
+                for (unsigned k = 0; k < D && flat >= 0; ++k)
+                    flat = (axis[k][w[k]] < 0 ? -1 : flat + axis[k][w[k]]);
+                if (flat >= 0)
+                    value += taps[j] * real_t(input_data[flat]);
+
+                for (unsigned k = 0; k < D && ++w[k] == window.shape[k]; ++k)
+                    w[k] = 0;
+            }
+            return value;
+        };
+
+        // interior range along the first axis; empty if the kernel does
+        // not fit
+        size_t n = shape[0],
+               begin = centre[0],
+               end = (n + centre[0] >= window.shape[0]
+                      ? n + centre[0] + 1 - window.shape[0] : 0);
+        if (end <= begin)
+            begin = end = n;
+
+        size_t lookup_size = 0;
+        for (unsigned k = 0; k < D; ++k)
+            lookup_size += window.shape[k];
+
+        #pragma omp parallel
+        {
+        std::vector<ptrdiff_t> lookup(lookup_size);
+
+        #pragma omp for nowait
+        for (size_t line = 0; line < grid.size / n; ++line)
+        {
+            shape_t<D> index = grid.index(line * n);
+            bool inside = true;
+            for (unsigned k = 1; k < D; ++k)
+                inside = inside && interior(k, index[k]);
+
+            auto const *src = input_data + input.flat_index(index);
+            auto *dst = output_data + result.flat_index(index);
+            ptrdiff_t in_step = input.stride[0], out_step = result.stride[0];
+
+            auto border = [&] (size_t i)
+            {
+                index[0] = i;
+                dst[i * out_step] = border_value(index, lookup);
+            };
+
+            if (!inside)
+            {
+                for (size_t i = 0; i < n; ++i)
+                    border(i);
+                continue;
+            }
+
+            for (size_t i = 0; i < begin; ++i)
+                border(i);
+
+            for (size_t i = begin; i < end; ++i)
+            {
+                auto const *p = src + i * in_step;
+                real_t value = 0;
+                for (size_t j = 0; j < taps.size(); ++j)
+                    value += taps[j] * real_t(p[offsets[j]]);
+                dst[i * out_step] = value;
+            }
+
+            for (size_t i = end; i < n; ++i)
+                border(i);
+        }
         }
 
         return output;
@@ -71,6 +202,18 @@ namespace numeric {
         return convolve(data, kernel, result);
     }
 
+    template <typename C1, typename C2>
+    typename array_traits<C1>::copy_type convolve(
+            C1 const &data, C2 const &kernel,
+            boundary_t<array_traits<C1>::dimension> const &boundary)
+    {
+        using real_t = typename array_traits<C1>::value_type;
+        constexpr unsigned D = array_traits<C1>::dimension;
+
+        NdArray<real_t,D> result(data.shape());
+        return convolve(data, kernel, result, boundary);
+    }
+
     template <typename Input, typename Kernel>
     typename array_traits<Input>::copy_type
     convolve_padding_zero(
@@ -93,37 +236,50 @@ namespace numeric {
     /*! \brief Convolve input in one direction with a one dimensional
      *  kernel.
      *
+     *  Every line along `axis` is handed to `convolve_line`, working
+     *  directly on the underlying memory of `input` and `output`. Each
+     *  thread owns one scratch buffer, so no allocations happen per line.
+     *  Because lines are buffered before being written, `output` may be
+     *  the same array as `input`.
+     *
+     *  For any axis other than the first, lines are processed in blocks of
+     *  `simd::block_width` neighbours along the first axis by
+     *  `convolve_block`, see `for_each_line`.
+     *
+     *  Input and output may be stored as `half` or `bfloat16`; lines are
+     *  converted to `float` while being buffered, and back on store.
+     *
      *  \param input Input array.
-     *  \param kernel Kernel array.
+     *  \param kernel Kernel array, or a prepared `LineKernel`.
      *  \param output Output array, should have same shape as input.
      *  \param axis Axis over which to convolve.
+     *  \param boundary How lines are continued beyond their ends.
      */
     template <typename Input, typename Kernel, typename Output>
     Output &convolve_1d(
             Input const &input,
             Kernel const &kernel,
             Output &output,
-            unsigned axis)
+            unsigned axis,
+            Boundary boundary = Boundary::periodic)
     {
-        constexpr unsigned D = array_traits<Input>::dimension;
+        using real_t = compute_t<typename array_traits<Input>::value_type>;
 
+        if (output.shape() != input.shape())
+            throw Exception("Shapes do not match.");
+
+        LineKernel<real_t> line_kernel(kernel);
         size_t length = input.shape()[axis];
-        int stride = input.stride()[axis];
-        auto orthogonal_slice = input.slice().sel(axis, 0);
-        Slice<D-1> flat(orthogonal_slice.shape);
 
-        #pragma omp parallel
-        {
-        #pragma omp for nowait
-        for (size_t i = 0; i < orthogonal_slice.size; ++i)
-        //for (NdCounter<D-1> i(orthogonal_slice.offset, orthogonal_slice);
-        //     i != NdCounter<D-1>(); ++i)
-        {
-            size_t j = orthogonal_slice.flat_index(flat.index(i));
-            Slice<1> line(j, {length}, {stride});
-            output.view(line) = convolve(input.view(line), kernel);
-        }
-        }
+        for_each_line<real_t>(
+            input.slice(), input.const_container().data(),
+            output.slice(), output.container().data(), axis,
+            line_kernel.scratch_size(length),
+            line_kernel.block_scratch_size(length),
+            [&line_kernel, boundary] (auto... args)
+                { convolve_line(line_kernel, args..., boundary); },
+            [&line_kernel, boundary] (auto... args)
+                { convolve_block(line_kernel, args..., boundary); });
 
         return output;
     }
@@ -132,11 +288,12 @@ namespace numeric {
     typename array_traits<Input>::copy_type convolve_1d(
             Input const &input,
             Kernel const &kernel,
-            unsigned axis)
+            unsigned axis,
+            Boundary boundary = Boundary::periodic)
     {
         using output_type = typename array_traits<Input>::copy_type;
         output_type output(input.shape());
-        convolve_1d(input, kernel, output, axis);
+        convolve_1d(input, kernel, output, axis, boundary);
         return output;
     }
 }} // HyperCanny::numeric
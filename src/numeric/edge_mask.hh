@@ -0,0 +1,473 @@
+/* Copyright 2017 Netherlands eScience Center
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#pragma once
+
+/*! \file numeric/edge_mask.hh
+ *  \brief Boolean masks of edge pixels.
+ *
+ *  `std::vector<bool>` hides its bits behind proxy references, and two
+ *  threads writing neighbouring pixels may write the same word. An
+ *  `EdgeMask` stores either one byte per pixel, which any thread may
+ *  write, or 64 pixels per word, where writers partition the array by
+ *  whole words (see `EdgeMask::owned_range`).
+ *
+ *  The storage is laid out so that it can be handed to NumPy without a
+ *  copy: the byte mask is a `uint8` array of zeros and ones, and the
+ *  packed mask, read as bytes, is the result of
+ *  `numpy.packbits(mask, bitorder='little')`, padded to a multiple of
+ *  eight bytes.
+ */
+
+#include "support.hh"
+#include "simd.hh"
+
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <type_traits>
+#include <vector>
+
+namespace HyperCanny {
+namespace numeric {
+namespace simd
+{
+    // # Mask kernels {{{1
+    /*! \brief Bytewise AND and OR of `b` into `a`, for `n` bytes.
+     *  These serve both byte masks and packed masks.
+     */
+    inline void bitwise_and_scalar(uint8_t *a, uint8_t const *b, size_t n)
+    {
+        for (size_t i = 0; i < n; ++i)
+            a[i] &= b[i];
+    }
+
+    inline void bitwise_or_scalar(uint8_t *a, uint8_t const *b, size_t n)
+    {
+        for (size_t i = 0; i < n; ++i)
+            a[i] |= b[i];
+    }
+
+    /*! \brief Sum of `n` bytes, which counts a byte mask.
+     */
+    inline size_t count_bytes_scalar(uint8_t const *a, size_t n)
+    {
+        size_t sum = 0;
+        for (size_t i = 0; i < n; ++i)
+            sum += a[i];
+        return sum;
+    }
+
+    /*! \brief Number of bits set in `n` words, which counts a packed mask.
+     */
+    inline size_t count_bits_scalar(uint64_t const *a, size_t n)
+    {
+        size_t sum = 0;
+        for (size_t i = 0; i < n; ++i)
+            sum += __builtin_popcountll(a[i]);
+        return sum;
+    }
+
+    /*! \brief Pack `n` words worth of 0/1 bytes into bits, least
+     *  significant bit first.
+     */
+    inline void pack_bits_scalar(uint8_t const *bytes, uint64_t *words, size_t n)
+    {
+        for (size_t w = 0; w < n; ++w)
+        {
+            uint64_t word = 0;
+            for (unsigned b = 0; b < 64; ++b)
+                word |= uint64_t(bytes[64 * w + b] != 0) << b;
+            words[w] = word;
+        }
+    }
+
+#ifdef HYPER_CANNY_X86_SIMD
+    __attribute__((target("avx2")))
+    inline void bitwise_and_avx2(uint8_t *a, uint8_t const *b, size_t n)
+    {
+        size_t i = 0;
+        for (; i + 32 <= n; i += 32)
+        {
+            __m256i x = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(a + i));
+            __m256i y = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(b + i));
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(a + i), _mm256_and_si256(x, y));
+        }
+        bitwise_and_scalar(a + i, b + i, n - i);
+    }
+
+    __attribute__((target("avx2")))
+    inline void bitwise_or_avx2(uint8_t *a, uint8_t const *b, size_t n)
+    {
+        size_t i = 0;
+        for (; i + 32 <= n; i += 32)
+        {
+            __m256i x = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(a + i));
+            __m256i y = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(b + i));
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(a + i), _mm256_or_si256(x, y));
+        }
+        bitwise_or_scalar(a + i, b + i, n - i);
+    }
+
+    /*! \brief Sum of absolute differences against zero adds up 32
+     *  bytes into four 64-bit lanes.
+     */
+    __attribute__((target("avx2")))
+    inline size_t count_bytes_avx2(uint8_t const *a, size_t n)
+    {
+        __m256i acc = _mm256_setzero_si256();
+        size_t i = 0;
+        for (; i + 32 <= n; i += 32)
+            acc = _mm256_add_epi64(acc, _mm256_sad_epu8(
+                _mm256_loadu_si256(reinterpret_cast<__m256i const *>(a + i)),
+                _mm256_setzero_si256()));
+
+        uint64_t lanes[4];
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(lanes), acc);
+        return lanes[0] + lanes[1] + lanes[2] + lanes[3]
+             + count_bytes_scalar(a + i, n - i);
+    }
+
+    /*! \brief Population count by nibble table lookup, summed per byte
+     *  and then per 64-bit lane.
+     */
+    __attribute__((target("avx2")))
+    inline size_t count_bits_avx2(uint64_t const *a, size_t n)
+    {
+        __m256i const table = _mm256_setr_epi8(
+            0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+            0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+        __m256i const low = _mm256_set1_epi8(0x0f);
+        __m256i acc = _mm256_setzero_si256();
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4)
+        {
+            __m256i x = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(a + i));
+            __m256i c = _mm256_add_epi8(
+                _mm256_shuffle_epi8(table, _mm256_and_si256(x, low)),
+                _mm256_shuffle_epi8(table, _mm256_and_si256(_mm256_srli_epi16(x, 4), low)));
+            acc = _mm256_add_epi64(acc, _mm256_sad_epu8(c, _mm256_setzero_si256()));
+        }
+
+        uint64_t lanes[4];
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(lanes), acc);
+        return lanes[0] + lanes[1] + lanes[2] + lanes[3]
+             + count_bits_scalar(a + i, n - i);
+    }
+
+    /*! \brief Packs 64 bytes at a time with two byte compares and
+     *  `movemask`.
+     */
+    __attribute__((target("avx2")))
+    inline void pack_bits_avx2(uint8_t const *bytes, uint64_t *words, size_t n)
+    {
+        __m256i const zero = _mm256_setzero_si256();
+        for (size_t w = 0; w < n; ++w)
+        {
+            __m256i lo = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(bytes + 64 * w));
+            __m256i hi = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(bytes + 64 * w + 32));
+            uint32_t l = ~uint32_t(_mm256_movemask_epi8(_mm256_cmpeq_epi8(lo, zero)));
+            uint32_t h = ~uint32_t(_mm256_movemask_epi8(_mm256_cmpeq_epi8(hi, zero)));
+            words[w] = uint64_t(l) | (uint64_t(h) << 32);
+        }
+    }
+#endif
+
+    inline void bitwise_and(uint8_t *a, uint8_t const *b, size_t n)
+    {
+#ifdef HYPER_CANNY_X86_SIMD
+        if (level() >= Level::avx2)
+            return bitwise_and_avx2(a, b, n);
+#endif
+        bitwise_and_scalar(a, b, n);
+    }
+
+    inline void bitwise_or(uint8_t *a, uint8_t const *b, size_t n)
+    {
+#ifdef HYPER_CANNY_X86_SIMD
+        if (level() >= Level::avx2)
+            return bitwise_or_avx2(a, b, n);
+#endif
+        bitwise_or_scalar(a, b, n);
+    }
+
+    inline size_t count_bytes(uint8_t const *a, size_t n)
+    {
+#ifdef HYPER_CANNY_X86_SIMD
+        if (level() >= Level::avx2)
+            return count_bytes_avx2(a, n);
+#endif
+        return count_bytes_scalar(a, n);
+    }
+
+    inline size_t count_bits(uint64_t const *a, size_t n)
+    {
+#ifdef HYPER_CANNY_X86_SIMD
+        if (level() >= Level::avx2)
+            return count_bits_avx2(a, n);
+#endif
+        return count_bits_scalar(a, n);
+    }
+
+    inline void pack_bits(uint8_t const *bytes, uint64_t *words, size_t n)
+    {
+#ifdef HYPER_CANNY_X86_SIMD
+        if (level() >= Level::avx2)
+            return pack_bits_avx2(bytes, words, n);
+#endif
+        pack_bits_scalar(bytes, words, n);
+    }
+    // }}}1
+} // namespace simd
+
+    // # EdgeMask {{{1
+    /*! \brief Boolean mask over a D-dimensional array, in column-major
+     *  order like `NdArray`.
+     *
+     *  \tparam Word `uint8_t` to store one pixel per byte, `uint64_t` to
+     *  pack 64 pixels per word, least significant bit first. Bits beyond
+     *  the last pixel are kept zero.
+     *  \tparam Container Owns the words, or is a `pointer_range` to wrap
+     *  memory owned by someone else.
+     *
+     *  Reading is always thread safe. Writing pixels from several threads
+     *  is safe for byte masks; for packed masks each thread should only
+     *  write pixels within its own `owned_range`.
+     */
+    template <unsigned D, typename Word = uint8_t,
+              typename Container = std::vector<Word>>
+    class EdgeMask
+    {
+        static_assert(std::is_same<Word, uint8_t>::value
+                      || std::is_same<Word, uint64_t>::value,
+                      "EdgeMask stores bytes or 64-bit words.");
+
+        Container m_container;
+        shape_t<D> m_shape;
+        size_t m_size;
+
+        public:
+            using word_type = Word;
+            using value_type = bool;
+
+            static constexpr bool packed = std::is_same<Word, uint64_t>::value;
+            /*! \brief Number of pixels stored in one word.
+             */
+            static constexpr size_t word_size = (packed ? 64 : 1);
+
+            static size_t words_for(size_t size)
+            {
+                return (size + word_size - 1) / word_size;
+            }
+
+            // const_iterator {{{2
+            class const_iterator
+            {
+                EdgeMask const *m_mask;
+                size_t m_index;
+
+                public:
+                    using iterator_category = std::forward_iterator_tag;
+                    using value_type = bool;
+                    using difference_type = ptrdiff_t;
+                    using pointer = bool const *;
+                    using reference = bool;
+
+                    const_iterator(EdgeMask const *mask, size_t index)
+                        : m_mask(mask), m_index(index) {}
+
+                    bool operator*() const { return (*m_mask)[m_index]; }
+                    const_iterator &operator++() { ++m_index; return *this; }
+                    const_iterator operator++(int)
+                        { const_iterator i = *this; ++m_index; return i; }
+                    bool operator==(const_iterator const &o) const
+                        { return m_index == o.m_index; }
+                    bool operator!=(const_iterator const &o) const
+                        { return m_index != o.m_index; }
+            };
+            // }}}2
+
+            EdgeMask(): m_size(0) { m_shape.fill(0); }
+
+            explicit EdgeMask(shape_t<D> const &shape, bool value = false):
+                m_container(words_for(calc_size<D>(shape))),
+                m_shape(shape),
+                m_size(calc_size<D>(shape))
+            {
+                fill(value);
+            }
+
+            /*! \brief Wrap existing storage of `words_for(size)` words.
+             */
+            EdgeMask(shape_t<D> const &shape, Container const &container):
+                m_container(container),
+                m_shape(shape),
+                m_size(calc_size<D>(shape))
+            {}
+
+            /*! \brief Copy any array of truth values with the same number
+             *  of pixels, such as `NdArray<bool, D>`.
+             */
+            template <typename Array>
+            static EdgeMask from(Array const &array)
+            {
+                EdgeMask mask(array.shape());
+                size_t i = 0;
+                for (auto x : array)
+                    mask.set(i++, bool(x));
+                return mask;
+            }
+
+            shape_t<D> const &shape() const { return m_shape; }
+            size_t size() const { return m_size; }
+            size_t n_words() const { return words_for(m_size); }
+            size_t n_bytes() const { return n_words() * sizeof(Word); }
+
+            Word *data() { return m_container.data(); }
+            Word const *data() const { return m_container.data(); }
+            uint8_t *bytes() { return reinterpret_cast<uint8_t *>(data()); }
+            uint8_t const *bytes() const { return reinterpret_cast<uint8_t const *>(data()); }
+
+            Container &container() { return m_container; }
+            Container const &const_container() const { return m_container; }
+
+            const_iterator begin() const { return const_iterator(this, 0); }
+            const_iterator end() const { return const_iterator(this, m_size); }
+
+            bool operator[](size_t i) const
+            {
+                if constexpr (packed)
+                    return (data()[i / 64] >> (i % 64)) & 1;
+                else
+                    return data()[i] != 0;
+            }
+
+            void set(size_t i, bool value = true)
+            {
+                if constexpr (packed)
+                {
+                    Word &w = data()[i / 64];
+                    w = (w & ~(Word(1) << (i % 64))) | (Word(value) << (i % 64));
+                }
+                else
+                    data()[i] = value;
+            }
+
+            void fill(bool value)
+            {
+                std::memset(bytes(), value ? (packed ? 0xff : 1) : 0, n_bytes());
+                if (packed && value && m_size % 64 != 0)
+                    data()[m_size / 64] = (Word(1) << (m_size % 64)) - 1;
+            }
+
+            /*! \brief Set `count` pixels starting at `offset` from an array
+             *  of 0/1 bytes.
+             */
+            void assign(size_t offset, uint8_t const *values, size_t count)
+            {
+                if constexpr (packed)
+                {
+                    size_t i = 0;
+                    for (; i < count && (offset + i) % 64 != 0; ++i)
+                        set(offset + i, values[i]);
+                    size_t n = (count - i) / 64;
+                    simd::pack_bits(values + i, data() + (offset + i) / 64, n);
+                    for (i += 64 * n; i < count; ++i)
+                        set(offset + i, values[i]);
+                }
+                else
+                    std::memcpy(data() + offset, values, count);
+            }
+
+            /*! \brief Write the pixels as 0/1 bytes.
+             */
+            void copy_to(uint8_t *values) const
+            {
+                if constexpr (packed)
+                {
+                    for (size_t i = 0; i < m_size; ++i)
+                        values[i] = (*this)[i];
+                }
+                else
+                    std::memcpy(values, data(), m_size);
+            }
+
+            /*! \brief Range of pixels `[begin, end)` that part `part` of
+             *  `parts` may write to, without sharing a word with any other
+             *  part.
+             */
+            std::pair<size_t, size_t> owned_range(size_t part, size_t parts) const
+            {
+                size_t words = (n_words() + parts - 1) / parts;
+                return std::make_pair(
+                    std::min(m_size, part * words * word_size),
+                    std::min(m_size, (part + 1) * words * word_size));
+            }
+
+            /*! \brief Number of pixels set.
+             */
+            size_t count() const
+            {
+                if constexpr (packed)
+                    return simd::count_bits(data(), n_words());
+                else
+                    return simd::count_bytes(data(), m_size);
+            }
+
+            bool any() const { return count() != 0; }
+
+            template <typename C2>
+            EdgeMask &operator&=(EdgeMask<D, Word, C2> const &other)
+            {
+                if (other.shape() != m_shape)
+                    throw Exception("Shapes of masks do not match.");
+                simd::bitwise_and(bytes(), other.bytes(), n_bytes());
+                return *this;
+            }
+
+            template <typename C2>
+            EdgeMask &operator|=(EdgeMask<D, Word, C2> const &other)
+            {
+                if (other.shape() != m_shape)
+                    throw Exception("Shapes of masks do not match.");
+                simd::bitwise_or(bytes(), other.bytes(), n_bytes());
+                return *this;
+            }
+
+            /*! \brief Compare with any array of truth values, such as
+             *  `NdArray<bool, D>` or another mask.
+             */
+            template <typename Array>
+            bool operator==(Array const &other) const
+            {
+                if (other.shape() != m_shape)
+                    return false;
+                size_t i = 0;
+                for (auto x : other)
+                    if (bool(x) != (*this)[i++])
+                        return false;
+                return true;
+            }
+
+            template <typename Array>
+            bool operator!=(Array const &other) const
+            {
+                return not (*this == other);
+            }
+    };
+
+    template <unsigned D>
+    using PackedEdgeMask = EdgeMask<D, uint64_t>;
+    // }}}1
+}} // namespace HyperCanny::numeric
@@ -0,0 +1,405 @@
+/* Copyright 2017 Netherlands eScience Center
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#pragma once
+
+/*! \file numeric/expression.hh
+ *  \brief Lazy elementwise arithmetic on NdArrays.
+ *
+ *  With this header, `+`, `-`, `*` and `/` between arrays, views and
+ *  scalars build an expression instead of computing a result. Assigning
+ *  the expression to an array or view evaluates it in a single pass,
+ *  without temporaries:
+ *
+ *      x = (x - mean) * (1 / sigma);
+ *      y.sel<0>(2) = a.transpose() * b + 1.0f;
+ *
+ *  The pass walks the runs of the target (see numeric::for_each_run()),
+ *  split into blocks that are spread over OpenMP threads; where every
+ *  operand has unit stride the inner loop is a plain indexed loop that
+ *  the compiler vectorises. Values are computed in the compute type of
+ *  each operand (`float` for the sixteen bit types of numeric/half.hh).
+ *
+ *  Expressions refer to the storage of their operands, which should
+ *  outlive them. As with any assignment between arrays, the target may
+ *  only share storage with an operand if both walk it in the same order.
+ */
+
+#include "ndarray.hh"
+#include "half.hh"
+
+#include <functional>
+#include <type_traits>
+
+namespace HyperCanny {
+namespace numeric
+{
+    // # Expression nodes {{{1
+    /*! \brief Base class of expression nodes.
+     *
+     *  Every node has a `cursor(index, first)` giving the elements of the
+     *  run that starts at `index` (with zeros for the axes inside the
+     *  run), from element `first` on, as `unit(i)` for unit strides and
+     *  `strided(i)` otherwise.
+     */
+    template <typename Derived>
+    class Expression
+    {};
+
+    /*! \brief Array operand of an expression.
+     */
+    template <typename Iterator, unsigned D>
+    class Terminal: public Expression<Terminal<Iterator, D>>
+    {
+        Iterator m_start;
+        Slice<D> m_slice;
+
+        public:
+            static constexpr unsigned dimension = D;
+            static constexpr bool is_scalar = false;
+            using value_type = compute_t<std::remove_cv_t<
+                typename std::iterator_traits<Iterator>::value_type>>;
+
+            struct Cursor
+            {
+                Iterator p;
+                ptrdiff_t stride;
+
+                decltype(auto) unit(size_t i) const { return p[i]; }
+                decltype(auto) strided(size_t i) const { return p[ptrdiff_t(i) * stride]; }
+            };
+
+            Terminal(Iterator start, Slice<D> const &slice)
+                : m_start(start)
+                , m_slice(slice)
+            {}
+
+            shape_t<D> const &shape() const { return m_slice.shape; }
+
+            bool continues(unsigned axis, size_t length) const
+            {
+                return m_slice.stride[axis] == m_slice.stride[0] * ptrdiff_t(length);
+            }
+
+            bool unit_stride() const { return m_slice.stride[0] == 1; }
+
+            Cursor cursor(shape_t<D> const &index, size_t first) const
+            {
+                return Cursor{
+                    m_start + ptrdiff_t(m_slice.flat_index(index))
+                            + ptrdiff_t(first) * m_slice.stride[0],
+                    m_slice.stride[0] };
+            }
+    };
+
+    /*! \brief Scalar operand, the same for every element.
+     */
+    template <typename T>
+    class Scalar: public Expression<Scalar<T>>
+    {
+        T m_value;
+
+        public:
+            static constexpr bool is_scalar = true;
+            using value_type = T;
+
+            struct Cursor
+            {
+                T value;
+
+                T unit(size_t) const { return value; }
+                T strided(size_t) const { return value; }
+            };
+
+            explicit Scalar(T value): m_value(value) {}
+
+            bool continues(unsigned, size_t) const { return true; }
+            bool unit_stride() const { return true; }
+
+            template <typename Index>
+            Cursor cursor(Index const &, size_t) const { return Cursor{m_value}; }
+    };
+
+    /*! \brief Elementwise function of one operand.
+     */
+    template <typename Function, typename A>
+    class Unary: public Expression<Unary<Function, A>>
+    {
+        Function m_f;
+        A m_a;
+
+        public:
+            static constexpr unsigned dimension = A::dimension;
+            static constexpr bool is_scalar = false;
+            using value_type = std::decay_t<decltype(
+                std::declval<Function>()(std::declval<typename A::value_type>()))>;
+            using a_type = typename A::value_type;
+
+            struct Cursor
+            {
+                Function f;
+                typename A::Cursor a;
+
+                value_type unit(size_t i) const { return f(a_type(a.unit(i))); }
+                value_type strided(size_t i) const { return f(a_type(a.strided(i))); }
+            };
+
+            Unary(Function f, A const &a)
+                : m_f(f)
+                , m_a(a)
+            {}
+
+            shape_t<dimension> const &shape() const { return m_a.shape(); }
+
+            bool continues(unsigned axis, size_t length) const
+                { return m_a.continues(axis, length); }
+            bool unit_stride() const { return m_a.unit_stride(); }
+
+            Cursor cursor(shape_t<dimension> const &index, size_t first) const
+            {
+                return Cursor{m_f, m_a.cursor(index, first)};
+            }
+    };
+
+    /*! \brief Elementwise function of two operands, of which at most one
+     *  is a scalar.
+     */
+    template <typename Function, typename A, typename B>
+    class Binary: public Expression<Binary<Function, A, B>>
+    {
+        Function m_f;
+        A m_a;
+        B m_b;
+
+        public:
+            static constexpr bool is_scalar = false;
+            using a_type = typename A::value_type;
+            using b_type = typename B::value_type;
+            using value_type = std::decay_t<decltype(
+                std::declval<Function>()(std::declval<a_type>(), std::declval<b_type>()))>;
+
+            static constexpr unsigned dimension =
+                std::conditional_t<A::is_scalar, B, A>::dimension;
+
+            struct Cursor
+            {
+                Function f;
+                typename A::Cursor a;
+                typename B::Cursor b;
+
+                value_type unit(size_t i) const
+                    { return f(a_type(a.unit(i)), b_type(b.unit(i))); }
+                value_type strided(size_t i) const
+                    { return f(a_type(a.strided(i)), b_type(b.strided(i))); }
+            };
+
+            Binary(Function f, A const &a, B const &b)
+                : m_f(f)
+                , m_a(a)
+                , m_b(b)
+            {
+                if constexpr (!A::is_scalar && !B::is_scalar)
+                {
+                    static_assert(A::dimension == B::dimension,
+                                  "Operands should have the same dimension.");
+                    if (a.shape() != b.shape())
+                        throw Exception("Shapes of operands do not match.");
+                }
+            }
+
+            shape_t<dimension> const &shape() const
+            {
+                if constexpr (A::is_scalar)
+                    return m_b.shape();
+                else
+                    return m_a.shape();
+            }
+
+            bool continues(unsigned axis, size_t length) const
+            {
+                return m_a.continues(axis, length) && m_b.continues(axis, length);
+            }
+
+            bool unit_stride() const { return m_a.unit_stride() && m_b.unit_stride(); }
+
+            Cursor cursor(shape_t<dimension> const &index, size_t first) const
+            {
+                return Cursor{
+                    m_f, m_a.cursor(index, first), m_b.cursor(index, first) };
+            }
+    };
+    // }}}1
+
+    // # Building expressions {{{1
+    namespace detail
+    {
+        template <typename T>
+        constexpr bool is_operand = is_expression<T> || is_nd_array<T>;
+
+        template <typename A, typename B>
+        constexpr bool is_operation =
+            (is_operand<A> && (is_operand<B> || std::is_arithmetic<B>::value))
+            || (std::is_arithmetic<A>::value && is_operand<B>);
+
+        template <typename T>
+        auto operand(T const &x)
+        {
+            if constexpr (is_expression<T>)
+                return x;
+            else if constexpr (is_nd_array<T>)
+            {
+                auto start = run_start(x.const_container(), 0);
+                return Terminal<decltype(start), array_traits<T>::dimension>(
+                    start, x.slice());
+            }
+            else
+                return Scalar<T>(x);
+        }
+
+        template <typename Function, typename A, typename B>
+        auto binary(Function f, A const &a, B const &b)
+        {
+            using operand_a = decltype(operand(a));
+            using operand_b = decltype(operand(b));
+            return Binary<Function, operand_a, operand_b>(f, operand(a), operand(b));
+        }
+
+        // elements in one block of work of assign_expression()
+        constexpr size_t expression_block = 1 << 14;
+    }
+
+    /*! \brief Apply `f` to each element of an array or expression.
+     */
+    template <typename Function, typename A,
+              typename = std::enable_if_t<detail::is_operand<A>>>
+    auto map(Function f, A const &a)
+    {
+        using operand_a = decltype(detail::operand(a));
+        return Unary<Function, operand_a>(f, detail::operand(a));
+    }
+
+    template <typename A, typename = std::enable_if_t<detail::is_operand<A>>>
+    auto operator-(A const &a)
+    {
+        return map(std::negate<>(), a);
+    }
+
+    template <typename A, typename B,
+              typename = std::enable_if_t<detail::is_operation<A, B>>>
+    auto operator+(A const &a, B const &b)
+    {
+        return detail::binary(std::plus<>(), a, b);
+    }
+
+    template <typename A, typename B,
+              typename = std::enable_if_t<detail::is_operation<A, B>>>
+    auto operator-(A const &a, B const &b)
+    {
+        return detail::binary(std::minus<>(), a, b);
+    }
+
+    template <typename A, typename B,
+              typename = std::enable_if_t<detail::is_operation<A, B>>>
+    auto operator*(A const &a, B const &b)
+    {
+        return detail::binary(std::multiplies<>(), a, b);
+    }
+
+    template <typename A, typename B,
+              typename = std::enable_if_t<detail::is_operation<A, B>>>
+    auto operator/(A const &a, B const &b)
+    {
+        return detail::binary(std::divides<>(), a, b);
+    }
+    // }}}1
+
+    // # Evaluation {{{1
+    /*! \brief Evaluate `expression` into `target`, an NdArray or a view of
+     *  the same shape, in one pass. This is what assigning an expression
+     *  to an array does.
+     */
+    template <typename Target, typename Expr>
+    void assign_expression(Target &target, Expr const &expression)
+    {
+        constexpr unsigned D = array_traits<Target>::dimension;
+        using value_type = typename array_traits<Target>::value_type;
+        using detail::expression_block;
+        static_assert(Expr::dimension == D,
+                      "Expression should have the dimension of the target.");
+
+        if (target.shape() != expression.shape())
+            throw Exception("Shapes of target and expression do not match.");
+
+        Slice<D> const &slice = target.slice();
+        if (slice.size == 0)
+            return;
+
+        auto start = detail::run_start(target.container(), 0);
+        Terminal<decltype(start), D> const output(start, slice);
+
+        size_t length = slice.shape[0];
+        unsigned axis = 1;
+        for (; axis < D && output.continues(axis, length)
+                        && expression.continues(axis, length); ++axis)
+            length *= slice.shape[axis];
+
+        size_t const n_runs = slice.size / length;
+        size_t const n_blocks = (length + expression_block - 1) / expression_block;
+        bool const unit = output.unit_stride() && expression.unit_stride();
+
+        // bits of std::vector<bool> share words, and are written by one thread
+        bool const parallel = std::is_pointer<decltype(start)>::value
+                           && slice.size > expression_block;
+
+        #pragma omp parallel if (parallel)
+        {
+            #pragma omp for nowait
+            for (size_t item = 0; item < n_runs * n_blocks; ++item)
+            {
+                size_t run = item / n_blocks,
+                       first = (item % n_blocks) * expression_block,
+                       n = std::min(expression_block, length - first);
+
+                shape_t<D> index;
+                index.fill(0);
+                for (unsigned k = axis; k < D; ++k)
+                {
+                    index[k] = run % slice.shape[k];
+                    run /= slice.shape[k];
+                }
+
+                auto o = output.cursor(index, first);
+                auto e = expression.cursor(index, first);
+                if (unit)
+                    for (size_t i = 0; i < n; ++i)
+                        o.unit(i) = value_type(e.unit(i));
+                else
+                    for (size_t i = 0; i < n; ++i)
+                        o.strided(i) = value_type(e.strided(i));
+            }
+        }
+    }
+
+    /*! \brief Evaluate an expression into a new array.
+     */
+    template <typename Expr, typename = std::enable_if_t<is_expression<Expr>>>
+    NdArray<typename Expr::value_type, Expr::dimension> evaluate(Expr const &expression)
+    {
+        NdArray<typename Expr::value_type, Expr::dimension> result(expression.shape());
+        assign_expression(result, expression);
+        return result;
+    }
+    // }}}1
+}} // namespace HyperCanny::numeric
+// vim: fdm=marker
@@ -21,9 +21,11 @@
 #include "ndarray.hh"
 #include "counter.hh"
 #include "convolution.hh"
+#include "recursive_gaussian.hh"
 
 #include <cmath>
 #include <queue>
+#include <vector>
 
 namespace HyperCanny {
 namespace numeric {
@@ -69,31 +71,150 @@ namespace filter
         return kernel;
     }
 
+    /*! \brief Method of Gaussian smoothing.
+     *
+     *  `direct` convolves with a truncated kernel of \f$2n + 1\f$ taps;
+     *  `recursive` uses the `RecursiveGaussian` filter, of which the cost
+     *  does not depend on the width of the Gaussian.
+     */
+    enum class GaussianMethod { direct, recursive };
+
+    /*! \brief Gaussian smoothing
+     *
+     * Filters the input with a Gaussian kernel, writing the result to
+     * `output`, which may be a view. All passes after the first are done
+     * in place, so no temporary arrays are allocated.
+     *   \param n Half width of the kernel, ignored by the recursive method.
+     *   \param sigma The standard deviation of the kernel, in pixels.
+     *   \param output Array of the same shape as `input`.
+     *   \param method Direct convolution or recursive filter.
+     *   \param boundary Boundary mode for each axis. The recursive method
+     *   only supports periodic boundaries.
+     */
+    template <typename Input, typename Output>
+    Output &gaussian(
+            Input const &input, unsigned n, float sigma, Output &output,
+            GaussianMethod method = GaussianMethod::direct,
+            boundary_t<array_traits<Input>::dimension> const &boundary =
+                uniform_boundary<array_traits<Input>::dimension>())
+    {
+        constexpr unsigned D = array_traits<Input>::dimension;
+        using real_t = compute_t<typename array_traits<Input>::value_type>;
+
+        if (method == GaussianMethod::recursive)
+        {
+            if (boundary != uniform_boundary<D>())
+                throw Exception("Recursive Gaussian needs periodic boundaries.");
+
+            recursive_gaussian_1d(input, sigma, output, 0);
+            for (unsigned axis = 1; axis < D; ++axis)
+                recursive_gaussian_1d(output, sigma, output, axis);
+            return output;
+        }
+
+        LineKernel<real_t> kernel(gaussian_kernel<real_t>(n, sigma));
+        convolve_1d(input, kernel, output, 0, boundary[0]);
+        for (unsigned axis = 1; axis < D; ++axis)
+            convolve_1d(output, kernel, output, axis, boundary[axis]);
+
+        return output;
+    }
+
     /*! \brief Gaussian smoothing
      *
      * Filters the input with a Gaussian kernel.
+     *   \param n Half width of the kernel, ignored by the recursive method.
+     *   \param sigma The standard deviation of the kernel, in pixels.
+     *   \param method Direct convolution or recursive filter.
+     *   \param boundary Boundary mode for each axis.
      */
     template <typename Input>
     typename array_traits<Input>::copy_type gaussian(
-            Input const &input, unsigned n, float sigma)
+            Input const &input, unsigned n, float sigma,
+            GaussianMethod method = GaussianMethod::direct,
+            boundary_t<array_traits<Input>::dimension> const &boundary =
+                uniform_boundary<array_traits<Input>::dimension>())
+    {
+        using output_type = typename array_traits<Input>::copy_type;
+
+        output_type output(input.shape());
+        gaussian(input, n, sigma, output, method, boundary);
+        return output;
+    }
+
+    /*! \brief Gaussian derivative
+     *
+     * Takes the derivative of the Gaussian smoothed input along `axis`,
+     * using the \f$[1/2, 0, -1/2]\f$ kernel of `gradient`.
+     *   \param n Half width of the kernel, ignored by the recursive method.
+     *   \param sigma The standard deviation of the kernel, in pixels.
+     *   \param method Direct convolution or recursive filter.
+     */
+    template <typename Input>
+    typename array_traits<Input>::copy_type gaussian_gradient(
+            Input const &input, unsigned axis, unsigned n, float sigma,
+            GaussianMethod method = GaussianMethod::direct)
     {
         constexpr unsigned D = array_traits<Input>::dimension;
-        using real_t = typename array_traits<Input>::value_type;
+        using real_t = compute_t<typename array_traits<Input>::value_type>;
         using output_type = typename array_traits<Input>::copy_type;
 
-        auto kernel = gaussian_kernel<real_t>(n, sigma);
-        output_type output(input.shape()), buffer(input.shape());
+        output_type output(input.shape());
 
-        convolve_1d(input, kernel, output, 0);
-        for (unsigned axis = 1; axis < D; ++axis)
+        if (method == GaussianMethod::recursive)
+        {
+            recursive_gaussian_1d(input, sigma, output, axis, true);
+            for (unsigned k = 1; k < D; ++k)
+                recursive_gaussian_1d(output, sigma, output, (axis + k) % D);
+            return output;
+        }
+
+        auto G = gaussian_kernel<real_t>(n, sigma);
+        auto gradient_kernel = convolve_padding_zero(
+                NdArray<real_t, 1>({3}, {0.5, 0.0, -0.5}), G);
+        output_type buffer(input.shape());
+
+        convolve_1d(input, gradient_kernel, output, axis);
+        for (unsigned k = 1; k < D; ++k)
         {
             std::swap(output, buffer);
-            convolve_1d(buffer, kernel, output, axis);
+            convolve_1d(buffer, G, output, (axis + k) % D);
         }
 
         return output;
     }
 
+    /*! \brief Sobel operator
+     *
+     *  Applies Sobel operator on one axis by filtering with a
+     *  smoothing kernel in all other axes, and a gradient kernel
+     *  on the given axis. The result is written to `output`, which may be
+     *  a view, such as one component of a vector field. All passes after
+     *  the first are done in place, so no temporary arrays are allocated.
+     *
+     *  \param input Input array.
+     *  \param axis Direction in which to take the gradient
+     *  \param smooth_kernel Custom smoothing kernel
+     *  \param gradient_kernel Custom gradient kernel
+     *  \param output Array of the same shape as `input`.
+     */
+    template <typename Input, typename Kernel, typename Output>
+    Output &sobel(
+            Input const &input, unsigned axis,
+            Kernel const &smooth_kernel,
+            Kernel const &gradient_kernel,
+            Output &output)
+    {
+        constexpr unsigned D = array_traits<Input>::dimension;
+
+        convolve_1d(input, smooth_kernel, output, (axis + 1) % D);
+        for (unsigned k = 2; k < D; ++k)
+            convolve_1d(output, smooth_kernel, output, (axis + k) % D);
+        convolve_1d(output, gradient_kernel, output, axis);
+
+        return output;
+    }
+
     /*! \brief Sobel operator
      *
      *  Applies Sobel operator on one axis by filtering with a
@@ -115,19 +236,10 @@ namespace filter
             Kernel const &smooth_kernel,
             Kernel const &gradient_kernel)
     {
-        constexpr unsigned D = array_traits<Input>::dimension;
         using output_type = typename array_traits<Input>::copy_type;
 
-        output_type output(input.shape()), buffer(input.shape());
-
-        convolve_1d(input, smooth_kernel, buffer, (axis + 1) % D);
-        for (unsigned k = 2; k < D; ++k)
-        {
-            std::swap(output, buffer);
-            convolve_1d(output, smooth_kernel, buffer, (axis + k) % D);
-        }
-        convolve_1d(buffer, gradient_kernel, output, axis);
-
+        output_type output(input.shape());
+        sobel(input, axis, smooth_kernel, gradient_kernel, output);
         return output;
     }
 
@@ -135,10 +247,279 @@ namespace filter
     typename array_traits<Input>::copy_type sobel(
             Input const &input, unsigned axis)
     {
-        using real_t = typename array_traits<Input>::value_type;
+        using real_t = compute_t<typename array_traits<Input>::value_type>;
 
         NdArray<real_t, 1> smooth_kernel({3}, {0.25, 0.50, 0.25});
         NdArray<real_t, 1> gradient_kernel({3}, {0.5, 0.0, -0.5});
         return sobel(input, axis, smooth_kernel, gradient_kernel);
     }
+
+    namespace detail
+    {
+        /*! \brief Smooth `input` along the axes `first` to `last`
+         *  (exclusive) except `skip`, writing the result to `output`.
+         */
+        template <typename Input, typename Kernel, typename Output,
+                  unsigned long D>
+        void smooth_axes(
+                Input const &input, Kernel const &kernel, Output &output,
+                unsigned first, unsigned last, unsigned skip,
+                boundary_t<D> const &boundary)
+        {
+            bool in_place = false;
+            for (unsigned axis = first; axis < last; ++axis)
+            {
+                if (axis == skip)
+                    continue;
+
+                if (in_place)
+                    convolve_1d(output, kernel, output, axis, boundary[axis]);
+                else
+                    convolve_1d(input, kernel, output, axis, boundary[axis]);
+                in_place = true;
+            }
+        }
+
+        /*! \brief Compute the Sobel components `first` to `last`
+         *  (exclusive) from an input that has already been smoothed along
+         *  all other axes. See `sobel_components`.
+         *
+         *  Each level of splitting needs one of `buffers`. Once these run
+         *  out, the remaining components are computed one by one in the
+         *  output. Components are finished in increasing order, and
+         *  `done(k, component)` is called right after component `k`.
+         */
+        template <typename Input, typename Kernel, typename Output,
+                  typename Buffer, unsigned long D, typename Done>
+        void sobel_split(
+                Input const &input, unsigned first, unsigned last,
+                Kernel const &smooth_kernel, Kernel const &gradient_kernel,
+                Output &output, Buffer *const *buffers, unsigned n_buffers,
+                boundary_t<D> const &boundary, Done &done)
+        {
+            if (last - first == 1 || n_buffers == 0)
+            {
+                for (unsigned k = first; k < last; ++k)
+                {
+                    auto component = output.sel(0, k);
+                    if (last - first == 1)
+                    {
+                        convolve_1d(input, gradient_kernel, component, k,
+                                    boundary[k]);
+                        done(k, component);
+                        continue;
+                    }
+                    smooth_axes(input, smooth_kernel, component,
+                                first, last, k, boundary);
+                    convolve_1d(component, gradient_kernel, component, k,
+                                boundary[k]);
+                    done(k, component);
+                }
+                return;
+            }
+
+            unsigned middle = (first + last) / 2;
+            Buffer &buffer = *buffers[0];
+
+            smooth_axes(input, smooth_kernel, buffer, middle, last, last,
+                        boundary);
+            sobel_split(buffer, first, middle, smooth_kernel,
+                        gradient_kernel, output, buffers + 1, n_buffers - 1,
+                        boundary, done);
+
+            smooth_axes(input, smooth_kernel, buffer, first, middle, middle,
+                        boundary);
+            sobel_split(buffer, middle, last, smooth_kernel,
+                        gradient_kernel, output, buffers + 1, n_buffers - 1,
+                        boundary, done);
+        }
+
+        template <typename Input, typename Kernel, typename Output,
+                  typename Buffer, unsigned long D>
+        void sobel_split(
+                Input const &input, unsigned first, unsigned last,
+                Kernel const &smooth_kernel, Kernel const &gradient_kernel,
+                Output &output, Buffer *const *buffers, unsigned n_buffers,
+                boundary_t<D> const &boundary)
+        {
+            auto done = [] (unsigned, auto const &) {};
+            sobel_split(input, first, last, smooth_kernel, gradient_kernel,
+                        output, buffers, n_buffers, boundary, done);
+        }
+
+        /*! \brief Stand-in for the output of `sobel_split` that hands out
+         *  the same array for every component.
+         */
+        template <typename Plane>
+        struct SinglePlane
+        {
+            Plane &plane;
+
+            typename Plane::View sel(unsigned, size_t)
+            {
+                return typename Plane::View(plane.slice(), plane.container());
+            }
+        };
+    }
+
+    /*! \brief Sobel operator along every axis
+     *
+     *  Computes the same components as calling `sobel(input, k, ...)` for
+     *  each axis `k`, and writes component `k` to `output.sel(0, k)`.
+     *  Smoothing passes are shared between components: the axes are split
+     *  in two halves, the components of one half need the input smoothed
+     *  along all axes of the other half, after which each half is split
+     *  again. For \f$D = 4\f$ this takes 12 one dimensional passes
+     *  instead of 16.
+     *
+     *  Each level of splitting keeps its intermediate result in one of
+     *  the two scratch buffers; the final passes of each component are
+     *  done in place in `output`. For \f$D \le 4\f$ two buffers cover
+     *  all levels. Beyond that, the deepest groups of components are
+     *  computed one by one, so no memory is allocated.
+     *
+     *  Smoothing passes are applied in a different order than in
+     *  `sobel()`, so the results agree up to rounding.
+     *
+     *  \param input Input array.
+     *  \param smooth_kernel Smoothing kernel.
+     *  \param gradient_kernel Gradient kernel.
+     *  \param output Array of rank one higher than `input`, with the
+     *  components on the first axis.
+     *  \param buffer_a Scratch array of the same shape as `input`.
+     *  \param buffer_b Scratch array of the same shape as `input`.
+     *  \param boundary Boundary mode for each axis.
+     */
+    template <typename Input, typename Kernel, typename Output,
+              typename Buffer>
+    void sobel_components(
+            Input const &input,
+            Kernel const &smooth_kernel,
+            Kernel const &gradient_kernel,
+            Output &output,
+            Buffer &buffer_a,
+            Buffer &buffer_b,
+            boundary_t<array_traits<Input>::dimension> const &boundary =
+                uniform_boundary<array_traits<Input>::dimension>())
+    {
+        constexpr unsigned D = array_traits<Input>::dimension;
+        using real_t = compute_t<typename array_traits<Input>::value_type>;
+
+        LineKernel<real_t> smooth(smooth_kernel), gradient(gradient_kernel);
+        Buffer *buffers[2] = { &buffer_a, &buffer_b };
+
+        detail::sobel_split(
+            input, 0, D, smooth, gradient, output, buffers, 2, boundary);
+    }
+
+    /*! \brief Sobel operator along every axis, one component at a time
+     *
+     *  As above, but each component is computed in turn in `plane`, an
+     *  array of the same shape as `input`, after which `done(k, plane)`
+     *  is called. This serves outputs that only keep something derived
+     *  from the components, without room for all of them.
+     */
+    template <typename Input, typename Kernel, typename Plane,
+              typename Buffer, typename Done>
+    void sobel_each_component(
+            Input const &input,
+            Kernel const &smooth_kernel,
+            Kernel const &gradient_kernel,
+            Plane &plane,
+            Buffer &buffer_a,
+            Buffer &buffer_b,
+            boundary_t<array_traits<Input>::dimension> const &boundary,
+            Done done)
+    {
+        constexpr unsigned D = array_traits<Input>::dimension;
+        using real_t = compute_t<typename array_traits<Input>::value_type>;
+
+        LineKernel<real_t> smooth(smooth_kernel), gradient(gradient_kernel);
+        Buffer *buffers[2] = { &buffer_a, &buffer_b };
+        detail::SinglePlane<Plane> output{plane};
+
+        detail::sobel_split(
+            input, 0, D, smooth, gradient, output, buffers, 2, boundary, done);
+    }
+
+    /*! \brief Sobel operator along every axis, one component at a time,
+     *  with a single scratch buffer.
+     */
+    template <typename Input, typename Kernel, typename Plane,
+              typename Buffer, typename Done>
+    void sobel_each_component(
+            Input const &input,
+            Kernel const &smooth_kernel,
+            Kernel const &gradient_kernel,
+            Plane &plane,
+            Buffer &buffer,
+            boundary_t<array_traits<Input>::dimension> const &boundary,
+            Done done)
+    {
+        constexpr unsigned D = array_traits<Input>::dimension;
+        using real_t = compute_t<typename array_traits<Input>::value_type>;
+
+        LineKernel<real_t> smooth(smooth_kernel), gradient(gradient_kernel);
+        Buffer *buffers[1] = { &buffer };
+        detail::SinglePlane<Plane> output{plane};
+
+        detail::sobel_split(
+            input, 0, D, smooth, gradient, output, buffers, 1, boundary, done);
+    }
+
+    /*! \brief Sobel operator along every axis
+     *
+     *  As above, with a single scratch buffer. For \f$D \le 4\f$ this
+     *  takes the same number of passes, but more of them work on the
+     *  strided components of `output`.
+     */
+    template <typename Input, typename Kernel, typename Output,
+              typename Buffer>
+    void sobel_components(
+            Input const &input,
+            Kernel const &smooth_kernel,
+            Kernel const &gradient_kernel,
+            Output &output,
+            Buffer &buffer,
+            boundary_t<array_traits<Input>::dimension> const &boundary =
+                uniform_boundary<array_traits<Input>::dimension>())
+    {
+        constexpr unsigned D = array_traits<Input>::dimension;
+        using real_t = compute_t<typename array_traits<Input>::value_type>;
+
+        LineKernel<real_t> smooth(smooth_kernel), gradient(gradient_kernel);
+        Buffer *buffers[1] = { &buffer };
+
+        detail::sobel_split(
+            input, 0, D, smooth, gradient, output, buffers, 1, boundary);
+    }
+
+    /*! \brief Sobel operator along every axis
+     *
+     *  As above, allocating the scratch buffers.
+     */
+    template <typename Input, typename Kernel, typename Output>
+    void sobel_components(
+            Input const &input,
+            Kernel const &smooth_kernel,
+            Kernel const &gradient_kernel,
+            Output &output)
+    {
+        constexpr unsigned D = array_traits<Input>::dimension;
+        using buffer_type = typename array_traits<Input>::copy_type;
+
+        // up to two dimensions, there is only one level of splitting
+        buffer_type buffer_a(input.shape());
+        if (D <= 2)
+        {
+            sobel_components(
+                input, smooth_kernel, gradient_kernel, output, buffer_a);
+            return;
+        }
+
+        buffer_type buffer_b(input.shape());
+        sobel_components(
+            input, smooth_kernel, gradient_kernel, output,
+            buffer_a, buffer_b);
+    }
 }}}
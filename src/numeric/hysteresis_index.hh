@@ -0,0 +1,262 @@
+/* Copyright 2017 Netherlands eScience Center
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#pragma once
+
+/*! \file numeric/hysteresis_index.hh
+ *  \brief Double threshold for many pairs of thresholds on the same edges.
+ *
+ *  The candidates of a thinned mask are added one by one, strongest
+ *  (lowest inverse magnitude) first, and each one becomes a node of a
+ *  merge tree: the parent of the components it joins, or of nothing if
+ *  it starts a new one. The subtree under a node is then the component
+ *  of that node at its own level, and along the path to the root levels
+ *  only go up.
+ *
+ *  For thresholds `lower` and `upper`, the component at level `upper`
+ *  around a pixel is the subtree of its highest ancestor at or below
+ *  `upper`. The edges that pass are those subtrees over the pixels at or
+ *  below `lower`. Nodes are stored in depth-first order, so that every
+ *  subtree is a range of pixels; a query climbs from each of those
+ *  pixels that is not yet covered and copies the range, which takes time
+ *  proportional to the output.
+ */
+
+#include "canny.hh"
+
+#include <map>
+
+namespace HyperCanny {
+namespace numeric {
+namespace filter {
+    /*! \brief Precomputed merge tree of the candidates of a thinned edge
+     *  mask, answering `double_threshold()` for any pair of thresholds
+     *  with `lower` not above `upper`.
+     */
+    class HysteresisIndex
+    {
+        static constexpr size_t none = std::numeric_limits<size_t>::max();
+
+        size_t m_n_pixels;
+        std::vector<double> m_level;    // inverse magnitude, by rank
+        std::vector<size_t> m_parent;   // rank of the parent node, or none
+        std::vector<size_t> m_begin;    // position of the subtree in m_layout
+        std::vector<size_t> m_size;     // size of the subtree
+        std::vector<size_t> m_layout;   // pixel index, in depth-first order
+
+        public:
+            /*! \brief Build the index.
+             *
+             *  \param input Output of sobel() function.
+             *  \param mask Output of edge_thinning() function.
+             *  \param boundary Boundary mode for each of the D spatial axes.
+             */
+            template <typename Input, typename Mask>
+            HysteresisIndex(
+                    Input const &input, Mask const &mask,
+                    boundary_t<array_traits<Input>::dimension - 1> const &boundary =
+                        uniform_boundary<array_traits<Input>::dimension - 1>())
+            {
+                constexpr unsigned D = array_traits<Input>::dimension - 1;
+
+                if (reduce_one(input.shape(), 0) != mask.shape())
+                    throw Exception("Shapes of input and mask do not match.");
+
+                Slice<D> const spatial = input.slice().sel(0, 0);
+                ptrdiff_t const component = input.slice().stride[0];
+                auto const *data = input.const_container().data() + D * component;
+                Slice<D> const grid(spatial.shape);
+                size_t const n = grid.shape[0];
+                ptrdiff_t const step = spatial.stride[0];
+                size_t const n_lines = (n > 0 ? grid.size / n : 0);
+                m_n_pixels = grid.size;
+
+                // candidates, strongest first; NaN never passes
+                std::vector<std::pair<double, size_t>> candidates;
+                for (size_t line = 0; line < n_lines; ++line)
+                {
+                    auto const *v = data + spatial.flat_index(grid.index(line * n));
+                    for (size_t x = 0; x < n; ++x)
+                    {
+                        size_t i = line * n + x;
+                        double value = v[x * step];
+                        if (mask[i] && !std::isnan(value))
+                            candidates.emplace_back(value, i);
+                    }
+                }
+                std::sort(candidates.begin(), candidates.end());
+
+                size_t const n_nodes = candidates.size();
+                std::vector<size_t> rank(grid.size, none), pixel(n_nodes);
+                m_level.resize(n_nodes);
+                for (size_t r = 0; r < n_nodes; ++r)
+                {
+                    m_level[r] = candidates[r].first;
+                    pixel[r] = candidates[r].second;
+                    rank[pixel[r]] = r;
+                }
+                candidates.clear();
+                candidates.shrink_to_fit();
+
+                // the root of a set is always its latest node
+                std::vector<size_t> set(n_nodes);
+                auto find = [&set] (size_t x)
+                {
+                    while (set[x] != x)
+                        x = set[x] = set[set[x]];
+                    return x;
+                };
+
+                detail::Neighbourhood<D> const neighbourhood(grid.shape, boundary);
+                m_parent.assign(n_nodes, none);
+                for (size_t r = 0; r < n_nodes; ++r)
+                {
+                    set[r] = r;
+                    neighbourhood.for_each(pixel[r], [&] (size_t j)
+                    {
+                        if (rank[j] >= r)
+                            return;
+                        size_t root = find(rank[j]);
+                        if (root != r)
+                            set[root] = m_parent[root] = r;
+                    });
+                }
+
+                // parents come after their children, so sizes are summed
+                // going up and positions handed out going down
+                m_size.assign(n_nodes, 1);
+                for (size_t r = 0; r < n_nodes; ++r)
+                    if (m_parent[r] != none)
+                        m_size[m_parent[r]] += m_size[r];
+
+                std::vector<size_t> &next = set;
+                size_t next_root = 0;
+                m_begin.resize(n_nodes);
+                m_layout.resize(n_nodes);
+                for (size_t r = n_nodes; r-- > 0;)
+                {
+                    size_t &cursor = (m_parent[r] == none ? next_root : next[m_parent[r]]);
+                    m_begin[r] = cursor;
+                    cursor += m_size[r];
+                    next[r] = m_begin[r] + 1;
+                    m_layout[m_begin[r]] = pixel[r];
+                }
+            }
+
+            /*! \brief Number of pixels of the mask the index was built on.
+             */
+            size_t n_pixels() const { return m_n_pixels; }
+
+            /*! \brief Number of candidates in the index.
+             */
+            size_t size() const { return m_level.size(); }
+
+            /*! \brief Call `f` with the flat index of each pixel that passes
+             *  the double threshold, in no particular order.
+             */
+            template <typename F>
+            void for_each_edge(double lower, double upper, F f) const
+            {
+                if (lower > upper)
+                    throw Exception("The hysteresis index needs `lower` not above `upper`.");
+
+                size_t const n_seeds = std::upper_bound(
+                    m_level.begin(), m_level.end(), lower) - m_level.begin();
+                size_t const n_upper = std::upper_bound(
+                    m_level.begin(), m_level.end(), upper) - m_level.begin();
+
+                // ranges of m_layout that are already written
+                std::map<size_t, size_t> done;
+                for (size_t s = 0; s < n_seeds; ++s)
+                {
+                    auto covering = done.upper_bound(m_begin[s]);
+                    if (covering != done.begin()
+                            && std::prev(covering)->second > m_begin[s])
+                        continue;
+
+                    size_t top = s;
+                    while (m_parent[top] < n_upper)
+                        top = m_parent[top];
+
+                    size_t first = m_begin[top], last = first + m_size[top];
+                    done.emplace(first, last);
+                    for (size_t i = first; i < last; ++i)
+                        f(m_layout[i]);
+                }
+            }
+
+            /*! \brief Flat indices of the pixels that pass, in no particular
+             *  order.
+             */
+            std::vector<size_t> edges(double lower, double upper) const
+            {
+                std::vector<size_t> result;
+                for_each_edge(lower, upper, [&result] (size_t i)
+                {
+                    result.push_back(i);
+                });
+                return result;
+            }
+
+            /*! \brief Write the edges that pass to `output`, the same as
+             *  `double_threshold(input, mask, lower, upper, output)`.
+             *
+             *  \return The number of edge pixels.
+             */
+            template <unsigned D, typename Word, typename Container>
+            size_t operator()(
+                    double lower, double upper,
+                    EdgeMask<D, Word, Container> &output) const
+            {
+                if (calc_size<D>(output.shape()) != m_n_pixels)
+                    throw Exception("Output does not match the size of the index.");
+
+                size_t count = 0;
+                output.fill(false);
+                for_each_edge(lower, upper, [&] (size_t i)
+                {
+                    output.set(i);
+                    ++count;
+                });
+                return count;
+            }
+
+            /*! \brief Answer a batch of threshold pairs in parallel, one
+             *  output for each pair.
+             */
+            template <unsigned D, typename Word, typename Container>
+            void operator()(
+                    std::vector<std::pair<double, double>> const &thresholds,
+                    std::vector<EdgeMask<D, Word, Container>> &outputs) const
+            {
+                if (outputs.size() != thresholds.size())
+                    throw Exception("Need one output for each pair of thresholds.");
+                for (size_t j = 0; j < thresholds.size(); ++j)
+                {
+                    if (thresholds[j].first > thresholds[j].second)
+                        throw Exception("The hysteresis index needs `lower` not above `upper`.");
+                    if (calc_size<D>(outputs[j].shape()) != m_n_pixels)
+                        throw Exception("Output does not match the size of the index.");
+                }
+
+                size_t const n = thresholds.size();
+                #pragma omp parallel
+                {
+                    #pragma omp for schedule(dynamic) nowait
+                    for (size_t j = 0; j < n; ++j)
+                        (*this)(thresholds[j].first, thresholds[j].second, outputs[j]);
+                }
+            }
+    };
+}}} // namespace HyperCanny::numeric::filter
@@ -0,0 +1,528 @@
+/* Copyright 2017 Netherlands eScience Center
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#pragma once
+
+/*! \file numeric/line_convolution.hh
+ *  \brief Convolution of a single strided line of raw data.
+ *
+ *  This is the engine behind `convolve_1d`. It works on base pointers and
+ *  strides, so no `NdArray` objects or iterators are created per line.
+ */
+
+#include "support.hh"
+#include "slice.hh"
+#include "boundary.hh"
+#include "simd.hh"
+#include "half.hh"
+
+#include <vector>
+#include <algorithm>
+#include <limits>
+#include <cmath>
+#include <type_traits>
+
+namespace HyperCanny {
+namespace numeric
+{
+    /*! \brief Symmetry of a one dimensional kernel around its center.
+     */
+    enum class Parity { general, symmetric, antisymmetric };
+
+    /*! \brief One dimensional kernel, prepared for line convolution.
+     *
+     *  The taps are stored in reverse order, such that the convolution
+     *  reduces to a plain inner product
+     *
+     *  \f[y[i]\ =\ \sum_j t[j]\, x[i - l + j],\f]
+     *
+     *  where \f$l = K/2\f$ is the number of samples that the kernel reaches
+     *  to the left. This matches the centering used by `convolve()`.
+     *
+     *  Zero taps at either end are dropped. If the remaining kernel is
+     *  centered and (anti)symmetric, it is folded, so that the convolution
+     *  takes \f$(x[i-k] \pm x[i+k])\, w[k]\f$ pairs. This halves the
+     *  number of multiplications for Gaussian and gradient kernels. Kernels
+     *  that are computed numerically, like those in `smooth_sobel()`, are
+     *  symmetric up to round-off, so parity detection allows a relative
+     *  tolerance of a few machine epsilon.
+     */
+    template <typename real_t>
+    class LineKernel
+    {
+        std::vector<real_t> m_taps;
+        std::vector<real_t> m_folded;
+        size_t m_left;
+        Parity m_parity;
+
+        void trim()
+        {
+            auto is_zero = [] (real_t x) { return x == real_t(0); };
+
+            size_t lead = std::find_if_not(
+                    m_taps.begin(), m_taps.end(), is_zero) - m_taps.begin();
+            lead = std::min(lead, m_left);
+            m_taps.erase(m_taps.begin(), m_taps.begin() + lead);
+            m_left -= lead;
+
+            size_t trail = std::find_if_not(
+                    m_taps.rbegin(), m_taps.rend(), is_zero) - m_taps.rbegin();
+            trail = std::min(trail, right());
+            m_taps.resize(m_taps.size() - trail);
+        }
+
+        bool is_centered() const
+        {
+            return m_taps.size() == 2 * m_left + 1;
+        }
+
+        bool has_parity(Parity parity) const
+        {
+            if (!is_centered() || parity == Parity::general)
+                return false;
+
+            real_t scale = 0;
+            for (real_t t : m_taps)
+                scale = std::max(scale, std::abs(t));
+            real_t eps = 8 * std::numeric_limits<real_t>::epsilon() * scale;
+
+            real_t const *c = m_taps.data() + m_left;
+            if (parity == Parity::antisymmetric && std::abs(c[0]) > eps)
+                return false;
+
+            for (size_t k = 1; k <= m_left; ++k)
+            {
+                real_t d = (parity == Parity::symmetric
+                            ? c[-ptrdiff_t(k)] - c[k] : c[-ptrdiff_t(k)] + c[k]);
+                if (std::abs(d) > eps)
+                    return false;
+            }
+            return true;
+        }
+
+        void fold(Parity parity)
+        {
+            m_parity = parity;
+            if (parity == Parity::general)
+                return;
+
+            real_t const *c = m_taps.data() + m_left;
+            m_folded.resize(m_left + 1);
+            m_folded[0] = (parity == Parity::symmetric ? c[0] : real_t(0));
+            for (size_t k = 1; k <= m_left; ++k)
+                m_folded[k] = (parity == Parity::symmetric
+                               ? c[-ptrdiff_t(k)] + c[k]
+                               : c[-ptrdiff_t(k)] - c[k]) / 2;
+        }
+
+        public:
+            /*! \brief Prepare kernel, detecting its parity.
+             */
+            template <typename Kernel>
+            explicit LineKernel(Kernel const &kernel)
+                : m_taps(kernel.cbegin(), kernel.cend())
+                , m_left(m_taps.size() / 2)
+            {
+                std::reverse(m_taps.begin(), m_taps.end());
+                trim();
+
+                if (has_parity(Parity::symmetric))
+                    fold(Parity::symmetric);
+                else if (has_parity(Parity::antisymmetric))
+                    fold(Parity::antisymmetric);
+                else
+                    fold(Parity::general);
+            }
+
+            /*! \brief Prepare kernel with a given parity. The parity is
+             *  not checked, the kernel is folded by averaging the taps on
+             *  both sides of the center. The kernel must have an odd
+             *  number of taps, after trimming zeros.
+             */
+            template <typename Kernel>
+            LineKernel(Kernel const &kernel, Parity parity)
+                : m_taps(kernel.cbegin(), kernel.cend())
+                , m_left(m_taps.size() / 2)
+            {
+                std::reverse(m_taps.begin(), m_taps.end());
+                trim();
+
+                if (parity != Parity::general && !is_centered())
+                    throw Exception("Kernel with parity should have odd size.");
+                fold(parity);
+            }
+
+            size_t size() const { return m_taps.size(); }
+            size_t left() const { return m_left; }
+            size_t right() const { return m_taps.size() - 1 - m_left; }
+            real_t const *taps() const { return m_taps.data(); }
+            Parity parity() const { return m_parity; }
+
+            /*! \brief Folded weights \f$w[0] \dots w[l]\f$; only valid
+             *  if the kernel has parity.
+             */
+            real_t const *folded() const { return m_folded.data(); }
+
+            /*! \brief Size of the scratch buffer needed by `convolve_line`
+             *  for a line of given length.
+             */
+            size_t scratch_size(size_t length) const
+            {
+                return 2 * length + m_taps.size() - 1;
+            }
+
+            /*! \brief Size of the scratch buffer needed by
+             *  `convolve_block` for lines of given length.
+             */
+            size_t block_scratch_size(size_t length) const
+            {
+                return simd::block_width * scratch_size(length);
+            }
+    };
+
+    /*! \brief Copy a strided line into a contiguous buffer, padding it on
+     *  both sides according to a boundary mode.
+     *
+     *  The interior of the line is a plain copy; only the padding looks
+     *  at the boundary mode. Input of a storage type such as `half` is
+     *  converted to `real_t` on the way.
+     *
+     *  \param input Pointer to the first element of the line.
+     *  \param stride Memory step between elements of the line.
+     *  \param length Number of elements in the line.
+     *  \param left Padding on the left.
+     *  \param right Padding on the right.
+     *  \param buffer Output of size `left + length + right`.
+     *  \param boundary How the line is continued beyond its ends.
+     */
+    template <typename real_t, typename In>
+    void pad_line(
+            In const *input, ptrdiff_t stride, size_t length,
+            size_t left, size_t right, real_t *buffer,
+            Boundary boundary = Boundary::periodic)
+    {
+        auto outside = [=] (ptrdiff_t i)
+        {
+            ptrdiff_t q = boundary_index(boundary, i, length);
+            return (q < 0 ? real_t(0) : real_t(input[q * stride]));
+        };
+
+        for (size_t i = 0; i < left; ++i)
+            buffer[i] = outside(ptrdiff_t(i) - ptrdiff_t(left));
+
+        real_t *middle = buffer + left;
+        if (stride == 1)
+            simd::convert(input, middle, length);
+        else
+            for (size_t i = 0; i < length; ++i)
+                middle[i] = real_t(input[i * stride]);
+
+        real_t *tail = middle + length;
+        for (size_t i = 0; i < right; ++i)
+            tail[i] = outside(length + i);
+    }
+
+    /*! \brief Where a line kernel can write its result directly: the
+     *  output itself if it is contiguous and of the compute type, else
+     *  `nullptr`.
+     */
+    template <typename real_t, typename Out>
+    real_t *direct_output(Out *output, ptrdiff_t stride)
+    {
+        if constexpr (std::is_same<Out, real_t>::value)
+            return (stride == 1 ? output : nullptr);
+        else
+            return nullptr;
+    }
+
+    /*! \brief Write a contiguous result to a strided line, converting to
+     *  the storage type of the output.
+     */
+    template <typename real_t, typename Out>
+    void store_line(
+            real_t const *result, Out *output, ptrdiff_t stride,
+            size_t length)
+    {
+        if (stride == 1)
+            simd::convert(result, output, length);
+        else
+            for (size_t i = 0; i < length; ++i)
+                output[i * stride] = Out(result[i]);
+    }
+
+    /*! \brief Write an interleaved block result, as produced by the
+     *  block kernels, to `simd::block_width` neighbouring lines.
+     */
+    template <typename real_t, typename Out>
+    void store_block(
+            real_t const *result, Out *output, ptrdiff_t stride,
+            ptrdiff_t lane_stride, size_t length)
+    {
+        constexpr unsigned W = simd::block_width;
+
+        for (size_t i = 0; i < length; ++i)
+        {
+            if (lane_stride == 1)
+                simd::convert(result + i * W, output + i * stride, W);
+            else
+                for (unsigned b = 0; b < W; ++b)
+                    output[i * stride + b * lane_stride] =
+                        Out(result[i * W + b]);
+        }
+    }
+
+    /*! \brief Convolve a single line.
+     *
+     *  The line is first copied into `scratch`, so `input` and `output` may
+     *  point to the same memory. The inner products are computed by
+     *  `simd::correlate`, or `simd::correlate_folded` for kernels with
+     *  parity, which pick a vectorised kernel for single precision data.
+     *  The input and output may be stored in another type than the
+     *  kernel, such as `half`; they are converted while copying.
+     *
+     *  \param kernel Prepared kernel.
+     *  \param input Pointer to the first element of the input line.
+     *  \param input_stride Memory step between input elements.
+     *  \param output Pointer to the first element of the output line.
+     *  \param output_stride Memory step between output elements.
+     *  \param length Number of elements in the line.
+     *  \param scratch Buffer of at least `kernel.scratch_size(length)`
+     *  elements.
+     *  \param boundary How the line is continued beyond its ends.
+     */
+    template <typename real_t, typename In, typename Out>
+    void convolve_line(
+            LineKernel<real_t> const &kernel,
+            In const *input, ptrdiff_t input_stride,
+            Out *output, ptrdiff_t output_stride,
+            size_t length, real_t *scratch,
+            Boundary boundary = Boundary::periodic)
+    {
+        pad_line(
+            input, input_stride, length,
+            kernel.left(), kernel.right(), scratch, boundary);
+
+        real_t *direct = direct_output<real_t>(output, output_stride);
+        real_t *result = (direct ? direct
+                          : scratch + length + kernel.size() - 1);
+        switch (kernel.parity())
+        {
+            case Parity::symmetric:
+                simd::correlate_folded<false>(
+                    scratch, kernel.folded(), kernel.left(), result, length);
+                break;
+            case Parity::antisymmetric:
+                simd::correlate_folded<true>(
+                    scratch, kernel.folded(), kernel.left(), result, length);
+                break;
+            default:
+                simd::correlate(
+                    scratch, kernel.taps(), kernel.size(), result, length);
+        }
+
+        if (!direct)
+            store_line(result, output, output_stride, length);
+    }
+
+    /*! \brief Copy a block of `simd::block_width` neighbouring lines into
+     *  an interleaved buffer, padded as in `pad_line`.
+     *
+     *  Element `b` of padded position `p` is stored at
+     *  `buffer[p * simd::block_width + b]`.
+     *
+     *  \param lane_stride Memory step between neighbouring lines.
+     */
+    template <typename real_t, typename In>
+    void pad_block(
+            In const *input, ptrdiff_t stride, ptrdiff_t lane_stride,
+            size_t length, size_t left, size_t right, real_t *buffer,
+            Boundary boundary = Boundary::periodic)
+    {
+        constexpr unsigned W = simd::block_width;
+
+        auto copy_row = [=] (ptrdiff_t q, real_t *dst)
+        {
+            if (q < 0)
+                std::fill(dst, dst + W, real_t(0));
+            else if (lane_stride == 1)
+                simd::convert(input + q * stride, dst, W);
+            else
+                for (unsigned b = 0; b < W; ++b)
+                    dst[b] = real_t(input[q * stride + b * lane_stride]);
+        };
+
+        for (size_t p = 0; p < left; ++p)
+            copy_row(boundary_index(
+                boundary, ptrdiff_t(p) - ptrdiff_t(left), length),
+                buffer + p * W);
+
+        for (size_t q = 0; q < length; ++q)
+            copy_row(q, buffer + (left + q) * W);
+
+        for (size_t p = 0; p < right; ++p)
+            copy_row(boundary_index(boundary, length + p, length),
+                     buffer + (left + length + p) * W);
+    }
+
+    /*! \brief Convolve a block of `simd::block_width` neighbouring lines.
+     *
+     *  This is used for convolution along axes that have a large stride.
+     *  If neighbouring lines are adjacent in memory, every tap reads a
+     *  contiguous row of the block, instead of touching a different cache
+     *  line for each line. The result is the same as calling
+     *  `convolve_line` on each of the lines.
+     *
+     *  \param input_lane_stride Memory step between neighbouring input
+     *  lines.
+     *  \param output_lane_stride Memory step between neighbouring output
+     *  lines.
+     *  \param scratch Buffer of at least `kernel.block_scratch_size(length)`
+     *  elements.
+     */
+    template <typename real_t, typename In, typename Out>
+    void convolve_block(
+            LineKernel<real_t> const &kernel,
+            In const *input, ptrdiff_t input_stride,
+            ptrdiff_t input_lane_stride,
+            Out *output, ptrdiff_t output_stride,
+            ptrdiff_t output_lane_stride,
+            size_t length, real_t *scratch,
+            Boundary boundary = Boundary::periodic)
+    {
+        constexpr unsigned W = simd::block_width;
+
+        pad_block(
+            input, input_stride, input_lane_stride, length,
+            kernel.left(), kernel.right(), scratch, boundary);
+
+        real_t *direct = direct_output<real_t>(output, output_lane_stride);
+        real_t *result = (direct ? direct
+                          : scratch + W * (length + kernel.size() - 1));
+        ptrdiff_t result_stride = (direct ? output_stride : W);
+
+        switch (kernel.parity())
+        {
+            case Parity::symmetric:
+                simd::correlate_block_folded<false>(
+                    scratch, kernel.folded(), kernel.left(),
+                    result, result_stride, length);
+                break;
+            case Parity::antisymmetric:
+                simd::correlate_block_folded<true>(
+                    scratch, kernel.folded(), kernel.left(),
+                    result, result_stride, length);
+                break;
+            default:
+                simd::correlate_block(
+                    scratch, kernel.taps(), kernel.size(),
+                    result, result_stride, length);
+        }
+
+        if (!direct)
+            store_block(result, output, output_stride, output_lane_stride,
+                        length);
+    }
+
+    /*! \brief Apply an operation to every line of an array along one axis.
+     *
+     *  Lines are handed out in blocks of `simd::block_width` neighbours
+     *  along `lane_axis`. With the default `lane_axis` of 0, memory is
+     *  read in contiguous rows rather than with the large stride of
+     *  `axis`. If `lane_axis` equals `axis`, no blocks are formed. Lines
+     *  that do not fill a block are handed out one at a time. Lines are
+     *  distributed over OpenMP threads; each thread owns one scratch
+     *  buffer.
+     *
+     *  \param input Slice of the input data.
+     *  \param input_data Base pointer of the input data.
+     *  \param output Slice of the output data, should have the same shape.
+     *  \param output_data Base pointer of the output data.
+     *  \param axis Axis along which the lines run.
+     *  \param line_scratch Scratch size needed by `line_op`.
+     *  \param block_scratch Scratch size needed by `block_op`.
+     *  \param line_op Called as `line_op(input, input_stride, output,
+     *  output_stride, length, scratch)`.
+     *  \param block_op Called as `block_op(input, input_stride,
+     *  input_lane_stride, output, output_stride, output_lane_stride, length,
+     *  scratch)`.
+     *  \param lane_axis Axis along which lines are grouped into blocks.
+     */
+    template <typename Scratch, unsigned D, typename In, typename Out,
+              typename LineOp, typename BlockOp>
+    void for_each_line(
+            Slice<D> const &input, In const *input_data,
+            Slice<D> const &output, Out *output_data,
+            unsigned axis, size_t line_scratch, size_t block_scratch,
+            LineOp line_op, BlockOp block_op, unsigned lane_axis = 0)
+    {
+        constexpr unsigned W = simd::block_width;
+
+        size_t length = input.shape[axis];
+        ptrdiff_t input_stride = input.stride[axis],
+                  output_stride = output.stride[axis];
+
+        if constexpr (D == 1)
+        {
+            std::vector<Scratch> scratch(line_scratch);
+            line_op(input_data + input.offset, input_stride,
+                    output_data + output.offset, output_stride,
+                    length, scratch.data());
+        }
+        else
+        {
+            auto input_lines = input.sel(axis, 0);
+            auto output_lines = output.sel(axis, 0);
+
+            // full blocks along the lane axis, and the remaining lines
+            unsigned lane = (lane_axis > axis ? lane_axis - 1 : lane_axis);
+            size_t n_blocks = (lane_axis == axis ? 0
+                               : input.shape[lane_axis] / W);
+            shape_t<D-1> block_shape = input_lines.shape,
+                         rest_shape = input_lines.shape;
+            block_shape[lane] = n_blocks;
+            rest_shape[lane] -= n_blocks * W;
+            Slice<D-1> blocks(block_shape), rest(rest_shape);
+
+            #pragma omp parallel
+            {
+            std::vector<Scratch> scratch(
+                n_blocks > 0 ? block_scratch : line_scratch);
+
+            #pragma omp for nowait
+            for (size_t i = 0; i < blocks.size; ++i)
+            {
+                shape_t<D-1> index = blocks.index(i);
+                index[lane] *= W;
+                block_op(
+                    input_data + input_lines.flat_index(index),
+                    input_stride, input.stride[lane_axis],
+                    output_data + output_lines.flat_index(index),
+                    output_stride, output.stride[lane_axis],
+                    length, scratch.data());
+            }
+
+            #pragma omp for nowait
+            for (size_t i = 0; i < rest.size; ++i)
+            {
+                shape_t<D-1> index = rest.index(i);
+                index[lane] += n_blocks * W;
+                line_op(
+                    input_data + input_lines.flat_index(index), input_stride,
+                    output_data + output_lines.flat_index(index), output_stride,
+                    length, scratch.data());
+            }
+            }
+        }
+    }
+}} // namespace HyperCanny::numeric
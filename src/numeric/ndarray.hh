@@ -24,6 +24,7 @@
 #include "nditerator.hh"
 #include "periodic_iterator.hh"
 #include "pointer_range.hh"
+#include "strided_copy.hh"
 
 #include <vector>
 #include <initializer_list>
@@ -38,21 +39,7 @@ namespace numeric
      * @{
      */
 
-    // # Base class and forward declarations {{{1
-    /*! \brief Base class for all NdArray classes.
-     */
-    template <typename T, unsigned D, typename Container = std::vector<T>>
-    class NdArrayBase
-    {
-        public:
-            virtual ~NdArrayBase() {}
-
-            virtual Container &container() = 0;
-            virtual Container const &const_container() const = 0;
-
-            virtual shape_t<D> const &shape() const = 0;
-    };
-
+    // # Forward declarations {{{1
     template <typename T, unsigned D, typename Container>
     class NdArrayView;
 
@@ -67,6 +54,23 @@ namespace numeric
 
     template <typename T, unsigned D, typename Container>
     class NdArray;
+
+    template <typename Derived>
+    class NdArrayImpl;
+
+    /*! \brief Whether `T` is NdArray or one of its views, whose elements
+     *  can be walked in runs.
+     */
+    template <typename T>
+    constexpr bool is_nd_array = std::is_base_of<NdArrayImpl<T>, T>::value;
+
+    template <typename Derived>
+    class Expression;
+
+    /*! \brief Whether `T` is a lazy expression, see numeric/expression.hh.
+     */
+    template <typename T>
+    constexpr bool is_expression = std::is_base_of<Expression<T>, T>::value;
     // }}}1
 
     // # Traits class {{{1
@@ -84,7 +88,6 @@ namespace numeric
         using mask_type = NdArray<bool, D, std::vector<bool>>;
         using iterator = NdIterator<typename Container::iterator, D>;
         using const_iterator = ConstNdIterator<typename Container::const_iterator, D>;
-        using base_type = NdArrayBase<T, D, Container>;
         using reduced_view = NdArrayView<T, D-1, Container>;
         using const_reduced_view = ConstNdArrayView<T, D-1, Container>;
         using periodic_view = PeriodicNdArrayView<T, D, Container>;
@@ -103,7 +106,6 @@ namespace numeric
         using iterator = NdIterator<typename Container::iterator, D>;
         using mask_type = NdArray<bool, D, std::vector<bool>>;
         using const_iterator = ConstNdIterator<typename Container::const_iterator, D>;
-        using base_type = NdArrayBase<T, D, Container>;
         using reduced_view = NdArrayView<T, D-1, Container>;
         using const_reduced_view = ConstNdArrayView<T, D-1, Container>;
         using periodic_view = PeriodicNdArrayView<T, D, Container>;
@@ -125,7 +127,6 @@ namespace numeric
         using iterator = ConstNdIterator<typename Container::const_iterator, D>;
         using const_iterator = ConstNdIterator<typename Container::const_iterator, D>;
         using mask_type = NdArray<bool, D, std::vector<bool>>;
-        using base_type = NdArrayBase<T, D, Container>;
         using reduced_view = NdArrayView<T, D-1, Container>;
         using const_reduced_view = ConstNdArrayView<T, D-1, Container>;
         using periodic_view = PeriodicNdArrayView<T, D, Container>;
@@ -140,10 +141,8 @@ namespace numeric
     // # Class interfaces {{{1
     // class PeriodicNdArrayView {{{2
     template <typename T, unsigned D, typename Container = std::vector<T>>
-    class PeriodicNdArrayView: public NdArrayBase<T, D, Container>
+    class PeriodicNdArrayView
     {
-        using Base = NdArrayBase<T, D, Container>;
-
         Container &m_container;
         Slice<D>   m_slice;
         shape_t<D> m_offset;
@@ -178,8 +177,8 @@ namespace numeric
             const_iterator cbegin() const;
             const_iterator cend() const { return const_iterator(); }
 
-            virtual Container &container() { return m_container; }
-            virtual Container const &const_container() const { return m_container; }
+            Container &container() { return m_container; }
+            Container const &const_container() const { return m_container; }
 
             // TODO merge these operators with those in NdArrayImpl
             template <typename T2>
@@ -194,10 +193,8 @@ namespace numeric
     // }}}2
     // class ConstPeriodicNdArrayView {{{2
     template <typename T, unsigned D, typename Container = std::vector<T>>
-    class ConstPeriodicNdArrayView: public NdArrayBase<T, D, Container>
+    class ConstPeriodicNdArrayView
     {
-        using Base = NdArrayBase<T, D, Container>;
-
         Container const &m_container;
         Slice<D>   m_slice;
         shape_t<D> m_offset;
@@ -232,8 +229,8 @@ namespace numeric
             const_iterator cbegin() const;
             const_iterator cend() const { return const_iterator(); }
 
-            virtual Container &container() { throw NotImplementedError(); }
-            virtual Container const &const_container() const { return m_container; }
+            Container &container() { throw NotImplementedError(); }
+            Container const &const_container() const { return m_container; }
 
             // TODO merge these operators with those in NdArrayImpl
             template <typename T2>
@@ -247,11 +244,21 @@ namespace numeric
     };
     /// }}}2
     // CRTP class NdArrayImpl {{{2
+    /*! \brief Common implementation of NdArray and its views.
+     *
+     *  The storage is reached through `Derived::container()` and
+     *  `Derived::const_container()`, resolved at compile time, so that
+     *  element access and iteration inline down to the container. For
+     *  code that needs a run-time interface there is NdArrayRef.
+     */
     template <typename Derived>
-    class NdArrayImpl: public array_traits<Derived>::base_type
+    class NdArrayImpl
     {
         using traits = array_traits<Derived>;
 
+        Derived &derived() { return static_cast<Derived &>(*this); }
+        Derived const &derived() const { return static_cast<Derived const &>(*this); }
+
         public:
             static constexpr unsigned D = traits::dimension;
             using slice_type = Slice<D>;
@@ -291,7 +298,7 @@ namespace numeric
             view(Slice<Reduced> const &slice)
             {
                 return NdArrayView<value_type, Reduced, container_type>(
-                        slice, this->container());
+                        slice, derived().container());
             }
 
             template <unsigned Reduced>
@@ -299,7 +306,7 @@ namespace numeric
             view(Slice<Reduced> const &slice) const
             {
                 return ConstNdArrayView<value_type, Reduced, container_type>(
-                        slice, this->const_container());
+                        slice, derived().const_container());
             }
 
             template <unsigned M>
@@ -322,7 +329,7 @@ namespace numeric
 
                 PointerRange<std::array<value_type, M>> reduced_range(
                     reinterpret_cast<std::array<value_type, M> *>(
-                        this->container().data()),
+                        derived().container().data()),
                     reduced_slice.size);
 
                 return NdArray<std::array<value_type, M>, D-1,
@@ -349,17 +356,58 @@ namespace numeric
 
                 ConstPointerRange<std::array<value_type, M>> reduced_range(
                     reinterpret_cast<std::array<value_type, M> const *>(
-                        this->const_container().data()),
+                        derived().const_container().data()),
                     reduced_slice.size);
 
                 return NdArray<std::array<value_type, M>, D-1,
                        ConstPointerRange<std::array<value_type, M>>>(reduced_slice, reduced_range);
             }
 
+            /*! \brief Call `f(start, length, stride)` for each run of
+             *  elements along the innermost axes, see numeric::for_each_run().
+             *  `start` is a pointer if the container has contiguous storage.
+             */
+            template <typename Function>
+            void for_each_run(Function f)
+            {
+                numeric::for_each_run(
+                    m_slice, detail::run_start(derived().container(), 0), f);
+            }
+
+            template <typename Function>
+            void for_each_run(Function f) const
+            {
+                numeric::for_each_run(
+                    m_slice, detail::run_start(derived().const_container(), 0), f);
+            }
+
+            /*! \brief Walk the runs of this array and of `other`, which
+             *  should have the same shape, together: `f(start, other_start,
+             *  length, stride, other_stride)`.
+             */
+            template <typename Other, typename Function>
+            void for_each_run(Other const &other, Function f)
+            {
+                numeric::for_each_run(
+                    m_slice, detail::run_start(derived().container(), 0),
+                    other.slice(), detail::run_start(other.const_container(), 0), f);
+            }
+
+            template <typename Other, typename Function>
+            void for_each_run(Other const &other, Function f) const
+            {
+                numeric::for_each_run(
+                    m_slice, detail::run_start(derived().const_container(), 0),
+                    other.slice(), detail::run_start(other.const_container(), 0), f);
+            }
+
             template <typename Function>
             void for_each(Function f)
             {
-                std::for_each(begin(), end(), f);
+                for_each_run([&f] (auto p, size_t length, ptrdiff_t stride)
+                {
+                    for_each_in_run(p, length, stride, f);
+                });
             }
 
             value_type sum(value_type start = 0) const;
@@ -376,6 +424,9 @@ namespace numeric
             View transpose();
             ConstView transpose() const;
 
+            View permute(std::array<unsigned, D> const &axes);
+            ConstView permute(std::array<unsigned, D> const &axes) const;
+
             template <unsigned axis>
             View sub(size_t begin, size_t end, size_t step = 1);
             template <unsigned axis>
@@ -386,7 +437,7 @@ namespace numeric
                 Slice<D> sub_slice(slice());
                 sub_slice.offset = slice().flat_index(sbegin);
                 sub_slice.shape = sshape;
-                return View(sub_slice, this->container());
+                return View(sub_slice, derived().container());
             }
 
             typename array_traits<Derived>::reduced_view sel(unsigned axis, size_t idx);
@@ -422,22 +473,22 @@ namespace numeric
 
             typename array_traits<Derived>::reference operator[](size_t i)
             {
-                return this->container()[i];
+                return derived().container()[i];
             }
 
             typename array_traits<Derived>::const_reference operator[](size_t i) const
             {
-                return this->const_container()[i];
+                return derived().const_container()[i];
             }
 
             typename array_traits<Derived>::reference operator[](shape_t<D> const &i)
             {
-                return this->container()[affine(offset(), stride(), i)];
+                return derived().container()[affine(offset(), stride(), i)];
             }
 
             typename array_traits<Derived>::const_reference operator[](shape_t<D> const &i) const
             {
-                return this->const_container()[affine(offset(), stride(), i)];
+                return derived().const_container()[affine(offset(), stride(), i)];
             }
     };
     // }}}2
@@ -478,14 +529,14 @@ namespace numeric
             NdArray(shape_t<D> const &shape, std::initializer_list<T> const &init)
                 : NdArray(shape)
             {
-                std::copy(init.begin(), init.end(), this->begin());
+                std::copy(init.begin(), init.end(), m_container.begin());
             }
 
             template <typename U>
             explicit NdArray(NdArray<U,D> const &other):
                 NdArray(other.shape())
             {
-                std::copy(other.begin(), other.end(), this->begin());
+                Base::operator=(other);
             }
 
             void resize(shape_t<D> shape)
@@ -494,8 +545,8 @@ namespace numeric
                 m_container.resize(this->m_slice.size);
             }
 
-            virtual Container &container() { return m_container; }
-            virtual Container const &const_container() const { return m_container; }
+            Container &container() { return m_container; }
+            Container const &const_container() const { return m_container; }
 
             NdArray &operator=(NdArray const &other)
                 { return Base::operator=(other); }
@@ -520,8 +571,8 @@ namespace numeric
                 m_container(data)
             {}
 
-            virtual Container &container() { return m_container; }
-            virtual Container const &const_container() const { return m_container; }
+            Container &container() { return m_container; }
+            Container const &const_container() const { return m_container; }
 
             // using Base::operator=;
             NdArrayView &operator=(NdArrayView const &other) { return Base::operator=(other); }
@@ -556,17 +607,62 @@ namespace numeric
                 m_container(data)
             {}
 
-            virtual Container const &const_container() const { return m_container; }
+            Container const &const_container() const { return m_container; }
 
             ConstNdArrayView &operator=(ConstNdArrayView const &other) = delete;
 
-
         private:
-            virtual Container &container() { throw NotImplementedError(); }
+            friend Base;
+            Container &container() { throw NotImplementedError(); }
     };
     // }}}2
     // }}}1
 
+    // # Type erasure {{{1
+    /*! \brief Run-time interface to the storage and shape of an array.
+     *
+     *  The array classes do not derive from this; wrap an array in an
+     *  NdArrayRef to pass it where arrays of different types should go
+     *  through one interface. Every access then is a virtual call.
+     */
+    template <typename T, unsigned D, typename Container = std::vector<T>>
+    class NdArrayBase
+    {
+        public:
+            virtual ~NdArrayBase() {}
+
+            virtual Container &container() = 0;
+            virtual Container const &const_container() const = 0;
+
+            virtual shape_t<D> const &shape() const = 0;
+    };
+
+    /*! \brief NdArrayBase referring to an NdArray or NdArrayView, which
+     *  should outlive it.
+     */
+    template <typename Array>
+    class NdArrayRef: public NdArrayBase<
+        typename array_traits<Array>::value_type,
+        array_traits<Array>::dimension,
+        typename array_traits<Array>::container_type>
+    {
+        using traits = array_traits<Array>;
+
+        Array &m_array;
+
+        public:
+            explicit NdArrayRef(Array &array): m_array(array) {}
+
+            virtual typename traits::container_type &container()
+                { return m_array.container(); }
+            virtual typename traits::container_type const &const_container() const
+                { return m_array.const_container(); }
+
+            virtual shape_t<traits::dimension> const &shape() const
+                { return m_array.shape(); }
+    };
+    // }}}1
+
     /*! @} */
 
     // # Implementations {{{1
@@ -697,6 +793,44 @@ namespace numeric
     {
         if (shape() != other.shape())
             throw "shapes of arrays do not match.";
+
+        // a view that does not wrap onto itself is, along each axis, the
+        // part from the offset to the end followed by one from the
+        // start: at most 2^D boxes, each a strided copy
+        bool wraps_onto_itself = false;
+        for (unsigned k = 0; k < D; ++k)
+            wraps_onto_itself = wraps_onto_itself || m_shape[k] > m_slice.shape[k];
+
+        if constexpr (is_nd_array<T2>)
+            if (!wraps_onto_itself)
+            {
+                Slice<D> const &source = other.slice();
+                auto dst_start = detail::run_start(m_container, 0);
+                auto src_start = detail::run_start(other.const_container(), 0);
+
+                for (unsigned box = 0; box < (1u << D); ++box)
+                {
+                    shape_t<D> parent_begin, view_begin, box_shape;
+                    for (unsigned k = 0; k < D; ++k)
+                    {
+                        size_t head = std::min(m_shape[k], m_slice.shape[k] - m_offset[k]);
+                        bool tail = (box >> k) & 1;
+                        parent_begin[k] = (tail ? 0 : m_offset[k]);
+                        view_begin[k] = (tail ? head : 0);
+                        box_shape[k] = (tail ? m_shape[k] - head : head);
+                    }
+                    if (calc_size<D>(box_shape) == 0)
+                        continue;
+
+                    strided_copy(
+                        Slice<D>(m_slice.flat_index(parent_begin), box_shape, m_slice.stride),
+                        dst_start,
+                        Slice<D>(source.flat_index(view_begin), box_shape, source.stride),
+                        src_start);
+                }
+                return *this;
+            }
+
         std::copy(other.cbegin(), other.cend(), begin());
         return *this;
     }
@@ -746,7 +880,7 @@ namespace numeric
     typename array_traits<Derived>::iterator NdArrayImpl<Derived>::begin()
     {
         return iterator(
-            std::begin(this->container()) + offset(), shape(), stride());
+            std::begin(derived().container()) + offset(), shape(), stride());
     }
     template <typename Derived>
     typename array_traits<Derived>::iterator NdArrayImpl<Derived>::end()
@@ -757,7 +891,7 @@ namespace numeric
     NdArrayImpl<Derived>::cbegin() const
     {
         return const_iterator(
-            std::cbegin(this->const_container()) + offset(), shape(), stride());
+            std::cbegin(derived().const_container()) + offset(), shape(), stride());
     }
     template <typename Derived>
     typename array_traits<Derived>::const_iterator
@@ -774,43 +908,74 @@ namespace numeric
     template <typename Derived>
     template <unsigned axis>
     typename NdArrayImpl<Derived>::View NdArrayImpl<Derived>::reverse()
-        { return View(m_slice.template reverse<axis>(), this->container()); }
+        { return View(m_slice.template reverse<axis>(), derived().container()); }
     template <typename Derived>
     template <unsigned axis>
     typename NdArrayImpl<Derived>::ConstView NdArrayImpl<Derived>::reverse() const
-        { return View(m_slice.template reverse<axis>(), this->const_container()); }
+        { return View(m_slice.template reverse<axis>(), derived().const_container()); }
 
     template <typename Derived>
     typename NdArrayImpl<Derived>::View NdArrayImpl<Derived>::reverse_all()
-        { return View(m_slice.reverse_all(), this->container()); }
+        { return View(m_slice.reverse_all(), derived().container()); }
     template <typename Derived>
     typename NdArrayImpl<Derived>::ConstView NdArrayImpl<Derived>::reverse_all() const
-        { return ConstView(m_slice.reverse_all(), this->const_container()); }
+        { return ConstView(m_slice.reverse_all(), derived().const_container()); }
 
     template <typename Derived>
     typename NdArrayImpl<Derived>::View NdArrayImpl<Derived>::transpose()
-        { return View(m_slice.transpose(), this->container()); }
+        { return View(m_slice.transpose(), derived().container()); }
     template <typename Derived>
     typename NdArrayImpl<Derived>::ConstView NdArrayImpl<Derived>::transpose() const
-        { return ConstView(m_slice.transpose(), this->const_container()); }
+        { return ConstView(m_slice.transpose(), derived().const_container()); }
+
+    namespace detail
+    {
+        template <unsigned D>
+        void check_permutation(std::array<unsigned, D> const &axes)
+        {
+            std::array<bool, D> seen;
+            seen.fill(false);
+            for (unsigned k : axes)
+            {
+                if (k >= D || seen[k])
+                    throw Exception("Axes should be a permutation of 0 .. D-1.");
+                seen[k] = true;
+            }
+        }
+    }
+
+    template <typename Derived>
+    typename NdArrayImpl<Derived>::View
+    NdArrayImpl<Derived>::permute(std::array<unsigned, D> const &axes)
+    {
+        detail::check_permutation<D>(axes);
+        return View(m_slice.permute(axes), derived().container());
+    }
+    template <typename Derived>
+    typename NdArrayImpl<Derived>::ConstView
+    NdArrayImpl<Derived>::permute(std::array<unsigned, D> const &axes) const
+    {
+        detail::check_permutation<D>(axes);
+        return ConstView(m_slice.permute(axes), derived().const_container());
+    }
 
     template <typename Derived>
     template <unsigned axis>
     typename NdArrayImpl<Derived>::View
     NdArrayImpl<Derived>::sub(size_t begin, size_t end, size_t step)
-        { return View(m_slice.template sub<axis>(begin, end, step), this->container()); }
+        { return View(m_slice.template sub<axis>(begin, end, step), derived().container()); }
     template <typename Derived>
     template <unsigned axis>
     typename NdArrayImpl<Derived>::ConstView
     NdArrayImpl<Derived>::sub(size_t begin, size_t end, size_t step) const
-        { return ConstView(m_slice.template sub<axis>(begin, end, step), this->const_container()); }
+        { return ConstView(m_slice.template sub<axis>(begin, end, step), derived().const_container()); }
 
     template <typename Derived>
     typename array_traits<Derived>::reduced_view
     NdArrayImpl<Derived>::sel(unsigned axis, size_t idx)
     {
         using return_type = typename array_traits<Derived>::reduced_view;
-        return return_type(m_slice.sel(axis, idx), this->container());
+        return return_type(m_slice.sel(axis, idx), derived().container());
     }
 
     template <typename Derived>
@@ -818,7 +983,7 @@ namespace numeric
     NdArrayImpl<Derived>::sel(unsigned axis, size_t idx) const
     {
         using return_type = typename array_traits<Derived>::const_reduced_view;
-        return return_type(m_slice.sel(axis, idx), this->const_container());
+        return return_type(m_slice.sel(axis, idx), derived().const_container());
     }
 
     template <typename Derived>
@@ -826,13 +991,13 @@ namespace numeric
     typename array_traits<Derived>::reduced_view
     NdArrayImpl<Derived>::sel(size_t idx)
         { return NdArrayView<value_type, D-1, container_type>(
-                m_slice.template sel<axis>(idx), this->container()); }
+                m_slice.template sel<axis>(idx), derived().container()); }
     template <typename Derived>
     template <unsigned axis>
     typename array_traits<Derived>::const_reduced_view
     NdArrayImpl<Derived>::sel(size_t idx) const
         { return ConstNdArrayView<value_type, D-1, container_type>(
-                m_slice.template sel<axis>(idx), this->const_container()); }
+                m_slice.template sel<axis>(idx), derived().const_container()); }
 
     template <typename Derived>
     typename array_traits<Derived>::periodic_view
@@ -841,7 +1006,7 @@ namespace numeric
             typename NdArrayImpl<Derived>::shape_type const &shape)
     {
         return PeriodicNdArrayView<value_type, D, container_type>(
-            this->container(), slice(), offset, shape);
+            derived().container(), slice(), offset, shape);
     }
     template <typename Derived>
     typename array_traits<Derived>::const_periodic_view
@@ -850,7 +1015,7 @@ namespace numeric
             typename NdArrayImpl<Derived>::shape_type const &shape) const
     {
         return ConstPeriodicNdArrayView<value_type, D, container_type>(
-            this->const_container(), slice(), offset, shape);
+            derived().const_container(), slice(), offset, shape);
     }
     // }}}3
     // operators {{{3
@@ -858,7 +1023,16 @@ namespace numeric
     typename array_traits<Derived>::value_type NdArrayImpl<Derived>::sum(
             typename array_traits<Derived>::value_type start) const
     {
-        return std::accumulate(begin(), end(), start);
+        for_each_run([&start] (auto p, size_t length, ptrdiff_t stride)
+        {
+            value_type acc = start;
+            for_each_in_run(p, length, stride, [&acc] (value_type x)
+            {
+                acc = acc + x;
+            });
+            start = acc;
+        });
+        return start;
     }
 
     template <typename Derived>
@@ -866,11 +1040,17 @@ namespace numeric
     {
         value_type acc = 0, acc_sqr = 0;
 
-        std::for_each(begin(), end(),
-            [&acc, &acc_sqr] (auto x)
+        // accumulators are local to each run, so they stay in registers
+        for_each_run([&acc, &acc_sqr] (auto p, size_t length, ptrdiff_t stride)
         {
-            acc += x;
-            acc_sqr += x*x;
+            value_type a = acc, a_sqr = acc_sqr;
+            for_each_in_run(p, length, stride, [&a, &a_sqr] (value_type x)
+            {
+                a += x;
+                a_sqr += x*x;
+            });
+            acc = a;
+            acc_sqr = a_sqr;
         });
 
         acc /= size();
@@ -883,7 +1063,7 @@ namespace numeric
     NdArrayImpl<Derived>::copy() const
     {
         NdArray<value_type, D, std::vector<value_type>> result(shape());
-        std::copy(cbegin(), cend(), result.begin());
+        result = static_cast<Derived const &>(*this);
         return result;
     }
 
@@ -891,36 +1071,45 @@ namespace numeric
     Derived &NdArrayImpl<Derived>::operator+=(
             typename array_traits<Derived>::value_type value)
     {
-        for (auto i = begin(); i != end(); ++i)
-            *i += value;
-        return static_cast<Derived &>(*this);
+        for_each([value] (auto &&x) { x += value; });
+        return derived();
     }
 
     template <typename Derived>
     template <typename T>
     Derived &NdArrayImpl<Derived>::operator*=(T const &other)
     {
-        std::transform(begin(), end(), other.cbegin(), begin(),
-            [] (auto a, auto b) { return a * b; });
-        return static_cast<Derived &>(*this);
+        if constexpr (is_nd_array<T>)
+        {
+            for_each_run(other, [] (auto a, auto b, size_t length,
+                                    ptrdiff_t stride_a, ptrdiff_t stride_b)
+            {
+                for_each_in_run(a, b, length, stride_a, stride_b,
+                    [] (auto &&x, auto const &y) { x = x * y; });
+            });
+        }
+        else
+        {
+            std::transform(begin(), end(), other.cbegin(), begin(),
+                [] (auto a, auto b) { return a * b; });
+        }
+        return derived();
     }
 
     template <typename Derived>
     Derived &NdArrayImpl<Derived>::operator*=(
             typename array_traits<Derived>::value_type value)
     {
-        std::transform(begin(), end(), begin(),
-            [value] (auto a) { return a * value; });
-        return static_cast<Derived &>(*this);
+        for_each([value] (auto &&x) { x = x * value; });
+        return derived();
     }
 
     template <typename Derived>
     Derived &NdArrayImpl<Derived>::operator/=(
             typename array_traits<Derived>::value_type value)
     {
-        std::transform(begin(), end(), begin(),
-            [value] (auto a) { return a / value; });
-        return static_cast<Derived &>(*this);
+        for_each([value] (auto &&x) { x = x / value; });
+        return derived();
     }
 
     template <typename Derived>
@@ -929,32 +1118,72 @@ namespace numeric
     {
         if (shape() != other.shape())
             throw "shapes of arrays do not match.";
-        std::copy(other.cbegin(), other.cend(), begin());
-        return static_cast<Derived &>(*this);
+
+        if constexpr (is_nd_array<T>)
+        {
+            strided_copy(
+                m_slice, detail::run_start(derived().container(), 0),
+                other.slice(), detail::run_start(other.const_container(), 0));
+        }
+        else if constexpr (is_expression<T>)
+        {
+            assign_expression(derived(), other);
+        }
+        else
+        {
+            std::copy(other.cbegin(), other.cend(), begin());
+        }
+        return derived();
     }
 
     template <typename Derived>
     Derived &NdArrayImpl<Derived>::operator=(
             typename array_traits<Derived>::value_type value)
     {
-        std::fill(begin(), end(), value);
-        return static_cast<Derived &>(*this);
+        for_each_run([value] (auto p, size_t length, ptrdiff_t stride)
+        {
+            if (stride == 1)
+                std::fill(p, p + length, value);
+            else
+                for_each_in_run(p, length, stride, [value] (auto &&x) { x = value; });
+        });
+        return derived();
     }
 
     template <typename Derived>
     template <typename T>
     bool NdArrayImpl<Derived>::operator==(T const &other) const
     {
-        return (shape() == other.shape())
-            && std::equal(begin(), end(), other.begin());
+        if (shape() != other.shape())
+            return false;
+
+        if constexpr (is_nd_array<T>)
+        {
+            bool equal = true;
+            for_each_run(other, [&equal] (auto a, auto b, size_t length,
+                                          ptrdiff_t stride_a, ptrdiff_t stride_b)
+            {
+                if (!equal)
+                    return;
+                if (stride_a == 1 && stride_b == 1)
+                    equal = std::equal(a, a + length, b);
+                else
+                    for (size_t i = 0; i < length && equal; ++i)
+                        equal = (a[ptrdiff_t(i) * stride_a] == b[ptrdiff_t(i) * stride_b]);
+            });
+            return equal;
+        }
+        else
+        {
+            return std::equal(begin(), end(), other.begin());
+        }
     }
 
     template <typename Derived>
     template <typename T>
     bool NdArrayImpl<Derived>::operator!=(T const &other) const
     {
-        return (shape() != other.shape())
-            || !std::equal(begin(), end(), other.begin());
+        return !(*this == other);
     }
     // }}}3
     // }}}2 }}}1
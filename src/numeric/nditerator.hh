@@ -189,6 +189,144 @@ namespace numeric
     template <typename LinearIterator, unsigned D>
     using NdIterator = NdIteratorImpl<LinearIterator, D, typename std::iterator_traits<LinearIterator>::value_type>;
 
+    /*! \brief Call `f(start + i, length, stride)` for each run of elements
+     *  of `slice`, in the order of NdIterator.
+     *
+     *  A run covers the innermost axis, and the next ones as long as they
+     *  continue it with the same stride, so a contiguous slice is a single
+     *  run. The index carry is done once per run instead of once per
+     *  element.
+     */
+    template <unsigned D, typename LinearIterator, typename Function>
+    void for_each_run(Slice<D> const &slice, LinearIterator start, Function f)
+    {
+        if (slice.size == 0)
+            return;
+
+        size_t length = slice.shape[0];
+        ptrdiff_t stride = slice.stride[0];
+        unsigned axis = 1;
+        for (; axis < D; ++axis)
+        {
+            if (length == 1)
+                stride = slice.stride[axis];
+            else if (slice.stride[axis] != stride * ptrdiff_t(length))
+                break;
+            length *= slice.shape[axis];
+        }
+
+        shape_t<D> index;
+        index.fill(0);
+        ptrdiff_t address = slice.offset;
+        for (size_t run = 0, n_runs = slice.size / length; run < n_runs; ++run)
+        {
+            f(start + address, length, stride);
+            for (unsigned k = axis; k < D; ++k)
+            {
+                address += slice.stride[k];
+                if (++index[k] < slice.shape[k])
+                    break;
+                address -= slice.stride[k] * ptrdiff_t(slice.shape[k]);
+                index[k] = 0;
+            }
+        }
+    }
+
+    /*! \brief Call `f(start_a + i, start_b + j, length, stride_a, stride_b)`
+     *  for the runs of two slices of the same shape, walked together; runs
+     *  span several axes only where they do in both slices.
+     */
+    template <unsigned D, typename IteratorA, typename IteratorB, typename Function>
+    void for_each_run(Slice<D> const &slice_a, IteratorA start_a,
+                      Slice<D> const &slice_b, IteratorB start_b,
+                      Function f)
+    {
+        if (slice_a.size == 0)
+            return;
+
+        size_t length = slice_a.shape[0];
+        ptrdiff_t stride_a = slice_a.stride[0], stride_b = slice_b.stride[0];
+        unsigned axis = 1;
+        for (; axis < D; ++axis)
+        {
+            if (length == 1)
+            {
+                stride_a = slice_a.stride[axis];
+                stride_b = slice_b.stride[axis];
+            }
+            else if (slice_a.stride[axis] != stride_a * ptrdiff_t(length)
+                  || slice_b.stride[axis] != stride_b * ptrdiff_t(length))
+                break;
+            length *= slice_a.shape[axis];
+        }
+
+        shape_t<D> index;
+        index.fill(0);
+        ptrdiff_t address_a = slice_a.offset, address_b = slice_b.offset;
+        for (size_t run = 0, n_runs = slice_a.size / length; run < n_runs; ++run)
+        {
+            f(start_a + address_a, start_b + address_b, length, stride_a, stride_b);
+            for (unsigned k = axis; k < D; ++k)
+            {
+                address_a += slice_a.stride[k];
+                address_b += slice_b.stride[k];
+                if (++index[k] < slice_a.shape[k])
+                    break;
+                address_a -= slice_a.stride[k] * ptrdiff_t(slice_a.shape[k]);
+                address_b -= slice_b.stride[k] * ptrdiff_t(slice_b.shape[k]);
+                index[k] = 0;
+            }
+        }
+    }
+
+    /*! \brief Call `f` on each element of a run. Unit strides have a loop
+     *  of their own, which the compiler can vectorise.
+     */
+    template <typename Iterator, typename Function>
+    inline void for_each_in_run(
+            Iterator p, size_t length, ptrdiff_t stride, Function f)
+    {
+        if (stride == 1)
+            for (size_t i = 0; i < length; ++i)
+                f(p[i]);
+        else
+            for (size_t i = 0; i < length; ++i)
+                f(p[ptrdiff_t(i) * stride]);
+    }
+
+    /*! \brief Call `f` on each pair of elements of two runs.
+     */
+    template <typename IteratorA, typename IteratorB, typename Function>
+    inline void for_each_in_run(
+            IteratorA a, IteratorB b, size_t length,
+            ptrdiff_t stride_a, ptrdiff_t stride_b, Function f)
+    {
+        if (stride_a == 1 && stride_b == 1)
+            for (size_t i = 0; i < length; ++i)
+                f(a[i], b[i]);
+        else
+            for (size_t i = 0; i < length; ++i)
+                f(a[ptrdiff_t(i) * stride_a], b[ptrdiff_t(i) * stride_b]);
+    }
+
+    namespace detail
+    {
+        /*! \brief Start of the runs of a container: a pointer where it has
+         *  contiguous storage, an iterator otherwise (`std::vector<bool>`).
+         */
+        template <typename Container>
+        auto run_start(Container &c, int) -> decltype(c.data())
+        {
+            return c.data();
+        }
+
+        template <typename Container>
+        auto run_start(Container &c, long)
+        {
+            return std::begin(c);
+        }
+    }
+
     /*! @} */
 }} // namespace numeric
 
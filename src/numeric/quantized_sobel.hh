@@ -0,0 +1,489 @@
+/* Copyright 2017 Netherlands eScience Center
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#pragma once
+
+/*! \file numeric/quantized_sobel.hh
+ *  \brief Sobel output reduced to what rounded thinning and the double
+ *  threshold use.
+ *
+ *  Rounded thinning only looks at the unit gradient rounded to one of
+ *  the 3^D - 1 lattice neighbours, and the double threshold only at the
+ *  inverse magnitude. `QuantizedSobel` keeps just those: a byte with the
+ *  rounded direction and the inverse magnitude, as `float` or as one of
+ *  the sixteen bit types of numeric/half.hh. For D = 4 that is 5 or 3
+ *  bytes per pixel instead of 20 or 10.
+ *
+ *  `smooth_sobel_quantized()` computes the components one at a time into
+ *  a single plane, with one scratch array for the smoothing passes they
+ *  share: a first sweep sums their squares, a second sweep rounds each
+ *  normalised component as soon as it is done. That costs twice the
+ *  filtering, but no array of all components is ever held. With the
+ *  direct method the peak is the output, two arrays of the magnitude
+ *  type, and for the sixteen bit types one `float` array for the sums of
+ *  squares: 13 bytes per pixel for `float` and 11 for `half`, where
+ *  smooth_sobel() needs 28 and 14 for D = 4. The recursive method keeps
+ *  the smoothed input as well, one more array of the magnitude type. The
+ *  results of thinning and threshold are the same as with the full
+ *  output of smooth_sobel().
+ */
+
+#include "canny.hh"
+
+namespace HyperCanny {
+namespace numeric {
+namespace filter {
+    /*! \brief Rounded gradient direction and inverse magnitude of each
+     *  pixel.
+     *
+     *  The direction code is \f$\sum_k (d_k + 1) 3^k\f$ for the steps
+     *  \f$d_k \in \{-1, 0, 1\}\f$ along each axis, so a zero gradient
+     *  has code \f$(3^D - 1) / 2\f$.
+     */
+    template <typename T, unsigned D>
+    struct QuantizedSobel
+    {
+        static_assert(D <= 5, "Direction codes of more than five axes do not fit in a byte.");
+        static constexpr unsigned dimension = D;
+
+        NdArray<uint8_t, D> direction;
+        NdArray<T, D> magnitude;
+
+        QuantizedSobel() {}
+
+        explicit QuantizedSobel(shape_t<D> const &shape)
+            : direction(shape)
+            , magnitude(shape)
+        {}
+
+        shape_t<D> const &shape() const { return magnitude.shape(); }
+    };
+
+    /*! \brief Gaussian smoothing and Sobel operator, with quantized output.
+     *
+     *  Gives the rounded directions and the inverse magnitudes of
+     *  smooth_sobel(), see there for the parameters. Besides the output,
+     *  two scratch arrays of the shape of the input are allocated, of the
+     *  magnitude type, three with the recursive method, and one in
+     *  `float` if the magnitude type has sixteen bits.
+     */
+    template <typename Input, typename T, unsigned D>
+    void smooth_sobel_quantized(
+            Input const &input, unsigned n, double sigma,
+            QuantizedSobel<T, D> &output,
+            GaussianMethod method = GaussianMethod::direct,
+            boundary_t<array_traits<Input>::dimension> const &boundary =
+                uniform_boundary<array_traits<Input>::dimension>())
+    {
+        static_assert(array_traits<Input>::dimension == D,
+                      "Input should have the dimension of the output.");
+        using real_t = compute_t<T>;
+        using input_real_t = compute_t<typename array_traits<Input>::value_type>;
+        using buffer_type = NdArray<T, D>;
+
+        shape_t<D> const shape = input.shape();
+        if (output.shape() != shape)
+            throw Exception("Shapes of input and output do not match.");
+
+        size_t const size = calc_size<D>(shape);
+        bool const recursive = (method == GaussianMethod::recursive);
+        buffer_type buffer(shape), plane(shape),
+                    smoothed(recursive ? shape : shape_t<D>{});
+
+        // squared length, then inverse magnitude, in compute precision;
+        // in the output itself if it has that precision
+        constexpr bool in_place = std::is_same<T, real_t>::value;
+        std::vector<real_t> scratch(in_place ? 0 : size);
+        real_t *inverse;
+        if constexpr (in_place)
+            inverse = output.magnitude.container().data();
+        else
+            inverse = scratch.data();
+        uint8_t *code = output.direction.container().data();
+
+        // the same passes in the same order as smooth_sobel(), so that
+        // the components agree to the last bit
+        auto sweep = [&] (auto done)
+        {
+            if (recursive)
+            {
+                sobel_each_component(
+                    smoothed,
+                    NdArray<input_real_t, 1>({3}, {0.25, 0.50, 0.25}),
+                    NdArray<input_real_t, 1>({3}, {0.5, 0.0, -0.5}),
+                    plane, buffer, boundary, done);
+            }
+            else
+            {
+                auto G = gaussian_kernel<input_real_t>(n, sigma);
+                auto smooth_kernel = convolve_padding_zero(
+                        NdArray<input_real_t, 1>({3}, {0.25, 0.50, 0.25}), G);
+                auto gradient_kernel = convolve_padding_zero(
+                        NdArray<input_real_t, 1>({3}, {0.5, 0.0, -0.5}), G);
+                sobel_each_component(
+                    input, smooth_kernel, gradient_kernel, plane,
+                    buffer, boundary, done);
+            }
+        };
+
+        // the recursive Gaussian is done once, for both sweeps
+        if (recursive)
+            gaussian(input, n, sigma, smoothed, method, boundary);
+
+        T const *g = plane.const_container().data();
+        sweep([&] (unsigned k, auto const &)
+        {
+            #pragma omp parallel
+            {
+                #pragma omp for nowait
+                for (size_t i = 0; i < size; ++i)
+                {
+                    real_t c = g[i];
+                    inverse[i] = (k == 0 ? c*c : inverse[i] + c*c);
+                }
+            }
+        });
+
+        #pragma omp parallel
+        {
+            #pragma omp for nowait
+            for (size_t i = 0; i < size; ++i)
+            {
+                real_t l2 = inverse[i];
+                inverse[i] = (l2 == 0.0 ? std::numeric_limits<real_t>::infinity()
+                                        : real_t(1. / sqrt(l2)));
+            }
+        }
+
+        // rounds the normalised component as stored by
+        // normalize_homogeneous_vectors(), like rounded thinning does
+        sweep([&] (unsigned k, auto const &)
+        {
+            unsigned power = 1;
+            for (unsigned j = 0; j < k; ++j)
+                power *= 3;
+
+            #pragma omp parallel
+            {
+                #pragma omp for nowait
+                for (size_t i = 0; i < size; ++i)
+                {
+                    real_t x = std::isinf(inverse[i]) ? real_t(0)
+                             : real_t(T(real_t(g[i]) * inverse[i]));
+                    unsigned d = 1 + unsigned(x >= real_t(0.5)) - unsigned(x <= real_t(-0.5));
+                    code[i] = uint8_t((k == 0 ? 0 : code[i]) + d * power);
+                }
+            }
+        });
+
+        if constexpr (!in_place)
+        {
+            T *m = output.magnitude.container().data();
+            #pragma omp parallel
+            {
+                #pragma omp for nowait
+                for (size_t i = 0; i < size; ++i)
+                    m[i] = T(inverse[i]);
+            }
+        }
+    }
+
+    /*! \brief Gaussian smoothing and Sobel operator, with quantized output.
+     *
+     *  As above, returning a new QuantizedSobel with magnitudes of type
+     *  `T`, by default the value type of the input.
+     */
+    template <typename T = void, typename Input>
+    auto smooth_sobel_quantized(
+            Input const &input, unsigned n, double sigma,
+            GaussianMethod method = GaussianMethod::direct,
+            boundary_t<array_traits<Input>::dimension> const &boundary =
+                uniform_boundary<array_traits<Input>::dimension>())
+    {
+        constexpr unsigned D = array_traits<Input>::dimension;
+        using value_type = std::conditional_t<std::is_void<T>::value,
+            typename array_traits<Input>::value_type, T>;
+
+        QuantizedSobel<value_type, D> output(input.shape());
+        smooth_sobel_quantized(input, n, sigma, output, method, boundary);
+        return output;
+    }
+
+    namespace detail
+    {
+        /*! \brief Rounded non-maximum suppression of a QuantizedSobel, in
+         *  blocks as `edge_thinning` does for the full output; pixels with
+         *  a value above `cutoff` are never edges.
+         */
+        template <typename T, unsigned D, typename Block>
+        void thin_quantized(
+                QuantizedSobel<T, D> const &input, uint8_t *bytes,
+                boundary_t<QuantizedSobel<T, D>::dimension> const &boundary,
+                double cutoff, Block block)
+        {
+            using real_t = compute_t<T>;
+
+            shape_t<D> const &shape = input.shape();
+            Slice<D> const grid(shape);
+            if (grid.size == 0)
+                return;
+
+            uint8_t const *code = input.direction.const_container().data();
+            T const *m = input.magnitude.const_container().data();
+
+            // memory offset for each direction code, and its steps
+            size_t table_size = 1;
+            for (unsigned k = 0; k < D; ++k)
+                table_size *= 3;
+            std::vector<ptrdiff_t> offsets(table_size);
+            std::vector<std::array<int, D>> steps(table_size);
+            for (size_t j = 0; j < table_size; ++j)
+            {
+                ptrdiff_t offset = 0;
+                size_t q = j;
+                for (unsigned k = 0; k < D; ++k, q /= 3)
+                {
+                    steps[j][k] = int(q % 3) - 1;
+                    offset += steps[j][k] * grid.stride[k];
+                }
+                offsets[j] = offset;
+            }
+
+            constexpr real_t infinity = std::numeric_limits<real_t>::infinity();
+            constexpr ptrdiff_t outside = std::numeric_limits<ptrdiff_t>::min();
+            using near_t = std::array<std::array<ptrdiff_t, 3>, D>;
+            auto near_axis = [&] (near_t &near, unsigned k, size_t i)
+            {
+                for (int s = -1; s <= 1; ++s)
+                {
+                    ptrdiff_t q = boundary_index(boundary[k], ptrdiff_t(i) + s, shape[k]);
+                    near[k][s + 1] = (q < 0 ? outside : q * grid.stride[k]);
+                }
+            };
+
+            size_t const n = shape[0];
+
+            // pixels [i0, i1) of a line, written to o[0 .. i1 - i0)
+            auto thin_line = [&] (size_t line, size_t i0, size_t i1, uint8_t *o)
+            {
+                shape_t<D> index = grid.index(line * n);
+                bool inside = (n > 2);
+                for (unsigned k = 1; k < D; ++k)
+                    inside = inside && index[k] >= 1 && index[k] + 1 < shape[k];
+
+                size_t begin = std::max(i0, std::min(i1, size_t(inside ? 1 : n)));
+                size_t end = std::max(begin, std::min(i1, inside ? n - 1 : n));
+                size_t const first = line * n;
+
+                near_t near;
+                for (unsigned k = 1; k < D; ++k)
+                    near_axis(near, k, index[k]);
+
+                auto neighbour = [&] (std::array<int, D> const &d, int sign)
+                {
+                    ptrdiff_t flat = 0;
+                    for (unsigned k = 0; k < D; ++k)
+                    {
+                        ptrdiff_t q = near[k][sign * d[k] + 1];
+                        if (q == outside)
+                            return infinity;
+                        flat += q;
+                    }
+                    return real_t(m[flat]);
+                };
+
+                auto border = [&] (size_t i)
+                {
+                    real_t value = m[first + i];
+                    if (!(value <= cutoff) || !std::isfinite(value))
+                    {
+                        o[i - i0] = 0;
+                        return;
+                    }
+                    near_axis(near, 0, i);
+                    auto const &d = steps[code[first + i]];
+                    o[i - i0] = (value <= neighbour(d, -1)) && (value <= neighbour(d, 1));
+                };
+
+                for (size_t i = i0; i < begin; ++i)
+                    border(i);
+
+                T const *v = m + first;
+                for (size_t i = begin; i < end; ++i)
+                {
+                    real_t value = v[i];
+                    if (!(value <= cutoff) || !std::isfinite(value))
+                    {
+                        o[i - i0] = 0;
+                        continue;
+                    }
+                    ptrdiff_t offset = offsets[code[first + i]];
+                    o[i - i0] = (value <= real_t(v[ptrdiff_t(i) - offset]))
+                             && (value <= real_t(v[ptrdiff_t(i) + offset]));
+                }
+
+                for (size_t i = end; i < i1; ++i)
+                    border(i);
+            };
+
+            size_t const n_blocks = (grid.size + thinning_block - 1) / thinning_block;
+
+            #pragma omp parallel
+            {
+                std::vector<uint8_t> buffer(bytes ? 0 : thinning_block);
+
+                #pragma omp for nowait
+                for (size_t b = 0; b < n_blocks; ++b)
+                {
+                    size_t first = b * thinning_block;
+                    size_t last = std::min(grid.size, first + thinning_block);
+                    uint8_t *o = (bytes ? bytes + first : buffer.data());
+                    for (size_t line = first / n; line * n < last; ++line)
+                    {
+                        size_t i0 = std::max(first, line * n) - line * n;
+                        size_t i1 = std::min(last, line * n + n) - line * n;
+                        thin_line(line, i0, i1, o + (line * n + i0 - first));
+                    }
+                    block(first, last, o);
+                }
+            }
+        }
+    }
+
+    /*! \brief Rounded edge thinning of a QuantizedSobel; the same as
+     *  edge_thinning() with `ThinningMethod::rounded` on the full output.
+     */
+    template <typename T, unsigned D, typename Word, typename Container>
+    void edge_thinning(
+            QuantizedSobel<T, D> const &input,
+            EdgeMask<D, Word, Container> &output,
+            boundary_t<QuantizedSobel<T, D>::dimension> const &boundary =
+                uniform_boundary<QuantizedSobel<T, D>::dimension>())
+    {
+        using mask_type = EdgeMask<D, Word, Container>;
+
+        if (output.shape() != input.shape())
+            throw Exception("Shapes of input and mask do not match.");
+
+        detail::thin_quantized(
+            input, (mask_type::packed ? nullptr : output.bytes()), boundary,
+            std::numeric_limits<double>::infinity(),
+            [&] (size_t first, size_t last, uint8_t const *o)
+        {
+            if (mask_type::packed)
+                output.assign(first, o, last - first);
+        });
+    }
+
+    template <typename T, unsigned D>
+    EdgeMask<D> edge_thinning(
+            QuantizedSobel<T, D> const &input,
+            boundary_t<QuantizedSobel<T, D>::dimension> const &boundary =
+                uniform_boundary<QuantizedSobel<T, D>::dimension>())
+    {
+        EdgeMask<D> output(input.shape());
+        edge_thinning(input, output, boundary);
+        return output;
+    }
+
+    /*! \brief Double threshold on the magnitudes of a QuantizedSobel, the
+     *  same as double_threshold() on the full output for `lower` not above
+     *  `upper`.
+     */
+    template <typename T, unsigned D, typename Mask, typename Word, typename Container>
+    void double_threshold(
+            QuantizedSobel<T, D> const &input, Mask const &mask,
+            double lower, double upper,
+            EdgeMask<D, Word, Container> &output,
+            boundary_t<QuantizedSobel<T, D>::dimension> const &boundary =
+                uniform_boundary<QuantizedSobel<T, D>::dimension>())
+    {
+        if (mask.shape() != input.shape() || output.shape() != input.shape())
+            throw Exception("Shapes of input and mask do not match.");
+        if (lower > upper)
+            throw Exception("Quantized double threshold needs `lower` not above `upper`.");
+
+        size_t const size = calc_size<D>(input.shape());
+        T const *m = input.magnitude.const_container().data();
+        std::vector<uint8_t> classes(size);
+
+        #pragma omp parallel
+        {
+            #pragma omp for nowait
+            for (size_t i = 0; i < size; ++i)
+            {
+                compute_t<T> value = m[i];
+                classes[i] = uint8_t(!mask[i] ? EdgeClass::none
+                    : (value <= lower ? EdgeClass::strong
+                    : (value <= upper ? EdgeClass::weak : EdgeClass::none)));
+            }
+        }
+
+        detail::union_find_hysteresis<D>(input.shape(), boundary, classes.data(), output);
+    }
+
+    template <typename T, unsigned D, typename Mask>
+    EdgeMask<D> double_threshold(
+            QuantizedSobel<T, D> const &input, Mask const &mask,
+            double lower, double upper,
+            boundary_t<QuantizedSobel<T, D>::dimension> const &boundary =
+                uniform_boundary<QuantizedSobel<T, D>::dimension>())
+    {
+        EdgeMask<D> output(input.shape());
+        double_threshold(input, mask, lower, upper, output, boundary);
+        return output;
+    }
+
+    /*! \brief Rounded edge thinning and double threshold of a
+     *  QuantizedSobel in one sweep, as thin_and_threshold() does for the
+     *  full output.
+     */
+    template <typename T, unsigned D, typename Word, typename Container>
+    void thin_and_threshold(
+            QuantizedSobel<T, D> const &input, double lower, double upper,
+            EdgeMask<D, Word, Container> &output,
+            boundary_t<QuantizedSobel<T, D>::dimension> const &boundary =
+                uniform_boundary<QuantizedSobel<T, D>::dimension>())
+    {
+        if (output.shape() != input.shape())
+            throw Exception("Shapes of input and mask do not match.");
+        if (lower > upper)
+            throw Exception("Quantized double threshold needs `lower` not above `upper`.");
+
+        T const *m = input.magnitude.const_container().data();
+        std::vector<uint8_t> classes(calc_size<D>(input.shape()));
+        detail::thin_quantized(
+            input, classes.data(), boundary, upper,
+            [&] (size_t first, size_t last, uint8_t *o)
+        {
+            for (size_t i = first; i < last; ++i)
+                if (o[i - first])
+                    o[i - first] = uint8_t(compute_t<T>(m[i]) <= lower
+                        ? EdgeClass::strong : EdgeClass::weak);
+        });
+
+        detail::union_find_hysteresis<D>(input.shape(), boundary, classes.data(), output);
+    }
+
+    template <typename T, unsigned D>
+    EdgeMask<D> thin_and_threshold(
+            QuantizedSobel<T, D> const &input, double lower, double upper,
+            boundary_t<QuantizedSobel<T, D>::dimension> const &boundary =
+                uniform_boundary<QuantizedSobel<T, D>::dimension>())
+    {
+        EdgeMask<D> output(input.shape());
+        thin_and_threshold(input, lower, upper, output, boundary);
+        return output;
+    }
+}}} // namespace HyperCanny::numeric::filter
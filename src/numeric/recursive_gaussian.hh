@@ -0,0 +1,415 @@
+/* Copyright 2017 Netherlands eScience Center
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#pragma once
+
+/*! \file numeric/recursive_gaussian.hh
+ *  \brief Recursive (IIR) approximation of Gaussian smoothing.
+ *
+ *  Implements the third order recursive filter of Young and van Vliet,
+ *  "Recursive implementation of the Gaussian filter", Signal Processing 44
+ *  (1995), with the improved poles of van Vliet, Young and Verbeek,
+ *  "Recursive Gaussian derivative filters", ICPR (1998). The cost per
+ *  sample does not depend on the width of the Gaussian.
+ */
+
+#include "ndarray.hh"
+#include "line_convolution.hh"
+
+#include <array>
+#include <vector>
+#include <complex>
+#include <cmath>
+
+namespace HyperCanny {
+namespace numeric
+{
+    /*! \brief Recursive Gaussian filter for lines of a fixed length.
+     *
+     *  A causal and an anti-causal pass of the recursion
+     *
+     *  \f[w_n = B x_n + a_1 w_{n-1} + a_2 w_{n-2} + a_3 w_{n-3}\f]
+     *
+     *  are run over each line. Boundaries are periodic, and treated
+     *  exactly: the state at the start of a line is the steady state of the
+     *  recursion on the infinitely repeated line. This state is obtained by
+     *  a first pass starting from zero, followed by a correction with the
+     *  matrix \f$(I - A^L)^{-1}\f$, where \f$A\f$ is the companion matrix
+     *  of the recursion and \f$L\f$ the length of the line. The filter has
+     *  unit gain, so the sum of a line is preserved.
+     *
+     *  With `derivative` set, the smoothed line is differentiated with the
+     *  \f$[1/2, 0, -1/2]\f$ kernel of `filter::gradient`, giving a
+     *  Gaussian derivative filter at no extra cost.
+     */
+    template <typename real_t>
+    class RecursiveGaussian
+    {
+        using matrix_t = std::array<double, 9>;
+
+        std::array<real_t, 3> m_a;
+        real_t   m_B;
+        matrix_t m_M;
+        size_t   m_length;
+        bool     m_derivative;
+
+        static matrix_t product(matrix_t const &x, matrix_t const &y)
+        {
+            matrix_t z;
+            for (unsigned i = 0; i < 3; ++i)
+                for (unsigned j = 0; j < 3; ++j)
+                    z[i*3 + j] = x[i*3] * y[j] + x[i*3 + 1] * y[3 + j]
+                               + x[i*3 + 2] * y[6 + j];
+            return z;
+        }
+
+        static matrix_t inverse(matrix_t const &m)
+        {
+            matrix_t r;
+            r[0] =   m[4]*m[8] - m[5]*m[7];
+            r[1] = -(m[1]*m[8] - m[2]*m[7]);
+            r[2] =   m[1]*m[5] - m[2]*m[4];
+            r[3] = -(m[3]*m[8] - m[5]*m[6]);
+            r[4] =   m[0]*m[8] - m[2]*m[6];
+            r[5] = -(m[0]*m[5] - m[2]*m[3]);
+            r[6] =   m[3]*m[7] - m[4]*m[6];
+            r[7] = -(m[0]*m[7] - m[1]*m[6]);
+            r[8] =   m[0]*m[4] - m[1]*m[3];
+
+            double det = m[0]*r[0] + m[1]*r[3] + m[2]*r[6];
+            for (double &x : r)
+                x /= det;
+            return r;
+        }
+
+        /*! \brief Recursion coefficients \f$a_1, a_2, a_3\f$ for a given
+         *  width.
+         *
+         *  The poles for \f$\sigma = 2\f$ (optimised in the \f$L_2\f$
+         *  norm) are scaled as \f$d_i^{1/q}\f$, where \f$q\f$ is found by
+         *  bisection such that the variance of the filter,
+         *  \f$2 \sum_i d_i / (d_i - 1)^2\f$, equals \f$\sigma^2\f$.
+         *  This is more accurate than the fitted \f$q(\sigma)\f$ of the
+         *  1995 paper.
+         */
+        static std::array<double, 3> coefficients(double sigma)
+        {
+            using complex_t = std::complex<double>;
+            std::array<complex_t, 3> const d = {
+                complex_t(1.40098, 1.00236), complex_t(1.40098, -1.00236),
+                complex_t(1.85132, 0.0) };
+
+            auto scaled = [&d] (double q)
+            {
+                std::array<complex_t, 3> p;
+                for (unsigned i = 0; i < 3; ++i)
+                    p[i] = std::exp(std::log(d[i]) / q);
+                return p;
+            };
+
+            auto variance = [&scaled] (double q)
+            {
+                complex_t v = 0.0;
+                for (complex_t x : scaled(q))
+                    v += 2.0 * x / ((x - 1.0) * (x - 1.0));
+                return v.real();
+            };
+
+            double lo = 0.0, hi = sigma;
+            while (variance(hi) < sigma * sigma)
+                hi *= 2;
+            for (unsigned i = 0; i < 64; ++i)
+            {
+                double q = (lo + hi) / 2;
+                (variance(q) < sigma * sigma ? lo : hi) = q;
+            }
+
+            std::array<complex_t, 3> p = scaled((lo + hi) / 2);
+            for (complex_t &x : p)
+                x = 1.0 / x;
+
+            return {
+                (p[0] + p[1] + p[2]).real(),
+                -(p[0]*p[1] + p[0]*p[2] + p[1]*p[2]).real(),
+                (p[0]*p[1]*p[2]).real() };
+        }
+
+        /*! \brief Compute \f$(I - A^L)^{-1}\f$, by raising \f$A\f$ to the
+         *  power \f$L\f$ through repeated squaring.
+         */
+        static matrix_t periodic_matrix(
+                std::array<double, 3> const &a, size_t length)
+        {
+            matrix_t A = { a[0], a[1], a[2],
+                           1.0,  0.0,  0.0,
+                           0.0,  1.0,  0.0 },
+                     P = { 1.0, 0.0, 0.0,
+                           0.0, 1.0, 0.0,
+                           0.0, 0.0, 1.0 };
+
+            for (size_t n = length; n > 0; n >>= 1)
+            {
+                if (n & 1)
+                    P = product(P, A);
+                A = product(A, A);
+            }
+
+            matrix_t M;
+            for (unsigned i = 0; i < 9; ++i)
+                M[i] = (i % 4 == 0 ? 1.0 : 0.0) - P[i];
+            return inverse(M);
+        }
+
+        /*! \brief One step of the recursion on `W` lanes: computes `w0`
+         *  from the input `x` and the previous outputs `w1`, `w2`, `w3`.
+         */
+        template <unsigned W, bool Store>
+        void step(real_t const *x, real_t *y, real_t (&w0)[W],
+                  real_t const (&w1)[W], real_t const (&w2)[W],
+                  real_t const (&w3)[W]) const
+        {
+            real_t const B = m_B, a1 = m_a[0], a2 = m_a[1], a3 = m_a[2];
+            // the most recent output is added last, to keep the chain of
+            // dependent operations between steps short.
+            for (unsigned b = 0; b < W; ++b)
+                w0[b] = (B * x[b] + a3 * w3[b] + a2 * w2[b]) + a1 * w1[b];
+            if (Store)
+                std::copy(w0, w0 + W, y);
+        }
+
+        /*! \brief Run the recursion over `m_length` samples of `W`
+         *  interleaved lanes, in the direction of `step` (1 or -1).
+         *  `state` holds the three previous outputs and is updated. If
+         *  `Store` is false, only the final state is computed.
+         *
+         *  The loop is unrolled by four, rotating the roles of four state
+         *  buffers, so that no state is copied between steps.
+         */
+        template <unsigned W, bool Store>
+        void run(real_t const *x, real_t *y, ptrdiff_t direction,
+                 real_t (&state)[3][W]) const
+        {
+            real_t w0[W], w1[W], w2[W], w3[W];
+            std::copy(state[0], state[0] + W, w1);
+            std::copy(state[1], state[1] + W, w2);
+            std::copy(state[2], state[2] + W, w3);
+
+            ptrdiff_t const s = direction * ptrdiff_t(W),
+                            t = (Store ? s : 0);
+            size_t n = 0;
+            for (; n + 4 <= m_length; n += 4, x += 4*s, y += 4*t)
+            {
+                step<W, Store>(x,       y,       w0, w1, w2, w3);
+                step<W, Store>(x + s,   y + t,   w3, w0, w1, w2);
+                step<W, Store>(x + 2*s, y + 2*t, w2, w3, w0, w1);
+                step<W, Store>(x + 3*s, y + 3*t, w1, w2, w3, w0);
+            }
+            for (; n < m_length; ++n, x += s, y += t)
+            {
+                step<W, Store>(x, y, w0, w1, w2, w3);
+                std::copy(w2, w2 + W, w3);
+                std::copy(w1, w1 + W, w2);
+                std::copy(w0, w0 + W, w1);
+            }
+
+            std::copy(w1, w1 + W, state[0]);
+            std::copy(w2, w2 + W, state[1]);
+            std::copy(w3, w3 + W, state[2]);
+        }
+
+        /*! \brief One periodic pass over `W` interleaved lanes, in place.
+         */
+        template <unsigned W>
+        void periodic_pass(real_t *data, ptrdiff_t step) const
+        {
+            real_t state[3][W] = {};
+            run<W, false>(data, nullptr, step, state);
+
+            real_t init[3][W];
+            for (unsigned i = 0; i < 3; ++i)
+                for (unsigned b = 0; b < W; ++b)
+                    init[i][b] = m_M[i*3] * state[0][b]
+                               + m_M[i*3 + 1] * state[1][b]
+                               + m_M[i*3 + 2] * state[2][b];
+
+            run<W, true>(data, data, step, init);
+        }
+
+    public:
+        /*! \brief Constructor.
+         *
+         *  \param sigma The standard deviation of the Gaussian, measured
+         *  in pixels. The approximation is valid for \f$\sigma \ge 0.5\f$.
+         *  \param length Length of the lines that will be filtered.
+         *  \param derivative Take the first derivative after smoothing.
+         */
+        RecursiveGaussian(double sigma, size_t length, bool derivative = false)
+            : m_length(length)
+            , m_derivative(derivative)
+        {
+            if (sigma < 0.5)
+                throw Exception("Recursive Gaussian needs sigma >= 0.5.");
+            if (length == 0)
+                throw Exception("Recursive Gaussian needs a non-empty line.");
+
+            std::array<double, 3> a = coefficients(sigma);
+            m_a = { real_t(a[0]), real_t(a[1]), real_t(a[2]) };
+            m_B = real_t(1.0 - (a[0] + a[1] + a[2]));
+            m_M = periodic_matrix(a, length);
+        }
+
+        size_t length() const { return m_length; }
+        bool derivative() const { return m_derivative; }
+
+        /*! \brief Scratch size needed by `recursive_gaussian_line`.
+         */
+        size_t scratch_size() const { return m_length + 2; }
+
+        /*! \brief Scratch size needed by `recursive_gaussian_block`.
+         */
+        size_t block_scratch_size() const
+            { return simd::block_width * scratch_size(); }
+
+        /*! \brief Filter `W` interleaved lanes in place. The lanes are
+         *  padded with one periodic element on each side, which is
+         *  refreshed before taking the derivative; the result is written
+         *  to `output`, which has `output_stride` between samples.
+         */
+        template <unsigned W>
+        void filter(real_t *padded, real_t *output, ptrdiff_t output_stride) const
+        {
+            real_t *data = padded + W;
+            periodic_pass<W>(data, 1);
+            periodic_pass<W>(data + (m_length - 1) * W, -1);
+
+            if (!m_derivative)
+            {
+                for (size_t i = 0; i < m_length; ++i)
+                    std::copy(data + i * W, data + (i + 1) * W,
+                              output + i * output_stride);
+                return;
+            }
+
+            std::copy(data + (m_length - 1) * W, data + m_length * W, padded);
+            std::copy(data, data + W, data + m_length * W);
+            for (size_t i = 0; i < m_length; ++i)
+                for (unsigned b = 0; b < W; ++b)
+                    output[i * output_stride + b] =
+                        real_t(0.5) * (padded[(i + 2) * W + b]
+                                     - padded[i * W + b]);
+        }
+    };
+
+    /*! \brief Filter a single line with a recursive Gaussian.
+     *
+     *  Has the same calling convention as `convolve_line`; `input` and
+     *  `output` may point to the same memory.
+     */
+    template <typename real_t, typename In, typename Out>
+    void recursive_gaussian_line(
+            RecursiveGaussian<real_t> const &filter,
+            In const *input, ptrdiff_t input_stride,
+            Out *output, ptrdiff_t output_stride,
+            size_t length, real_t *scratch)
+    {
+        pad_line(input, input_stride, length, 1, 1, scratch);
+
+        if (real_t *direct = direct_output<real_t>(output, output_stride))
+        {
+            filter.template filter<1>(scratch, direct, 1);
+            return;
+        }
+
+        // the result is written back to the start of the scratch buffer,
+        // which only overwrites elements that have already been read.
+        filter.template filter<1>(scratch, scratch, 1);
+        store_line(scratch, output, output_stride, length);
+    }
+
+    /*! \brief Filter a block of `simd::block_width` neighbouring lines with
+     *  a recursive Gaussian.
+     *
+     *  Has the same calling convention as `convolve_block`. The recursion
+     *  is run on all lanes of the block at once, which the compiler turns
+     *  into vector instructions.
+     */
+    template <typename real_t, typename In, typename Out>
+    void recursive_gaussian_block(
+            RecursiveGaussian<real_t> const &filter,
+            In const *input, ptrdiff_t input_stride,
+            ptrdiff_t input_lane_stride,
+            Out *output, ptrdiff_t output_stride,
+            ptrdiff_t output_lane_stride,
+            size_t length, real_t *scratch)
+    {
+        constexpr unsigned W = simd::block_width;
+
+        pad_block(
+            input, input_stride, input_lane_stride, length, 1, 1, scratch);
+
+        if (real_t *direct = direct_output<real_t>(output, output_lane_stride))
+        {
+            filter.template filter<W>(scratch, direct, output_stride);
+            return;
+        }
+
+        filter.template filter<W>(scratch, scratch, W);
+        store_block(scratch, output, output_stride, output_lane_stride,
+                    length);
+    }
+
+    /*! \brief Smooth input in one direction with a recursive Gaussian.
+     *
+     *  The counterpart of `convolve_1d` for the recursive filter: the cost
+     *  per sample does not depend on `sigma`. `output` may be the same
+     *  array as `input`.
+     *
+     *  \param input Input array.
+     *  \param sigma Standard deviation of the Gaussian, in pixels.
+     *  \param output Output array, should have same shape as input.
+     *  \param axis Axis over which to filter.
+     *  \param derivative Take the first derivative along `axis`.
+     */
+    template <typename Input, typename Output>
+    Output &recursive_gaussian_1d(
+            Input const &input,
+            double sigma,
+            Output &output,
+            unsigned axis,
+            bool derivative = false)
+    {
+        constexpr unsigned D = array_traits<Input>::dimension;
+        using real_t = compute_t<typename array_traits<Input>::value_type>;
+
+        if (output.shape() != input.shape())
+            throw Exception("Shapes do not match.");
+
+        RecursiveGaussian<real_t> filter(
+            sigma, input.shape()[axis], derivative);
+
+        // the recursion is serial along a line, so lines along the first
+        // axis are also filtered in blocks, interleaving the second axis.
+        for_each_line<real_t>(
+            input.slice(), input.const_container().data(),
+            output.slice(), output.container().data(), axis,
+            filter.scratch_size(), filter.block_scratch_size(),
+            [&filter] (auto... args)
+                { recursive_gaussian_line(filter, args...); },
+            [&filter] (auto... args)
+                { recursive_gaussian_block(filter, args...); },
+            (axis == 0 && D > 1 ? 1 : 0));
+
+        return output;
+    }
+}} // namespace HyperCanny::numeric
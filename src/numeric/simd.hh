@@ -0,0 +1,1042 @@
+/* Copyright 2017 Netherlands eScience Center
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#pragma once
+
+/*! \file numeric/simd.hh
+ *  \brief Hand vectorised kernels with run-time instruction set dispatch.
+ *
+ *  The kernels are compiled for each instruction set using function target
+ *  attributes, so the code base itself can be compiled for a generic x86-64
+ *  target. The fastest kernel supported by the CPU is selected on first use.
+ *  On compilers or architectures that lack this support, only the scalar
+ *  kernels are available.
+ */
+
+#include <cstddef>
+#include <algorithm>
+#include <array>
+#include <utility>
+
+#if (defined(__GNUC__) || defined(__clang__)) && defined(__x86_64__)
+#define HYPER_CANNY_X86_SIMD
+#include <immintrin.h>
+#endif
+
+namespace HyperCanny {
+namespace numeric {
+/*! \brief SIMD kernels
+ */
+namespace simd
+{
+    /*! \brief Instruction set levels, in increasing order of capability.
+     */
+    enum class Level { scalar = 0, sse4 = 1, avx2 = 2, avx512 = 3 };
+
+    inline char const *name(Level level)
+    {
+        switch (level)
+        {
+            case Level::sse4:   return "sse4";
+            case Level::avx2:   return "avx2";
+            case Level::avx512: return "avx512";
+            default:            return "scalar";
+        }
+    }
+
+    /*! \brief Query the CPU for the highest supported level.
+     */
+    inline Level detect()
+    {
+#ifdef HYPER_CANNY_X86_SIMD
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512f"))
+            return Level::avx512;
+        if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+            return Level::avx2;
+        if (__builtin_cpu_supports("sse4.1"))
+            return Level::sse4;
+#endif
+        return Level::scalar;
+    }
+
+    /*! \brief The level used by the dispatching kernels, detected once.
+     */
+    inline Level level()
+    {
+        static Level const detected = detect();
+        return detected;
+    }
+
+    /*! \brief Whether the CPU converts between `float` and `half` (F16C),
+     *  detected once. Virtual machines may report AVX2 without it.
+     */
+    inline bool has_f16c()
+    {
+#ifdef HYPER_CANNY_X86_SIMD
+        static bool const detected = (__builtin_cpu_init(),
+                                      __builtin_cpu_supports("f16c") != 0);
+        return detected;
+#else
+        return false;
+#endif
+    }
+
+    // # Correlation kernels {{{1
+    /*! \brief Correlate a contiguous line with a set of taps.
+     *
+     *  Computes \f$y[i] = \sum_j t[j]\, x[i + j]\f$ for `length` outputs;
+     *  `x` should hold `length + n - 1` values. The sum is accumulated in
+     *  order of increasing `j`.
+     */
+    template <typename real_t>
+    void correlate_scalar(
+            real_t const *x, real_t const *taps, size_t n,
+            real_t *y, size_t length)
+    {
+        for (size_t i = 0; i < length; ++i)
+        {
+            real_t acc = 0;
+            for (size_t j = 0; j < n; ++j)
+                acc += x[i + j] * taps[j];
+            y[i] = acc;
+        }
+    }
+
+    /*! \brief Correlate a contiguous line with a folded symmetric or
+     *  antisymmetric set of taps.
+     *
+     *  Computes \f$y[i] = w[0]\, x[i + h] + \sum_{k=1}^{h} w[k]\,
+     *  (x[i + h - k] \pm x[i + h + k])\f$, which for a kernel of
+     *  \f$2h + 1\f$ taps takes \f$h + 1\f$ multiplications per sample
+     *  instead of \f$2h + 1\f$. The minus sign is taken when
+     *  `Antisymmetric` is true.
+     */
+    template <bool Antisymmetric, typename real_t>
+    void correlate_folded_scalar(
+            real_t const *x, real_t const *w, size_t h,
+            real_t *y, size_t length)
+    {
+        for (size_t i = 0; i < length; ++i)
+        {
+            real_t const *c = x + i + h;
+            real_t acc = c[0] * w[0];
+            for (size_t k = 1; k <= h; ++k)
+                acc += (Antisymmetric ? c[-ptrdiff_t(k)] - c[k] : c[-ptrdiff_t(k)] + c[k]) * w[k];
+            y[i] = acc;
+        }
+    }
+
+#ifdef HYPER_CANNY_X86_SIMD
+    /*! \brief SSE4 version of `correlate_scalar`. Multiplication and
+     *  addition are not fused, so results are identical to the scalar
+     *  kernel.
+     */
+    __attribute__((target("sse4.1")))
+    inline void correlate_sse4(
+            float const *x, float const *taps, size_t n,
+            float *y, size_t length)
+    {
+        size_t i = 0;
+        for (; i + 8 <= length; i += 8)
+        {
+            __m128 a0 = _mm_setzero_ps(), a1 = _mm_setzero_ps();
+            for (size_t j = 0; j < n; ++j)
+            {
+                __m128 w = _mm_set1_ps(taps[j]);
+                a0 = _mm_add_ps(a0, _mm_mul_ps(_mm_loadu_ps(x + i + j), w));
+                a1 = _mm_add_ps(a1, _mm_mul_ps(_mm_loadu_ps(x + i + j + 4), w));
+            }
+            _mm_storeu_ps(y + i, a0);
+            _mm_storeu_ps(y + i + 4, a1);
+        }
+        for (; i + 4 <= length; i += 4)
+        {
+            __m128 a0 = _mm_setzero_ps();
+            for (size_t j = 0; j < n; ++j)
+                a0 = _mm_add_ps(a0, _mm_mul_ps(
+                    _mm_loadu_ps(x + i + j), _mm_set1_ps(taps[j])));
+            _mm_storeu_ps(y + i, a0);
+        }
+        correlate_scalar(x + i, taps, n, y + i, length - i);
+    }
+
+    /*! \brief AVX2 version of `correlate_scalar`, using fused multiply-add.
+     */
+    __attribute__((target("avx2,fma")))
+    inline void correlate_avx2(
+            float const *x, float const *taps, size_t n,
+            float *y, size_t length)
+    {
+        size_t i = 0;
+        for (; i + 32 <= length; i += 32)
+        {
+            __m256 a0 = _mm256_setzero_ps(), a1 = _mm256_setzero_ps(),
+                   a2 = _mm256_setzero_ps(), a3 = _mm256_setzero_ps();
+            for (size_t j = 0; j < n; ++j)
+            {
+                float const *xj = x + i + j;
+                __m256 w = _mm256_set1_ps(taps[j]);
+                a0 = _mm256_fmadd_ps(_mm256_loadu_ps(xj), w, a0);
+                a1 = _mm256_fmadd_ps(_mm256_loadu_ps(xj + 8), w, a1);
+                a2 = _mm256_fmadd_ps(_mm256_loadu_ps(xj + 16), w, a2);
+                a3 = _mm256_fmadd_ps(_mm256_loadu_ps(xj + 24), w, a3);
+            }
+            _mm256_storeu_ps(y + i, a0);
+            _mm256_storeu_ps(y + i + 8, a1);
+            _mm256_storeu_ps(y + i + 16, a2);
+            _mm256_storeu_ps(y + i + 24, a3);
+        }
+        for (; i + 8 <= length; i += 8)
+        {
+            __m256 a0 = _mm256_setzero_ps();
+            for (size_t j = 0; j < n; ++j)
+                a0 = _mm256_fmadd_ps(
+                    _mm256_loadu_ps(x + i + j), _mm256_set1_ps(taps[j]), a0);
+            _mm256_storeu_ps(y + i, a0);
+        }
+        correlate_scalar(x + i, taps, n, y + i, length - i);
+    }
+
+    /*! \brief AVX-512 version of `correlate_scalar`. The remainder is
+     *  handled with masked loads and stores.
+     */
+    __attribute__((target("avx512f")))
+    inline void correlate_avx512(
+            float const *x, float const *taps, size_t n,
+            float *y, size_t length)
+    {
+        size_t i = 0;
+        for (; i + 64 <= length; i += 64)
+        {
+            __m512 a0 = _mm512_setzero_ps(), a1 = _mm512_setzero_ps(),
+                   a2 = _mm512_setzero_ps(), a3 = _mm512_setzero_ps();
+            for (size_t j = 0; j < n; ++j)
+            {
+                float const *xj = x + i + j;
+                __m512 w = _mm512_set1_ps(taps[j]);
+                a0 = _mm512_fmadd_ps(_mm512_loadu_ps(xj), w, a0);
+                a1 = _mm512_fmadd_ps(_mm512_loadu_ps(xj + 16), w, a1);
+                a2 = _mm512_fmadd_ps(_mm512_loadu_ps(xj + 32), w, a2);
+                a3 = _mm512_fmadd_ps(_mm512_loadu_ps(xj + 48), w, a3);
+            }
+            _mm512_storeu_ps(y + i, a0);
+            _mm512_storeu_ps(y + i + 16, a1);
+            _mm512_storeu_ps(y + i + 32, a2);
+            _mm512_storeu_ps(y + i + 48, a3);
+        }
+        for (; i < length; i += 16)
+        {
+            size_t m = length - i < 16 ? length - i : 16;
+            __mmask16 mask = static_cast<__mmask16>((1u << m) - 1);
+            __m512 a0 = _mm512_setzero_ps();
+            for (size_t j = 0; j < n; ++j)
+                a0 = _mm512_fmadd_ps(
+                    _mm512_maskz_loadu_ps(mask, x + i + j),
+                    _mm512_set1_ps(taps[j]), a0);
+            _mm512_mask_storeu_ps(y + i, mask, a0);
+        }
+    }
+
+    /*! \brief SSE4 version of `correlate_folded_scalar`, bit-exact with
+     *  the scalar kernel.
+     */
+    template <bool Antisymmetric>
+    __attribute__((target("sse4.1")))
+    inline void correlate_folded_sse4(
+            float const *x, float const *w, size_t h,
+            float *y, size_t length)
+    {
+        size_t i = 0;
+        for (; i + 4 <= length; i += 4)
+        {
+            float const *c = x + i + h;
+            __m128 a0 = _mm_mul_ps(_mm_loadu_ps(c), _mm_set1_ps(w[0]));
+            for (size_t k = 1; k <= h; ++k)
+            {
+                __m128 l = _mm_loadu_ps(c - k), r = _mm_loadu_ps(c + k);
+                __m128 f = Antisymmetric ? _mm_sub_ps(l, r) : _mm_add_ps(l, r);
+                a0 = _mm_add_ps(a0, _mm_mul_ps(f, _mm_set1_ps(w[k])));
+            }
+            _mm_storeu_ps(y + i, a0);
+        }
+        correlate_folded_scalar<Antisymmetric>(x + i, w, h, y + i, length - i);
+    }
+
+    /*! \brief AVX2 version of `correlate_folded_scalar`.
+     */
+    template <bool Antisymmetric>
+    __attribute__((target("avx2,fma")))
+    inline void correlate_folded_avx2(
+            float const *x, float const *w, size_t h,
+            float *y, size_t length)
+    {
+        size_t i = 0;
+        for (; i + 16 <= length; i += 16)
+        {
+            float const *c = x + i + h;
+            __m256 w0 = _mm256_set1_ps(w[0]);
+            __m256 a0 = _mm256_mul_ps(_mm256_loadu_ps(c), w0),
+                   a1 = _mm256_mul_ps(_mm256_loadu_ps(c + 8), w0);
+            for (size_t k = 1; k <= h; ++k)
+            {
+                __m256 wk = _mm256_set1_ps(w[k]);
+                __m256 l0 = _mm256_loadu_ps(c - k), r0 = _mm256_loadu_ps(c + k),
+                       l1 = _mm256_loadu_ps(c + 8 - k), r1 = _mm256_loadu_ps(c + 8 + k);
+                __m256 f0 = Antisymmetric ? _mm256_sub_ps(l0, r0) : _mm256_add_ps(l0, r0),
+                       f1 = Antisymmetric ? _mm256_sub_ps(l1, r1) : _mm256_add_ps(l1, r1);
+                a0 = _mm256_fmadd_ps(f0, wk, a0);
+                a1 = _mm256_fmadd_ps(f1, wk, a1);
+            }
+            _mm256_storeu_ps(y + i, a0);
+            _mm256_storeu_ps(y + i + 8, a1);
+        }
+        for (; i + 8 <= length; i += 8)
+        {
+            float const *c = x + i + h;
+            __m256 a0 = _mm256_mul_ps(_mm256_loadu_ps(c), _mm256_set1_ps(w[0]));
+            for (size_t k = 1; k <= h; ++k)
+            {
+                __m256 l = _mm256_loadu_ps(c - k), r = _mm256_loadu_ps(c + k);
+                __m256 f = Antisymmetric ? _mm256_sub_ps(l, r) : _mm256_add_ps(l, r);
+                a0 = _mm256_fmadd_ps(f, _mm256_set1_ps(w[k]), a0);
+            }
+            _mm256_storeu_ps(y + i, a0);
+        }
+        correlate_folded_scalar<Antisymmetric>(x + i, w, h, y + i, length - i);
+    }
+
+    /*! \brief AVX-512 version of `correlate_folded_scalar`.
+     */
+    template <bool Antisymmetric>
+    __attribute__((target("avx512f")))
+    inline void correlate_folded_avx512(
+            float const *x, float const *w, size_t h,
+            float *y, size_t length)
+    {
+        size_t i = 0;
+        for (; i + 32 <= length; i += 32)
+        {
+            float const *c = x + i + h;
+            __m512 w0 = _mm512_set1_ps(w[0]);
+            __m512 a0 = _mm512_mul_ps(_mm512_loadu_ps(c), w0),
+                   a1 = _mm512_mul_ps(_mm512_loadu_ps(c + 16), w0);
+            for (size_t k = 1; k <= h; ++k)
+            {
+                __m512 wk = _mm512_set1_ps(w[k]);
+                __m512 l0 = _mm512_loadu_ps(c - k), r0 = _mm512_loadu_ps(c + k),
+                       l1 = _mm512_loadu_ps(c + 16 - k), r1 = _mm512_loadu_ps(c + 16 + k);
+                __m512 f0 = Antisymmetric ? _mm512_sub_ps(l0, r0) : _mm512_add_ps(l0, r0),
+                       f1 = Antisymmetric ? _mm512_sub_ps(l1, r1) : _mm512_add_ps(l1, r1);
+                a0 = _mm512_fmadd_ps(f0, wk, a0);
+                a1 = _mm512_fmadd_ps(f1, wk, a1);
+            }
+            _mm512_storeu_ps(y + i, a0);
+            _mm512_storeu_ps(y + i + 16, a1);
+        }
+        for (; i < length; i += 16)
+        {
+            size_t m = length - i < 16 ? length - i : 16;
+            __mmask16 mask = static_cast<__mmask16>((1u << m) - 1);
+            float const *c = x + i + h;
+            __m512 a0 = _mm512_mul_ps(
+                _mm512_maskz_loadu_ps(mask, c), _mm512_set1_ps(w[0]));
+            for (size_t k = 1; k <= h; ++k)
+            {
+                __m512 l = _mm512_maskz_loadu_ps(mask, c - k),
+                       r = _mm512_maskz_loadu_ps(mask, c + k);
+                __m512 f = Antisymmetric ? _mm512_sub_ps(l, r) : _mm512_add_ps(l, r);
+                a0 = _mm512_fmadd_ps(f, _mm512_set1_ps(w[k]), a0);
+            }
+            _mm512_mask_storeu_ps(y + i, mask, a0);
+        }
+    }
+#endif
+
+    using correlate_fn = void (*)(
+            float const *, float const *, size_t, float *, size_t);
+
+    /*! \brief Get the correlation kernel for a given level. Levels that are
+     *  not compiled in fall back to the next lower level.
+     */
+    inline correlate_fn correlate_kernel(Level level)
+    {
+#ifdef HYPER_CANNY_X86_SIMD
+        switch (level)
+        {
+            case Level::avx512: return correlate_avx512;
+            case Level::avx2:   return correlate_avx2;
+            case Level::sse4:   return correlate_sse4;
+            default:            break;
+        }
+#endif
+        return correlate_scalar<float>;
+    }
+
+    /*! \brief Correlate using the best kernel for this CPU.
+     */
+    inline void correlate(
+            float const *x, float const *taps, size_t n,
+            float *y, size_t length)
+    {
+        static correlate_fn const kernel = correlate_kernel(level());
+        kernel(x, taps, n, y, length);
+    }
+
+    template <typename real_t>
+    void correlate(
+            real_t const *x, real_t const *taps, size_t n,
+            real_t *y, size_t length)
+    {
+        correlate_scalar(x, taps, n, y, length);
+    }
+
+    using correlate_folded_fn = void (*)(
+            float const *, float const *, size_t, float *, size_t);
+
+    /*! \brief Get the folded correlation kernel for a given level.
+     */
+    template <bool Antisymmetric>
+    correlate_folded_fn correlate_folded_kernel(Level level)
+    {
+#ifdef HYPER_CANNY_X86_SIMD
+        switch (level)
+        {
+            case Level::avx512: return correlate_folded_avx512<Antisymmetric>;
+            case Level::avx2:   return correlate_folded_avx2<Antisymmetric>;
+            case Level::sse4:   return correlate_folded_sse4<Antisymmetric>;
+            default:            break;
+        }
+#endif
+        return correlate_folded_scalar<Antisymmetric, float>;
+    }
+
+    // Fixed width kernels {{{2
+    /*! \brief Largest half width \f$h\f$ of a folded kernel for which a
+     *  specialised kernel is compiled. This covers kernels of up to 17
+     *  taps: the 3-tap Sobel and gradient kernels, and Gaussians with
+     *  \f$n \le 8\f$, or \f$n \le 7\f$ after convolution with a Sobel
+     *  kernel.
+     */
+    constexpr size_t max_fixed_half_width = 8;
+
+    /*! \brief Version of `correlate_folded_scalar` with the half width
+     *  `H` known at compile time. The loop over taps is unrolled and the
+     *  taps are kept in local variables, out of reach of the stores to `y`.
+     */
+    template <bool Antisymmetric, size_t H, typename real_t>
+    void correlate_folded_fixed_scalar(
+            real_t const *x, real_t const *w, size_t,
+            real_t *y, size_t length)
+    {
+        real_t wk[H + 1];
+        std::copy(w, w + H + 1, wk);
+
+        for (size_t i = 0; i < length; ++i)
+        {
+            real_t const *c = x + i + H;
+            real_t acc = c[0] * wk[0];
+            #pragma GCC unroll 16
+            for (size_t k = 1; k <= H; ++k)
+                acc += (Antisymmetric ? c[-ptrdiff_t(k)] - c[k] : c[-ptrdiff_t(k)] + c[k]) * wk[k];
+            y[i] = acc;
+        }
+    }
+
+#ifdef HYPER_CANNY_X86_SIMD
+    /*! \brief SSE4 version of `correlate_folded_fixed_scalar`, bit-exact
+     *  with the scalar kernels.
+     */
+    template <bool Antisymmetric, size_t H>
+    __attribute__((target("sse4.1")))
+    inline void correlate_folded_fixed_sse4(
+            float const *x, float const *w, size_t,
+            float *y, size_t length)
+    {
+        __m128 wk[H + 1];
+        for (size_t k = 0; k <= H; ++k)
+            wk[k] = _mm_set1_ps(w[k]);
+
+        size_t i = 0;
+        for (; i + 8 <= length; i += 8)
+        {
+            float const *c = x + i + H;
+            __m128 a0 = _mm_mul_ps(_mm_loadu_ps(c), wk[0]),
+                   a1 = _mm_mul_ps(_mm_loadu_ps(c + 4), wk[0]);
+            #pragma GCC unroll 16
+            for (size_t k = 1; k <= H; ++k)
+            {
+                __m128 l0 = _mm_loadu_ps(c - k),     r0 = _mm_loadu_ps(c + k),
+                       l1 = _mm_loadu_ps(c + 4 - k), r1 = _mm_loadu_ps(c + 4 + k);
+                __m128 f0 = Antisymmetric ? _mm_sub_ps(l0, r0) : _mm_add_ps(l0, r0),
+                       f1 = Antisymmetric ? _mm_sub_ps(l1, r1) : _mm_add_ps(l1, r1);
+                a0 = _mm_add_ps(a0, _mm_mul_ps(f0, wk[k]));
+                a1 = _mm_add_ps(a1, _mm_mul_ps(f1, wk[k]));
+            }
+            _mm_storeu_ps(y + i, a0);
+            _mm_storeu_ps(y + i + 4, a1);
+        }
+        correlate_folded_fixed_scalar<Antisymmetric, H>(
+            x + i, w, H, y + i, length - i);
+    }
+
+    /*! \brief AVX2 version of `correlate_folded_fixed_scalar`.
+     */
+    template <bool Antisymmetric, size_t H>
+    __attribute__((target("avx2,fma")))
+    inline void correlate_folded_fixed_avx2(
+            float const *x, float const *w, size_t,
+            float *y, size_t length)
+    {
+        __m256 wk[H + 1];
+        for (size_t k = 0; k <= H; ++k)
+            wk[k] = _mm256_set1_ps(w[k]);
+
+        size_t i = 0;
+        for (; i + 16 <= length; i += 16)
+        {
+            float const *c = x + i + H;
+            __m256 a0 = _mm256_mul_ps(_mm256_loadu_ps(c), wk[0]),
+                   a1 = _mm256_mul_ps(_mm256_loadu_ps(c + 8), wk[0]);
+            #pragma GCC unroll 16
+            for (size_t k = 1; k <= H; ++k)
+            {
+                __m256 l0 = _mm256_loadu_ps(c - k),     r0 = _mm256_loadu_ps(c + k),
+                       l1 = _mm256_loadu_ps(c + 8 - k), r1 = _mm256_loadu_ps(c + 8 + k);
+                __m256 f0 = Antisymmetric ? _mm256_sub_ps(l0, r0) : _mm256_add_ps(l0, r0),
+                       f1 = Antisymmetric ? _mm256_sub_ps(l1, r1) : _mm256_add_ps(l1, r1);
+                a0 = _mm256_fmadd_ps(f0, wk[k], a0);
+                a1 = _mm256_fmadd_ps(f1, wk[k], a1);
+            }
+            _mm256_storeu_ps(y + i, a0);
+            _mm256_storeu_ps(y + i + 8, a1);
+        }
+        correlate_folded_avx2<Antisymmetric>(x + i, w, H, y + i, length - i);
+    }
+
+    /*! \brief AVX-512 version of `correlate_folded_fixed_scalar`.
+     */
+    template <bool Antisymmetric, size_t H>
+    __attribute__((target("avx512f")))
+    inline void correlate_folded_fixed_avx512(
+            float const *x, float const *w, size_t,
+            float *y, size_t length)
+    {
+        __m512 wk[H + 1];
+        for (size_t k = 0; k <= H; ++k)
+            wk[k] = _mm512_set1_ps(w[k]);
+
+        size_t i = 0;
+        for (; i + 32 <= length; i += 32)
+        {
+            float const *c = x + i + H;
+            __m512 a0 = _mm512_mul_ps(_mm512_loadu_ps(c), wk[0]),
+                   a1 = _mm512_mul_ps(_mm512_loadu_ps(c + 16), wk[0]);
+            #pragma GCC unroll 16
+            for (size_t k = 1; k <= H; ++k)
+            {
+                __m512 l0 = _mm512_loadu_ps(c - k),      r0 = _mm512_loadu_ps(c + k),
+                       l1 = _mm512_loadu_ps(c + 16 - k), r1 = _mm512_loadu_ps(c + 16 + k);
+                __m512 f0 = Antisymmetric ? _mm512_sub_ps(l0, r0) : _mm512_add_ps(l0, r0),
+                       f1 = Antisymmetric ? _mm512_sub_ps(l1, r1) : _mm512_add_ps(l1, r1);
+                a0 = _mm512_fmadd_ps(f0, wk[k], a0);
+                a1 = _mm512_fmadd_ps(f1, wk[k], a1);
+            }
+            _mm512_storeu_ps(y + i, a0);
+            _mm512_storeu_ps(y + i + 16, a1);
+        }
+        correlate_folded_avx512<Antisymmetric>(x + i, w, H, y + i, length - i);
+    }
+#endif
+
+    /*! \brief Get the folded correlation kernel with half width `H` for a
+     *  given level.
+     */
+    template <bool Antisymmetric, size_t H>
+    correlate_folded_fn correlate_folded_fixed_kernel(Level level)
+    {
+#ifdef HYPER_CANNY_X86_SIMD
+        switch (level)
+        {
+            case Level::avx512: return correlate_folded_fixed_avx512<Antisymmetric, H>;
+            case Level::avx2:   return correlate_folded_fixed_avx2<Antisymmetric, H>;
+            case Level::sse4:   return correlate_folded_fixed_sse4<Antisymmetric, H>;
+            default:            break;
+        }
+#endif
+        return correlate_folded_fixed_scalar<Antisymmetric, H, float>;
+    }
+
+    /*! \brief Table of folded kernels for a given level, indexed by half
+     *  width, up to `max_fixed_half_width`.
+     */
+    template <bool Antisymmetric, size_t... H>
+    std::array<correlate_folded_fn, sizeof...(H)> correlate_folded_fixed_table(
+            Level level, std::index_sequence<H...>)
+    {
+        return { correlate_folded_fixed_kernel<Antisymmetric, H>(level)... };
+    }
+    // }}}2
+
+    /*! \brief Folded correlation using the best kernel for this CPU. For
+     *  half widths up to `max_fixed_half_width` a kernel specialised for
+     *  that width is used, otherwise the generic loop.
+     */
+    template <bool Antisymmetric>
+    void correlate_folded(
+            float const *x, float const *w, size_t h,
+            float *y, size_t length)
+    {
+        static correlate_folded_fn const kernel =
+            correlate_folded_kernel<Antisymmetric>(level());
+        static auto const fixed = correlate_folded_fixed_table<Antisymmetric>(
+            level(), std::make_index_sequence<max_fixed_half_width + 1>());
+
+        (h <= max_fixed_half_width ? fixed[h] : kernel)(x, w, h, y, length);
+    }
+
+    template <bool Antisymmetric, typename real_t>
+    void correlate_folded(
+            real_t const *x, real_t const *w, size_t h,
+            real_t *y, size_t length)
+    {
+        correlate_folded_scalar<Antisymmetric>(x, w, h, y, length);
+    }
+    // }}}1
+
+    // # Block correlation kernels {{{1
+    /*! \brief Number of lines that are convolved together by the block
+     *  kernels.
+     */
+    constexpr unsigned block_width = 16;
+
+    /*! \brief Correlate a block of `block_width` interleaved lines.
+     *
+     *  Element `b` of line position `p` is found at `x[p * block_width + b]`,
+     *  so every step along the lines is a contiguous load, and the inner
+     *  loop runs across lines. Output row `i` is written to
+     *  `y + i * y_stride`.
+     */
+    template <typename real_t>
+    void correlate_block_scalar(
+            real_t const *x, real_t const *taps, size_t n,
+            real_t *y, ptrdiff_t y_stride, size_t length)
+    {
+        for (size_t i = 0; i < length; ++i)
+        {
+            real_t acc[block_width] = {};
+            for (size_t j = 0; j < n; ++j)
+            {
+                real_t const *xj = x + (i + j) * block_width;
+                for (unsigned b = 0; b < block_width; ++b)
+                    acc[b] += xj[b] * taps[j];
+            }
+            std::copy(acc, acc + block_width, y + i * y_stride);
+        }
+    }
+
+    /*! \brief Block version of `correlate_folded_scalar`.
+     */
+    template <bool Antisymmetric, typename real_t>
+    void correlate_block_folded_scalar(
+            real_t const *x, real_t const *w, size_t h,
+            real_t *y, ptrdiff_t y_stride, size_t length)
+    {
+        constexpr ptrdiff_t W = block_width;
+        for (size_t i = 0; i < length; ++i)
+        {
+            real_t const *c = x + (i + h) * W;
+            real_t acc[block_width];
+            for (unsigned b = 0; b < block_width; ++b)
+                acc[b] = c[b] * w[0];
+            for (size_t k = 1; k <= h; ++k)
+            {
+                real_t const *l = c - ptrdiff_t(k) * W, *r = c + k * W;
+                for (unsigned b = 0; b < block_width; ++b)
+                    acc[b] += (Antisymmetric ? l[b] - r[b] : l[b] + r[b]) * w[k];
+            }
+            std::copy(acc, acc + block_width, y + i * y_stride);
+        }
+    }
+
+#ifdef HYPER_CANNY_X86_SIMD
+    /*! \brief AVX2 version of `correlate_block_scalar`; two output rows
+     *  are computed at once to have four independent accumulators.
+     */
+    __attribute__((target("avx2,fma")))
+    inline void correlate_block_avx2(
+            float const *x, float const *taps, size_t n,
+            float *y, ptrdiff_t y_stride, size_t length)
+    {
+        size_t i = 0;
+        for (; i + 2 <= length; i += 2)
+        {
+            __m256 a0 = _mm256_setzero_ps(), a1 = _mm256_setzero_ps(),
+                   a2 = _mm256_setzero_ps(), a3 = _mm256_setzero_ps();
+            for (size_t j = 0; j < n; ++j)
+            {
+                float const *xj = x + (i + j) * block_width;
+                __m256 w = _mm256_set1_ps(taps[j]);
+                a0 = _mm256_fmadd_ps(_mm256_loadu_ps(xj), w, a0);
+                a1 = _mm256_fmadd_ps(_mm256_loadu_ps(xj + 8), w, a1);
+                a2 = _mm256_fmadd_ps(_mm256_loadu_ps(xj + 16), w, a2);
+                a3 = _mm256_fmadd_ps(_mm256_loadu_ps(xj + 24), w, a3);
+            }
+            _mm256_storeu_ps(y + i * y_stride, a0);
+            _mm256_storeu_ps(y + i * y_stride + 8, a1);
+            _mm256_storeu_ps(y + (i + 1) * y_stride, a2);
+            _mm256_storeu_ps(y + (i + 1) * y_stride + 8, a3);
+        }
+        correlate_block_scalar(
+            x + i * block_width, taps, n, y + i * y_stride, y_stride, length - i);
+    }
+
+    /*! \brief AVX2 version of `correlate_block_folded_scalar`.
+     */
+    template <bool Antisymmetric>
+    __attribute__((target("avx2,fma")))
+    inline void correlate_block_folded_avx2(
+            float const *x, float const *w, size_t h,
+            float *y, ptrdiff_t y_stride, size_t length)
+    {
+        constexpr ptrdiff_t W = block_width;
+        size_t i = 0;
+        for (; i + 2 <= length; i += 2)
+        {
+            float const *c = x + (i + h) * W;
+            __m256 w0 = _mm256_set1_ps(w[0]);
+            __m256 a0 = _mm256_mul_ps(_mm256_loadu_ps(c), w0),
+                   a1 = _mm256_mul_ps(_mm256_loadu_ps(c + 8), w0),
+                   a2 = _mm256_mul_ps(_mm256_loadu_ps(c + W), w0),
+                   a3 = _mm256_mul_ps(_mm256_loadu_ps(c + W + 8), w0);
+            for (size_t k = 1; k <= h; ++k)
+            {
+                float const *l = c - ptrdiff_t(k) * W, *r = c + k * W;
+                __m256 wk = _mm256_set1_ps(w[k]);
+                __m256 l0 = _mm256_loadu_ps(l),     r0 = _mm256_loadu_ps(r),
+                       l1 = _mm256_loadu_ps(l + 8), r1 = _mm256_loadu_ps(r + 8),
+                       l2 = _mm256_loadu_ps(l + W), r2 = _mm256_loadu_ps(r + W),
+                       l3 = _mm256_loadu_ps(l + W + 8), r3 = _mm256_loadu_ps(r + W + 8);
+                a0 = _mm256_fmadd_ps(Antisymmetric ? _mm256_sub_ps(l0, r0) : _mm256_add_ps(l0, r0), wk, a0);
+                a1 = _mm256_fmadd_ps(Antisymmetric ? _mm256_sub_ps(l1, r1) : _mm256_add_ps(l1, r1), wk, a1);
+                a2 = _mm256_fmadd_ps(Antisymmetric ? _mm256_sub_ps(l2, r2) : _mm256_add_ps(l2, r2), wk, a2);
+                a3 = _mm256_fmadd_ps(Antisymmetric ? _mm256_sub_ps(l3, r3) : _mm256_add_ps(l3, r3), wk, a3);
+            }
+            _mm256_storeu_ps(y + i * y_stride, a0);
+            _mm256_storeu_ps(y + i * y_stride + 8, a1);
+            _mm256_storeu_ps(y + (i + 1) * y_stride, a2);
+            _mm256_storeu_ps(y + (i + 1) * y_stride + 8, a3);
+        }
+        correlate_block_folded_scalar<Antisymmetric>(
+            x + i * W, w, h, y + i * y_stride, y_stride, length - i);
+    }
+
+    /*! \brief AVX-512 version of `correlate_block_scalar`; a block row is
+     *  exactly one register, four rows are computed at once.
+     */
+    __attribute__((target("avx512f")))
+    inline void correlate_block_avx512(
+            float const *x, float const *taps, size_t n,
+            float *y, ptrdiff_t y_stride, size_t length)
+    {
+        constexpr ptrdiff_t W = block_width;
+        size_t i = 0;
+        for (; i + 4 <= length; i += 4)
+        {
+            __m512 a0 = _mm512_setzero_ps(), a1 = _mm512_setzero_ps(),
+                   a2 = _mm512_setzero_ps(), a3 = _mm512_setzero_ps();
+            for (size_t j = 0; j < n; ++j)
+            {
+                float const *xj = x + (i + j) * W;
+                __m512 w = _mm512_set1_ps(taps[j]);
+                a0 = _mm512_fmadd_ps(_mm512_loadu_ps(xj), w, a0);
+                a1 = _mm512_fmadd_ps(_mm512_loadu_ps(xj + W), w, a1);
+                a2 = _mm512_fmadd_ps(_mm512_loadu_ps(xj + 2 * W), w, a2);
+                a3 = _mm512_fmadd_ps(_mm512_loadu_ps(xj + 3 * W), w, a3);
+            }
+            _mm512_storeu_ps(y + i * y_stride, a0);
+            _mm512_storeu_ps(y + (i + 1) * y_stride, a1);
+            _mm512_storeu_ps(y + (i + 2) * y_stride, a2);
+            _mm512_storeu_ps(y + (i + 3) * y_stride, a3);
+        }
+        for (; i < length; ++i)
+        {
+            __m512 a0 = _mm512_setzero_ps();
+            for (size_t j = 0; j < n; ++j)
+                a0 = _mm512_fmadd_ps(
+                    _mm512_loadu_ps(x + (i + j) * W), _mm512_set1_ps(taps[j]), a0);
+            _mm512_storeu_ps(y + i * y_stride, a0);
+        }
+    }
+
+    /*! \brief AVX-512 version of `correlate_block_folded_scalar`.
+     */
+    template <bool Antisymmetric>
+    __attribute__((target("avx512f")))
+    inline void correlate_block_folded_avx512(
+            float const *x, float const *w, size_t h,
+            float *y, ptrdiff_t y_stride, size_t length)
+    {
+        constexpr ptrdiff_t W = block_width;
+        size_t i = 0;
+        for (; i + 2 <= length; i += 2)
+        {
+            float const *c = x + (i + h) * W;
+            __m512 w0 = _mm512_set1_ps(w[0]);
+            __m512 a0 = _mm512_mul_ps(_mm512_loadu_ps(c), w0),
+                   a1 = _mm512_mul_ps(_mm512_loadu_ps(c + W), w0);
+            for (size_t k = 1; k <= h; ++k)
+            {
+                float const *l = c - ptrdiff_t(k) * W, *r = c + k * W;
+                __m512 wk = _mm512_set1_ps(w[k]);
+                __m512 l0 = _mm512_loadu_ps(l),     r0 = _mm512_loadu_ps(r),
+                       l1 = _mm512_loadu_ps(l + W), r1 = _mm512_loadu_ps(r + W);
+                a0 = _mm512_fmadd_ps(Antisymmetric ? _mm512_sub_ps(l0, r0) : _mm512_add_ps(l0, r0), wk, a0);
+                a1 = _mm512_fmadd_ps(Antisymmetric ? _mm512_sub_ps(l1, r1) : _mm512_add_ps(l1, r1), wk, a1);
+            }
+            _mm512_storeu_ps(y + i * y_stride, a0);
+            _mm512_storeu_ps(y + (i + 1) * y_stride, a1);
+        }
+        correlate_block_folded_scalar<Antisymmetric>(
+            x + i * W, w, h, y + i * y_stride, y_stride, length - i);
+    }
+#endif
+
+    using correlate_block_fn = void (*)(
+            float const *, float const *, size_t, float *, ptrdiff_t, size_t);
+
+    /*! \brief Get the block correlation kernel for a given level. There
+     *  is no separate SSE4 kernel; the scalar loop over the block is
+     *  vectorised by the compiler for the baseline instruction set.
+     */
+    inline correlate_block_fn correlate_block_kernel(Level level)
+    {
+#ifdef HYPER_CANNY_X86_SIMD
+        switch (level)
+        {
+            case Level::avx512: return correlate_block_avx512;
+            case Level::avx2:   return correlate_block_avx2;
+            default:            break;
+        }
+#endif
+        return correlate_block_scalar<float>;
+    }
+
+    template <bool Antisymmetric>
+    correlate_block_fn correlate_block_folded_kernel(Level level)
+    {
+#ifdef HYPER_CANNY_X86_SIMD
+        switch (level)
+        {
+            case Level::avx512: return correlate_block_folded_avx512<Antisymmetric>;
+            case Level::avx2:   return correlate_block_folded_avx2<Antisymmetric>;
+            default:            break;
+        }
+#endif
+        return correlate_block_folded_scalar<Antisymmetric, float>;
+    }
+
+    /*! \brief Block correlation using the best kernel for this CPU.
+     */
+    inline void correlate_block(
+            float const *x, float const *taps, size_t n,
+            float *y, ptrdiff_t y_stride, size_t length)
+    {
+        static correlate_block_fn const kernel = correlate_block_kernel(level());
+        kernel(x, taps, n, y, y_stride, length);
+    }
+
+    template <typename real_t>
+    void correlate_block(
+            real_t const *x, real_t const *taps, size_t n,
+            real_t *y, ptrdiff_t y_stride, size_t length)
+    {
+        correlate_block_scalar(x, taps, n, y, y_stride, length);
+    }
+
+    // Fixed width kernels {{{2
+    /*! \brief Version of `correlate_block_folded_scalar` with the half
+     *  width `H` known at compile time.
+     */
+    template <bool Antisymmetric, size_t H, typename real_t>
+    void correlate_block_folded_fixed_scalar(
+            real_t const *x, real_t const *w, size_t,
+            real_t *y, ptrdiff_t y_stride, size_t length)
+    {
+        constexpr ptrdiff_t W = block_width;
+        real_t wk[H + 1];
+        std::copy(w, w + H + 1, wk);
+
+        for (size_t i = 0; i < length; ++i)
+        {
+            real_t const *c = x + (i + H) * W;
+            real_t acc[block_width];
+            for (unsigned b = 0; b < block_width; ++b)
+                acc[b] = c[b] * wk[0];
+            #pragma GCC unroll 16
+            for (size_t k = 1; k <= H; ++k)
+            {
+                real_t const *l = c - ptrdiff_t(k) * W, *r = c + k * W;
+                for (unsigned b = 0; b < block_width; ++b)
+                    acc[b] += (Antisymmetric ? l[b] - r[b] : l[b] + r[b]) * wk[k];
+            }
+            std::copy(acc, acc + block_width, y + i * y_stride);
+        }
+    }
+
+#ifdef HYPER_CANNY_X86_SIMD
+    /*! \brief AVX2 version of `correlate_block_folded_fixed_scalar`.
+     */
+    template <bool Antisymmetric, size_t H>
+    __attribute__((target("avx2,fma")))
+    inline void correlate_block_folded_fixed_avx2(
+            float const *x, float const *w, size_t,
+            float *y, ptrdiff_t y_stride, size_t length)
+    {
+        constexpr ptrdiff_t W = block_width;
+        __m256 wk[H + 1];
+        for (size_t k = 0; k <= H; ++k)
+            wk[k] = _mm256_set1_ps(w[k]);
+
+        size_t i = 0;
+        for (; i + 2 <= length; i += 2)
+        {
+            float const *c = x + (i + H) * W;
+            __m256 a0 = _mm256_mul_ps(_mm256_loadu_ps(c), wk[0]),
+                   a1 = _mm256_mul_ps(_mm256_loadu_ps(c + 8), wk[0]),
+                   a2 = _mm256_mul_ps(_mm256_loadu_ps(c + W), wk[0]),
+                   a3 = _mm256_mul_ps(_mm256_loadu_ps(c + W + 8), wk[0]);
+            #pragma GCC unroll 16
+            for (size_t k = 1; k <= H; ++k)
+            {
+                float const *l = c - ptrdiff_t(k) * W, *r = c + k * W;
+                __m256 l0 = _mm256_loadu_ps(l),     r0 = _mm256_loadu_ps(r),
+                       l1 = _mm256_loadu_ps(l + 8), r1 = _mm256_loadu_ps(r + 8),
+                       l2 = _mm256_loadu_ps(l + W), r2 = _mm256_loadu_ps(r + W),
+                       l3 = _mm256_loadu_ps(l + W + 8), r3 = _mm256_loadu_ps(r + W + 8);
+                a0 = _mm256_fmadd_ps(Antisymmetric ? _mm256_sub_ps(l0, r0) : _mm256_add_ps(l0, r0), wk[k], a0);
+                a1 = _mm256_fmadd_ps(Antisymmetric ? _mm256_sub_ps(l1, r1) : _mm256_add_ps(l1, r1), wk[k], a1);
+                a2 = _mm256_fmadd_ps(Antisymmetric ? _mm256_sub_ps(l2, r2) : _mm256_add_ps(l2, r2), wk[k], a2);
+                a3 = _mm256_fmadd_ps(Antisymmetric ? _mm256_sub_ps(l3, r3) : _mm256_add_ps(l3, r3), wk[k], a3);
+            }
+            _mm256_storeu_ps(y + i * y_stride, a0);
+            _mm256_storeu_ps(y + i * y_stride + 8, a1);
+            _mm256_storeu_ps(y + (i + 1) * y_stride, a2);
+            _mm256_storeu_ps(y + (i + 1) * y_stride + 8, a3);
+        }
+        correlate_block_folded_avx2<Antisymmetric>(
+            x + i * W, w, H, y + i * y_stride, y_stride, length - i);
+    }
+
+    /*! \brief AVX-512 version of `correlate_block_folded_fixed_scalar`.
+     *  With the taps in registers, there is room to compute four rows at
+     *  once.
+     */
+    template <bool Antisymmetric, size_t H>
+    __attribute__((target("avx512f")))
+    inline void correlate_block_folded_fixed_avx512(
+            float const *x, float const *w, size_t,
+            float *y, ptrdiff_t y_stride, size_t length)
+    {
+        constexpr ptrdiff_t W = block_width;
+        __m512 wk[H + 1];
+        for (size_t k = 0; k <= H; ++k)
+            wk[k] = _mm512_set1_ps(w[k]);
+
+        size_t i = 0;
+        for (; i + 4 <= length; i += 4)
+        {
+            float const *c = x + (i + H) * W;
+            __m512 a0 = _mm512_mul_ps(_mm512_loadu_ps(c), wk[0]),
+                   a1 = _mm512_mul_ps(_mm512_loadu_ps(c + W), wk[0]),
+                   a2 = _mm512_mul_ps(_mm512_loadu_ps(c + 2 * W), wk[0]),
+                   a3 = _mm512_mul_ps(_mm512_loadu_ps(c + 3 * W), wk[0]);
+            #pragma GCC unroll 16
+            for (size_t k = 1; k <= H; ++k)
+            {
+                float const *l = c - ptrdiff_t(k) * W, *r = c + k * W;
+                __m512 l0 = _mm512_loadu_ps(l),         r0 = _mm512_loadu_ps(r),
+                       l1 = _mm512_loadu_ps(l + W),     r1 = _mm512_loadu_ps(r + W),
+                       l2 = _mm512_loadu_ps(l + 2 * W), r2 = _mm512_loadu_ps(r + 2 * W),
+                       l3 = _mm512_loadu_ps(l + 3 * W), r3 = _mm512_loadu_ps(r + 3 * W);
+                a0 = _mm512_fmadd_ps(Antisymmetric ? _mm512_sub_ps(l0, r0) : _mm512_add_ps(l0, r0), wk[k], a0);
+                a1 = _mm512_fmadd_ps(Antisymmetric ? _mm512_sub_ps(l1, r1) : _mm512_add_ps(l1, r1), wk[k], a1);
+                a2 = _mm512_fmadd_ps(Antisymmetric ? _mm512_sub_ps(l2, r2) : _mm512_add_ps(l2, r2), wk[k], a2);
+                a3 = _mm512_fmadd_ps(Antisymmetric ? _mm512_sub_ps(l3, r3) : _mm512_add_ps(l3, r3), wk[k], a3);
+            }
+            _mm512_storeu_ps(y + i * y_stride, a0);
+            _mm512_storeu_ps(y + (i + 1) * y_stride, a1);
+            _mm512_storeu_ps(y + (i + 2) * y_stride, a2);
+            _mm512_storeu_ps(y + (i + 3) * y_stride, a3);
+        }
+        correlate_block_folded_avx512<Antisymmetric>(
+            x + i * W, w, H, y + i * y_stride, y_stride, length - i);
+    }
+#endif
+
+    /*! \brief Get the folded block kernel with half width `H` for a given
+     *  level.
+     */
+    template <bool Antisymmetric, size_t H>
+    correlate_block_fn correlate_block_folded_fixed_kernel(Level level)
+    {
+#ifdef HYPER_CANNY_X86_SIMD
+        switch (level)
+        {
+            case Level::avx512: return correlate_block_folded_fixed_avx512<Antisymmetric, H>;
+            case Level::avx2:   return correlate_block_folded_fixed_avx2<Antisymmetric, H>;
+            default:            break;
+        }
+#endif
+        return correlate_block_folded_fixed_scalar<Antisymmetric, H, float>;
+    }
+
+    /*! \brief Table of folded block kernels for a given level, indexed by
+     *  half width, up to `max_fixed_half_width`.
+     */
+    template <bool Antisymmetric, size_t... H>
+    std::array<correlate_block_fn, sizeof...(H)> correlate_block_folded_fixed_table(
+            Level level, std::index_sequence<H...>)
+    {
+        return { correlate_block_folded_fixed_kernel<Antisymmetric, H>(level)... };
+    }
+    // }}}2
+
+    /*! \brief Folded block correlation using the best kernel for this CPU.
+     *  Half widths up to `max_fixed_half_width` use a specialised kernel.
+     */
+    template <bool Antisymmetric>
+    void correlate_block_folded(
+            float const *x, float const *w, size_t h,
+            float *y, ptrdiff_t y_stride, size_t length)
+    {
+        static correlate_block_fn const kernel =
+            correlate_block_folded_kernel<Antisymmetric>(level());
+        static auto const fixed = correlate_block_folded_fixed_table<Antisymmetric>(
+            level(), std::make_index_sequence<max_fixed_half_width + 1>());
+
+        (h <= max_fixed_half_width ? fixed[h] : kernel)(
+            x, w, h, y, y_stride, length);
+    }
+
+    template <bool Antisymmetric, typename real_t>
+    void correlate_block_folded(
+            real_t const *x, real_t const *w, size_t h,
+            real_t *y, ptrdiff_t y_stride, size_t length)
+    {
+        correlate_block_folded_scalar<Antisymmetric>(x, w, h, y, y_stride, length);
+    }
+    // }}}1
+}}} // namespace HyperCanny::numeric::simd
+// vim: fdm=marker
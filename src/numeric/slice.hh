@@ -102,6 +102,22 @@ namespace HyperCanny { namespace numeric
                 return Slice<D>(offset, new_shape, new_stride);
             }
 
+            /*! \brief Permute the axes: axis `k` of the result is axis
+             *  `axes[k]` of this slice. `axes` should be a permutation of
+             *  0 .. D-1.
+             */
+            Slice<D> permute(std::array<unsigned, D> const &axes) const
+            {
+                stride_t<D> new_stride;
+                shape_t<D> new_shape;
+                for (unsigned i = 0; i < D; ++i)
+                {
+                    new_stride[i] = stride[axes[i]];
+                    new_shape[i] = shape[axes[i]];
+                }
+                return Slice<D>(offset, new_shape, new_stride);
+            }
+
             /*! \brief Take a sub-section of the slice in one axis.
              */
             template <unsigned axis>
@@ -0,0 +1,220 @@
+/* Copyright 2017 Netherlands eScience Center
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#pragma once
+
+/*! \file numeric/strided_copy.hh
+ *  \brief Parallel copy between two strided slices of the same shape.
+ *
+ *  The axes are put in the order of the destination strides, so that
+ *  the innermost loop writes contiguous memory, and axes that are
+ *  contiguous in both slices are merged. If the source is then also
+ *  contiguous along the innermost axis, rows are copied as they are
+ *  (with `std::copy`, so a memmove between pointers of the same type).
+ *  Otherwise, as after `transpose()` or `permute()`, the plane of the
+ *  innermost axes of destination and source is cut in halves
+ *  recursively until the pieces fit in cache, so that neither side is
+ *  read or written with a stride across more than a tile.
+ *
+ *  Work is spread over OpenMP threads in tiles of that plane and rows of
+ *  the other axes; destinations without contiguous storage
+ *  (`std::vector<bool>`) are written by one thread.
+ */
+
+#include "support.hh"
+#include "slice.hh"
+
+#include <algorithm>
+#include <array>
+#include <cstdlib>
+#include <type_traits>
+
+namespace HyperCanny {
+namespace numeric
+{
+    namespace detail
+    {
+        // elements in a leaf of the recursive copy, side of the tiles
+        // handed to threads, and elements in a row handed to a thread
+        constexpr size_t copy_leaf = 1024;
+        constexpr size_t copy_tile = 256;
+        constexpr size_t copy_row = 1 << 14;
+
+        template <typename OutIt, typename InIt>
+        inline void copy_row_n(
+                OutIt out, ptrdiff_t out_stride,
+                InIt in, ptrdiff_t in_stride, size_t n)
+        {
+            if (out_stride == 1 && in_stride == 1)
+                std::copy(in, in + n, out);
+            else
+                for (size_t i = 0; i < n; ++i)
+                    out[ptrdiff_t(i) * out_stride] = in[ptrdiff_t(i) * in_stride];
+        }
+
+        /*! \brief Copy the rectangle [i0, i1) x [j0, j1) of a plane,
+         *  halving its longer side until it fits in a leaf.
+         */
+        template <typename OutIt, typename InIt>
+        void copy_blocked(
+                OutIt out, ptrdiff_t out_i, ptrdiff_t out_j,
+                InIt in, ptrdiff_t in_i, ptrdiff_t in_j,
+                size_t i0, size_t i1, size_t j0, size_t j1)
+        {
+            size_t ni = i1 - i0, nj = j1 - j0;
+            if (ni * nj <= copy_leaf)
+            {
+                for (size_t j = j0; j < j1; ++j)
+                    copy_row_n(
+                        out + ptrdiff_t(i0) * out_i + ptrdiff_t(j) * out_j, out_i,
+                        in + ptrdiff_t(i0) * in_i + ptrdiff_t(j) * in_j, in_i, ni);
+                return;
+            }
+
+            if (ni >= nj)
+            {
+                size_t mid = i0 + ni / 2;
+                copy_blocked(out, out_i, out_j, in, in_i, in_j, i0, mid, j0, j1);
+                copy_blocked(out, out_i, out_j, in, in_i, in_j, mid, i1, j0, j1);
+            }
+            else
+            {
+                size_t mid = j0 + nj / 2;
+                copy_blocked(out, out_i, out_j, in, in_i, in_j, i0, i1, j0, mid);
+                copy_blocked(out, out_i, out_j, in, in_i, in_j, i0, i1, mid, j1);
+            }
+        }
+    }
+
+    /*! \brief Copy the elements of slice `src` of the storage at
+     *  `src_start` to slice `dst` of the storage at `dst_start`; the
+     *  slices should have the same shape.
+     *
+     *  Elements are matched by index, as when iterating both slices
+     *  together. The storage of source and destination should not
+     *  overlap, unless both slices are the same.
+     */
+    template <unsigned D, typename OutIt, typename InIt>
+    void strided_copy(Slice<D> const &dst, OutIt dst_start,
+                      Slice<D> const &src, InIt src_start)
+    {
+        size_t const size = calc_size<D>(dst.shape);
+        if (size == 0)
+            return;
+
+        // axes of more than one element, the fastest of the destination
+        // first, merged where they continue each other in both slices
+        std::array<unsigned, D> order;
+        unsigned n_axes = 0;
+        for (unsigned k = 0; k < D; ++k)
+            if (dst.shape[k] > 1)
+                order[n_axes++] = k;
+        std::stable_sort(order.begin(), order.begin() + n_axes,
+            [&dst] (unsigned a, unsigned b)
+        {
+            return std::abs(dst.stride[a]) < std::abs(dst.stride[b]);
+        });
+
+        std::array<size_t, D> n;
+        std::array<ptrdiff_t, D> ds, ss;
+        unsigned m = 0;
+        for (unsigned j = 0; j < n_axes; ++j)
+        {
+            unsigned k = order[j];
+            if (m > 0 && dst.stride[k] == ds[m-1] * ptrdiff_t(n[m-1])
+                      && src.stride[k] == ss[m-1] * ptrdiff_t(n[m-1]))
+            {
+                n[m-1] *= dst.shape[k];
+                continue;
+            }
+            n[m] = dst.shape[k];
+            ds[m] = dst.stride[k];
+            ss[m] = src.stride[k];
+            ++m;
+        }
+
+        if (m == 0)
+        {
+            dst_start[dst.offset] = src_start[src.offset];
+            return;
+        }
+
+        // the fastest axis of the source; if it is not the innermost,
+        // the copy is blocked in the plane of the two
+        unsigned t = 0;
+        for (unsigned a = 1; a < m; ++a)
+            if (std::abs(ss[a]) < std::abs(ss[t]))
+                t = a;
+        bool const blocked = (D > 1 && t != 0);
+
+        std::array<size_t, D> on;
+        std::array<ptrdiff_t, D> ods, oss;
+        unsigned n_outer_axes = 0;
+        size_t n_outer = 1;
+        for (unsigned a = 1; a < m && a < D; ++a)
+        {
+            if (blocked && a == t)
+                continue;
+            on[n_outer_axes] = n[a];
+            ods[n_outer_axes] = ds[a];
+            oss[n_outer_axes] = ss[a];
+            ++n_outer_axes;
+            n_outer *= n[a];
+        }
+
+        size_t const side_i = (blocked ? detail::copy_tile : detail::copy_row),
+                     side_j = (blocked ? detail::copy_tile : 1),
+                     nj = (blocked ? n[t] : 1),
+                     tiles_i = (n[0] + side_i - 1) / side_i,
+                     tiles_j = (nj + side_j - 1) / side_j,
+                     n_items = n_outer * tiles_i * tiles_j;
+        ptrdiff_t const ds_j = (blocked ? ds[t] : 0),
+                        ss_j = (blocked ? ss[t] : 0);
+
+        bool const parallel = std::is_pointer<OutIt>::value
+                           && size > detail::copy_row;
+
+        #pragma omp parallel if (parallel)
+        {
+            #pragma omp for nowait
+            for (size_t item = 0; item < n_items; ++item)
+            {
+                size_t q = item;
+                size_t i0 = (q % tiles_i) * side_i;
+                q /= tiles_i;
+                size_t j0 = (q % tiles_j) * side_j;
+                q /= tiles_j;
+
+                ptrdiff_t o = dst.offset, s = src.offset;
+                for (unsigned a = 0; a < n_outer_axes; ++a)
+                {
+                    ptrdiff_t x = q % on[a];
+                    q /= on[a];
+                    o += x * ods[a];
+                    s += x * oss[a];
+                }
+
+                size_t i1 = std::min(n[0], i0 + side_i);
+                if (blocked)
+                    detail::copy_blocked(
+                        dst_start + o, ds[0], ds_j, src_start + s, ss[0], ss_j,
+                        i0, i1, j0, std::min(nj, j0 + side_j));
+                else
+                    detail::copy_row_n(
+                        dst_start + o + ptrdiff_t(i0) * ds[0], ds[0],
+                        src_start + s + ptrdiff_t(i0) * ss[0], ss[0], i1 - i0);
+            }
+        }
+    }
+}} // namespace HyperCanny::numeric
@@ -0,0 +1,451 @@
+/* Copyright 2017 Netherlands eScience Center
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#pragma once
+
+/*! \file numeric/tiled_hysteresis.hh
+ *  \brief Hysteresis on volumes that are processed one tile at a time.
+ *
+ *  The volume is cut into a grid of tiles. Each tile finds the connected
+ *  components of its own weak and strong pixels, and keeps only the
+ *  labels of the pixels on its outer shell, with a flag for each of
+ *  those components that contains a strong pixel. A union-find over the
+ *  shell labels then joins the components that touch across tile faces,
+ *  edges and corners. After that each tile can be resolved on its own
+ *  again: components that never reach the shell are decided locally.
+ *
+ *  Working memory is that of one tile plus the shells of all tiles, and
+ *  both tile passes may run concurrently, on threads or, since a
+ *  `TileSummary` is plain data, in separate processes.
+ */
+
+#include "canny.hh"
+
+#include <map>
+
+namespace HyperCanny {
+namespace numeric {
+namespace filter {
+    namespace detail
+    {
+        /*! \brief Label the connected weak or strong pixels of one tile,
+         *  without following edges out of the tile. Labels are numbered
+         *  from zero in order of their first pixel, other pixels get -1.
+         *
+         *  \return The number of components.
+         */
+        template <unsigned D>
+        size_t label_tile(
+                shape_t<D> const &shape, uint8_t const *classes,
+                std::vector<int32_t> &labels)
+        {
+            constexpr uint8_t none = uint8_t(EdgeClass::none);
+
+            size_t const size = calc_size<D>(shape);
+            DisjointSets<uint32_t> sets(size);
+            connect_neighbours<D>(
+                shape, uniform_boundary<D>(Boundary::zero),
+                [classes] (size_t i) { return classes[i] != none; }, sets);
+
+            // roots are the smallest index of their set, so they are
+            // labelled before any other member
+            labels.assign(size, -1);
+            int32_t n = 0;
+            for (size_t i = 0; i < size; ++i)
+            {
+                if (classes[i] == none)
+                    continue;
+                uint32_t root = sets.find(uint32_t(i));
+                labels[i] = (root == i ? n++ : labels[root]);
+            }
+            return size_t(n);
+        }
+    }
+
+    /*! \brief What one tile contributes to the merge of tiles.
+     */
+    struct TileSummary
+    {
+        std::vector<int32_t> shell;   /*!< Face label of each shell pixel,
+                                           in order of flat index in the
+                                           tile; -1 where there is no edge. */
+        std::vector<uint8_t> strong;  /*!< For each face label, whether its
+                                           component has a strong pixel. */
+    };
+
+    /*! \brief Hysteresis in tiles.
+     *
+     *  Usage: for each tile `t`, compute the `EdgeClass` of its pixels,
+     *  in a contiguous array of shape `tile_shape(t)`, and pass
+     *  `summarise(t, classes)` to `add()`. Once every tile is added, call
+     *  `merge()`. Then for each tile, compute the classes again and call
+     *  `resolve()` to get its part of the result. Both loops over tiles
+     *  may run in parallel; `merge()` may not overlap with either.
+     *
+     *  The result is the same as that of `double_threshold()` on the
+     *  whole volume, with `lower` not above `upper`.
+     */
+    template <unsigned D>
+    class TiledHysteresis
+    {
+        /*! Shell pixels of a tile shape; tiles on the far edges of the
+         *  volume may be smaller, so there are at most 2^D shapes.
+         */
+        struct Shell
+        {
+            std::vector<size_t> pixels;
+            std::vector<int32_t> position;
+        };
+
+        shape_t<D> m_shape, m_tile_shape;
+        boundary_t<D> m_boundary;
+        Slice<D> m_grid;
+        std::map<shape_t<D>, Shell> m_shells;
+        std::vector<TileSummary> m_summaries;
+        std::vector<uint8_t> m_added;
+        std::vector<size_t> m_first;
+        std::vector<uint8_t> m_keep;
+
+        Shell const &shell(size_t t) const
+        {
+            return m_shells.find(tile_shape(t))->second;
+        }
+
+        /*! Number the local components that reach the shell, in order of
+         *  their first shell pixel. Returns the number of face labels.
+         */
+        int32_t face_labels(
+                Shell const &s, std::vector<int32_t> const &labels,
+                size_t n, std::vector<int32_t> &face) const
+        {
+            face.assign(n, -1);
+            int32_t n_face = 0;
+            for (size_t i : s.pixels)
+                if (labels[i] >= 0 && face[labels[i]] < 0)
+                    face[labels[i]] = n_face++;
+            return n_face;
+        }
+
+        public:
+            TiledHysteresis(
+                    shape_t<D> const &shape, shape_t<D> const &tile_shape,
+                    boundary_t<D> const &boundary = uniform_boundary<D>())
+                : m_shape(shape)
+                , m_tile_shape(tile_shape)
+                , m_boundary(boundary)
+            {
+                shape_t<D> n_tiles;
+                for (unsigned k = 0; k < D; ++k)
+                {
+                    if (tile_shape[k] == 0)
+                        throw Exception("Tiles should not be empty.");
+                    n_tiles[k] = (shape[k] + tile_shape[k] - 1) / tile_shape[k];
+                }
+                if (calc_size<D>(tile_shape) > size_t(std::numeric_limits<int32_t>::max()))
+                    throw Exception("Tiles too large for 32-bit labels.");
+
+                m_grid = Slice<D>(n_tiles);
+                m_summaries.resize(m_grid.size);
+                m_added.assign(m_grid.size, 0);
+
+                for (size_t t = 0; t < m_grid.size; ++t)
+                {
+                    shape_t<D> extent = this->tile_shape(t);
+                    if (m_shells.count(extent))
+                        continue;
+
+                    Slice<D> tile(extent);
+                    Shell &s = m_shells[extent];
+                    s.position.assign(tile.size, -1);
+                    for (size_t i = 0; i < tile.size; ++i)
+                    {
+                        shape_t<D> x = tile.index(i);
+                        for (unsigned k = 0; k < D; ++k)
+                            if (x[k] == 0 || x[k] + 1 == extent[k])
+                            {
+                                s.position[i] = int32_t(s.pixels.size());
+                                s.pixels.push_back(i);
+                                break;
+                            }
+                    }
+                }
+            }
+
+            size_t n_tiles() const { return m_grid.size; }
+
+            /*! \brief Index of the first pixel of tile `t` in the volume.
+             */
+            shape_t<D> tile_origin(size_t t) const
+            {
+                shape_t<D> x = m_grid.index(t);
+                for (unsigned k = 0; k < D; ++k)
+                    x[k] *= m_tile_shape[k];
+                return x;
+            }
+
+            /*! \brief Shape of tile `t`, cut short at the far edges.
+             */
+            shape_t<D> tile_shape(size_t t) const
+            {
+                shape_t<D> origin = tile_origin(t), extent;
+                for (unsigned k = 0; k < D; ++k)
+                    extent[k] = std::min(m_tile_shape[k], m_shape[k] - origin[k]);
+                return extent;
+            }
+
+            /*! \brief First pass over tile `t`.
+             *
+             *  \param classes An `EdgeClass` for each pixel of the tile.
+             */
+            TileSummary summarise(size_t t, uint8_t const *classes) const
+            {
+                constexpr uint8_t strong = uint8_t(EdgeClass::strong);
+
+                Shell const &s = shell(t);
+                std::vector<int32_t> labels, face;
+                size_t n = detail::label_tile<D>(tile_shape(t), classes, labels);
+                int32_t n_face = face_labels(s, labels, n, face);
+
+                TileSummary result;
+                result.shell.resize(s.pixels.size());
+                for (size_t j = 0; j < s.pixels.size(); ++j)
+                {
+                    int32_t l = labels[s.pixels[j]];
+                    result.shell[j] = (l < 0 ? -1 : face[l]);
+                }
+
+                result.strong.assign(n_face, 0);
+                for (size_t i = 0; i < labels.size(); ++i)
+                    if (classes[i] == strong && face[labels[i]] >= 0)
+                        result.strong[face[labels[i]]] = 1;
+                return result;
+            }
+
+            /*! \brief Store the summary of tile `t`. Different tiles may
+             *  be added concurrently.
+             */
+            void add(size_t t, TileSummary summary)
+            {
+                if (summary.shell.size() != shell(t).pixels.size())
+                    throw Exception("Summary does not match the shape of the tile.");
+                m_summaries[t] = std::move(summary);
+                m_added[t] = 1;
+            }
+
+            /*! \brief Join the face labels of neighbouring tiles and decide
+             *  which ones are kept. Summaries are released afterwards.
+             */
+            void merge()
+            {
+                size_t const n = m_grid.size;
+                if (std::find(m_added.begin(), m_added.end(), 0) != m_added.end())
+                    throw Exception("Not all tiles have been summarised.");
+
+                m_first.assign(n + 1, 0);
+                for (size_t t = 0; t < n; ++t)
+                    m_first[t + 1] = m_first[t] + m_summaries[t].strong.size();
+
+                size_t const n_nodes = m_first[n];
+                detail::DisjointSets<size_t> sets(n_nodes);
+                for (size_t i = 0; i < n_nodes; ++i)
+                    sets.make_set(i);
+
+                shape_t<D> three;
+                three.fill(3);
+                Slice<D> const window(three);
+
+                for (size_t t = 0; t < n; ++t)
+                {
+                    Shell const &s = shell(t);
+                    shape_t<D> const origin = tile_origin(t),
+                                     extent = tile_shape(t);
+                    Slice<D> const tile(extent);
+
+                    for (size_t j = 0; j < s.pixels.size(); ++j)
+                    {
+                        int32_t l = m_summaries[t].shell[j];
+                        if (l < 0)
+                            continue;
+                        shape_t<D> const x = tile.index(s.pixels[j]);
+
+                        for (size_t w = 0; w < window.size; ++w)
+                        {
+                            shape_t<D> d = window.index(w);
+                            bool inside = true, outside = false;
+                            shape_t<D> q;
+                            for (unsigned k = 0; k < D && !outside; ++k)
+                            {
+                                ptrdiff_t y = ptrdiff_t(x[k] + d[k]) - 1;
+                                inside &= (y >= 0 && y < ptrdiff_t(extent[k]));
+                                ptrdiff_t g = boundary_index(
+                                    m_boundary[k], ptrdiff_t(origin[k]) + y, m_shape[k]);
+                                outside = (g < 0);
+                                q[k] = size_t(g);
+                            }
+                            // neighbours inside the tile are already joined
+                            if (inside || outside)
+                                continue;
+
+                            shape_t<D> v;
+                            for (unsigned k = 0; k < D; ++k)
+                                v[k] = q[k] / m_tile_shape[k];
+                            size_t u = m_grid.flat_index(v);
+                            shape_t<D> const other = tile_origin(u);
+                            for (unsigned k = 0; k < D; ++k)
+                                q[k] -= other[k];
+
+                            int32_t p = shell(u).position[
+                                Slice<D>(tile_shape(u)).flat_index(q)];
+                            int32_t m = m_summaries[u].shell[p];
+                            if (m >= 0)
+                                sets.unite(m_first[t] + l, m_first[u] + m);
+                        }
+                    }
+                }
+
+                std::vector<uint8_t> strong(n_nodes, 0);
+                for (size_t t = 0; t < n; ++t)
+                    for (size_t l = 0; l < m_summaries[t].strong.size(); ++l)
+                        if (m_summaries[t].strong[l])
+                            strong[sets.find(m_first[t] + l)] = 1;
+
+                m_keep.resize(n_nodes);
+                for (size_t i = 0; i < n_nodes; ++i)
+                    m_keep[i] = strong[sets.find(i)];
+
+                m_summaries.clear();
+                m_summaries.shrink_to_fit();
+            }
+
+            /*! \brief Second pass over tile `t`, after `merge()`. Different
+             *  tiles may be resolved concurrently.
+             *
+             *  \param classes The same classes that were summarised.
+             *  \param output One byte for each pixel of the tile, set to 1
+             *  for the edges that pass and 0 elsewhere.
+             */
+            void resolve(size_t t, uint8_t const *classes, uint8_t *output) const
+            {
+                constexpr uint8_t strong = uint8_t(EdgeClass::strong);
+
+                if (m_first.empty() || m_keep.size() != m_first.back())
+                    throw Exception("Tiles should be merged before they are resolved.");
+
+                std::vector<int32_t> labels, face;
+                size_t n = detail::label_tile<D>(tile_shape(t), classes, labels);
+                face_labels(shell(t), labels, n, face);
+
+                // components inside the tile only need a strong pixel
+                std::vector<uint8_t> keep(n, 0);
+                for (size_t i = 0; i < labels.size(); ++i)
+                    if (classes[i] == strong)
+                        keep[labels[i]] = 1;
+                for (size_t l = 0; l < n; ++l)
+                    if (face[l] >= 0)
+                        keep[l] = m_keep[m_first[t] + face[l]];
+
+                for (size_t i = 0; i < labels.size(); ++i)
+                    output[i] = (labels[i] >= 0 && keep[labels[i]]);
+            }
+    };
+
+    /*! \brief Apply the double threshold of `double_threshold()` tile by
+     *  tile, with tiles running in parallel. The result is the same, for
+     *  `lower` not above `upper`; this mainly shows how `TiledHysteresis`
+     *  is driven when the tiles are read from disk instead.
+     *
+     *  \param tile_shape Shape of the tiles.
+     *  \param output Byte mask of the same shape as `mask`, overwritten
+     *  with the result.
+     */
+    template <typename Input, typename Mask, unsigned D, typename Container>
+    void tiled_double_threshold(
+            Input const &input, Mask const &mask, double lower, double upper,
+            shape_t<array_traits<Input>::dimension - 1> const &tile_shape,
+            EdgeMask<D, uint8_t, Container> &output,
+            boundary_t<array_traits<Input>::dimension - 1> const &boundary =
+                uniform_boundary<array_traits<Input>::dimension - 1>())
+    {
+        using real_t = compute_t<typename array_traits<Input>::value_type>;
+        static_assert(array_traits<Input>::dimension == D + 1,
+                      "Input should have one more dimension than the mask.");
+
+        if (reduce_one(input.shape(), 0) != mask.shape()
+                || output.shape() != mask.shape())
+            throw Exception("Shapes of input and mask do not match.");
+        if (lower > upper)
+            throw Exception("Tiled hysteresis needs `lower` not above `upper`.");
+
+        Slice<D> const spatial = input.slice().sel(0, 0);
+        ptrdiff_t const component = input.slice().stride[0];
+        auto const *data = input.const_container().data() + D * component;
+        Slice<D> const grid(spatial.shape);
+        TiledHysteresis<D> tiles(grid.shape, tile_shape, boundary);
+
+        auto for_each_pixel = [&] (size_t t, auto f)
+        {
+            shape_t<D> const origin = tiles.tile_origin(t);
+            Slice<D> const tile(tiles.tile_shape(t));
+            for (size_t i = 0; i < tile.size; ++i)
+            {
+                shape_t<D> x = tile.index(i);
+                for (unsigned k = 0; k < D; ++k)
+                    x[k] += origin[k];
+                f(i, grid.flat_index(x), spatial.flat_index(x));
+            }
+        };
+
+        auto classify = [&] (size_t t, std::vector<uint8_t> &classes)
+        {
+            classes.resize(calc_size<D>(tiles.tile_shape(t)));
+            for_each_pixel(t, [&] (size_t i, size_t j, size_t s)
+            {
+                real_t value = data[s];
+                classes[i] = uint8_t(!mask[j] ? EdgeClass::none
+                    : (value <= lower ? EdgeClass::strong
+                    : (value <= upper ? EdgeClass::weak : EdgeClass::none)));
+            });
+        };
+
+        size_t const n_tiles = tiles.n_tiles();
+        #pragma omp parallel
+        {
+            std::vector<uint8_t> classes;
+            #pragma omp for schedule(dynamic) nowait
+            for (size_t t = 0; t < n_tiles; ++t)
+            {
+                classify(t, classes);
+                tiles.add(t, tiles.summarise(t, classes.data()));
+            }
+        }
+
+        tiles.merge();
+
+        #pragma omp parallel
+        {
+            std::vector<uint8_t> classes, result;
+            #pragma omp for schedule(dynamic) nowait
+            for (size_t t = 0; t < n_tiles; ++t)
+            {
+                classify(t, classes);
+                result.resize(classes.size());
+                tiles.resolve(t, classes.data(), result.data());
+                for_each_pixel(t, [&] (size_t i, size_t j, size_t)
+                {
+                    output.bytes()[j] = result[i];
+                });
+            }
+        }
+    }
+}}} // namespace HyperCanny::numeric::filter
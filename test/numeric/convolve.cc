@@ -15,9 +15,25 @@
 #include <gtest/gtest.h>
 
 #include "numeric/convolution.hh"
+#include "numeric/filters.hh"
+
+#include <random>
+#include <functional>
 
 using namespace HyperCanny;
 
+template <typename T1, typename T2>
+inline void assert_array_near(T1 const &a, T2 const &b, double eps=1e-5)
+{
+    ASSERT_EQ(a.shape(), b.shape()) << "arrays should have same shape.";
+
+    auto ai = a.begin();
+    for (auto bi = b.begin(); bi != b.end(); ++bi, ++ai)
+    {
+        ASSERT_NEAR(*ai, *bi, eps);
+    }
+}
+
 TEST (Algorithms, Convolution)
 {
     using numeric::NdArray;
@@ -43,3 +59,332 @@ TEST (Algorithms, Convolution)
 
     ASSERT_EQ(convolve(a, k), expected);
 }
+
+TEST (Algorithms, Convolution1D)
+{
+    using numeric::NdArray;
+    using numeric::convolve;
+    using numeric::convolve_1d;
+
+    auto noise = std::bind(
+        std::normal_distribution<float>(0.0, 1.0), std::mt19937());
+
+    // 37 = 2 full blocks of 16 lines along the first axis, and 5 more.
+    NdArray<float,3> a({37, 7, 5});
+    std::generate(a.begin(), a.end(), noise);
+
+    // the last kernel is longer than the shortest axis, so it wraps more
+    // than once.
+    std::vector<std::vector<float>> kernels = {
+        { 0.5, 0.0, -0.5 },
+        { 0.1, 0.2, 0.4, -0.3, 0.7 },
+        { 0.3, -0.1, 0.2, 0.5, 0.1, -0.6, 0.9, 0.4, -0.2 } };
+
+    for (auto const &taps : kernels)
+    {
+        NdArray<float,1> k({taps.size()});
+        std::copy(taps.begin(), taps.end(), k.begin());
+
+        for (unsigned axis = 0; axis < 3; ++axis)
+        {
+            numeric::shape_t<3> kernel_shape = {1, 1, 1};
+            kernel_shape[axis] = taps.size();
+            NdArray<float,3> k3(kernel_shape);
+            std::copy(taps.begin(), taps.end(), k3.begin());
+
+            auto expected = convolve(a, k3);
+            auto result = convolve_1d(a, k, axis);
+            assert_array_near(result, expected);
+
+            // strided input and output
+            NdArray<float,3> b({5, 7, 37});
+            b.transpose() = a;
+            NdArray<float,3> c({5, 7, 37});
+            auto c_view = c.transpose();
+            convolve_1d(b.transpose(), k, c_view, axis);
+            assert_array_near(c_view, expected);
+        }
+    }
+}
+
+TEST (Algorithms, SimdCorrelate)
+{
+    namespace simd = numeric::simd;
+
+    auto noise = std::bind(
+        std::normal_distribution<float>(0.0, 1.0), std::mt19937());
+
+    // lengths chosen to exercise the unrolled, single vector and
+    // remainder loops of each kernel.
+    for (size_t length : {1, 7, 29, 100, 1001})
+    {
+        for (size_t n : {3, 13, 19})
+        {
+            std::vector<float> x(length + n - 1), taps(n),
+                               expected(length), result(length);
+            std::generate(x.begin(), x.end(), noise);
+            std::generate(taps.begin(), taps.end(), noise);
+            simd::correlate_scalar(
+                x.data(), taps.data(), n, expected.data(), length);
+
+            for (int l = 0; l <= int(simd::level()); ++l)
+            {
+                auto level = static_cast<simd::Level>(l);
+                simd::correlate_kernel(level)(
+                    x.data(), taps.data(), n, result.data(), length);
+
+                // without fused multiply-add the results are bit-exact.
+                if (level <= simd::Level::sse4)
+                    ASSERT_EQ(result, expected) << simd::name(level);
+                else
+                    for (size_t i = 0; i < length; ++i)
+                        ASSERT_NEAR(result[i], expected[i], 1e-5 * n)
+                            << simd::name(level);
+            }
+
+            // folded kernels, checked against the unfolded scalar kernel
+            size_t h = n / 2;
+            std::vector<float> w(h + 1), sym_taps(n), anti_taps(n),
+                               sym_expected(length), anti_expected(length),
+                               sym_result(length), anti_result(length);
+            std::generate(w.begin(), w.end(), noise);
+            std::vector<float> anti_w(w);
+            anti_w[0] = 0.0;
+            for (size_t k = 0; k <= h; ++k)
+            {
+                sym_taps[h - k] = sym_taps[h + k] = w[k];
+                anti_taps[h - k] = w[k];
+                anti_taps[h + k] = -w[k];
+            }
+            anti_taps[h] = 0.0;
+            simd::correlate_scalar(
+                x.data(), sym_taps.data(), n, sym_expected.data(), length);
+            simd::correlate_scalar(
+                x.data(), anti_taps.data(), n, anti_expected.data(), length);
+
+            for (int l = 0; l <= int(simd::level()); ++l)
+            {
+                auto level = static_cast<simd::Level>(l);
+                simd::correlate_folded_kernel<false>(level)(
+                    x.data(), w.data(), h, sym_result.data(), length);
+                simd::correlate_folded_kernel<true>(level)(
+                    x.data(), anti_w.data(), h, anti_result.data(), length);
+
+                for (size_t i = 0; i < length; ++i)
+                {
+                    ASSERT_NEAR(sym_result[i], sym_expected[i], 1e-5 * n)
+                        << simd::name(level);
+                    ASSERT_NEAR(anti_result[i], anti_expected[i], 1e-5 * n)
+                        << simd::name(level);
+                }
+            }
+        }
+    }
+}
+
+TEST (Algorithms, SimdCorrelateBlock)
+{
+    namespace simd = numeric::simd;
+    constexpr unsigned W = simd::block_width;
+
+    auto noise = std::bind(
+        std::normal_distribution<float>(0.0, 1.0), std::mt19937());
+
+    for (size_t length : {1, 6, 31})
+    {
+        for (size_t n : {3, 13})
+        {
+            size_t h = n / 2;
+            std::vector<float> x(W * (length + n - 1)), taps(n), w(h + 1),
+                               expected(W * length), result(W * length),
+                               folded_expected(W * length);
+            std::generate(x.begin(), x.end(), noise);
+            std::generate(w.begin(), w.end(), noise);
+            for (size_t k = 0; k <= h; ++k)
+                taps[h - k] = taps[h + k] = w[k];
+
+            simd::correlate_block_scalar(
+                x.data(), taps.data(), n, expected.data(), W, length);
+            simd::correlate_block_folded_scalar<false>(
+                x.data(), w.data(), h, folded_expected.data(), W, length);
+
+            for (size_t i = 0; i < length; ++i)
+                for (unsigned b = 0; b < W; ++b)
+                {
+                    float line = 0;
+                    for (size_t j = 0; j < n; ++j)
+                        line += x[(i + j) * W + b] * taps[j];
+                    ASSERT_EQ(expected[i * W + b], line);
+                    ASSERT_NEAR(folded_expected[i * W + b], line, 1e-5 * n);
+                }
+
+            for (int l = 0; l <= int(simd::level()); ++l)
+            {
+                auto level = static_cast<simd::Level>(l);
+                simd::correlate_block_kernel(level)(
+                    x.data(), taps.data(), n, result.data(), W, length);
+                for (size_t i = 0; i < W * length; ++i)
+                    ASSERT_NEAR(result[i], expected[i], 1e-5 * n)
+                        << simd::name(level);
+
+                simd::correlate_block_folded_kernel<false>(level)(
+                    x.data(), w.data(), h, result.data(), W, length);
+                for (size_t i = 0; i < W * length; ++i)
+                    ASSERT_NEAR(result[i], expected[i], 1e-5 * n)
+                        << simd::name(level);
+            }
+        }
+    }
+}
+
+TEST (Algorithms, SimdCorrelateFixedWidth)
+{
+    namespace simd = numeric::simd;
+    constexpr unsigned W = simd::block_width;
+    constexpr size_t N = simd::max_fixed_half_width + 1;
+
+    auto noise = std::bind(
+        std::normal_distribution<float>(0.0, 1.0), std::mt19937());
+
+    size_t length = 37;
+    for (int l = 0; l <= int(simd::level()); ++l)
+    {
+        auto level = static_cast<simd::Level>(l);
+        auto line = simd::correlate_folded_fixed_table<true>(
+            level, std::make_index_sequence<N>());
+        auto block = simd::correlate_block_folded_fixed_table<true>(
+            level, std::make_index_sequence<N>());
+
+        for (size_t h = 0; h < N; ++h)
+        {
+            std::vector<float> x(W * (length + 2 * h)), w(h + 1),
+                               expected(W * length), result(W * length);
+            std::generate(x.begin(), x.end(), noise);
+            std::generate(w.begin(), w.end(), noise);
+
+            simd::correlate_folded_kernel<true>(level)(
+                x.data(), w.data(), h, expected.data(), length);
+            line[h](x.data(), w.data(), h, result.data(), length);
+            for (size_t i = 0; i < length; ++i)
+                ASSERT_NEAR(result[i], expected[i], 1e-5 * (h + 1))
+                    << simd::name(level) << " h = " << h;
+
+            simd::correlate_block_folded_kernel<true>(level)(
+                x.data(), w.data(), h, expected.data(), W, length);
+            block[h](x.data(), w.data(), h, result.data(), W, length);
+            for (size_t i = 0; i < W * length; ++i)
+                ASSERT_NEAR(result[i], expected[i], 1e-5 * (h + 1))
+                    << simd::name(level) << " h = " << h;
+        }
+    }
+}
+
+TEST (Algorithms, KernelParity)
+{
+    using numeric::NdArray;
+    using numeric::LineKernel;
+    using numeric::Parity;
+    namespace filter = numeric::filter;
+
+    auto G = filter::gaussian_kernel<float>(5, 2.4);
+    auto smooth = numeric::convolve_padding_zero(
+            NdArray<float, 1>({3}, {0.25, 0.50, 0.25}), G);
+    auto gradient = numeric::convolve_padding_zero(
+            NdArray<float, 1>({3}, {0.5, 0.0, -0.5}), G);
+    NdArray<float, 1> skewed({3}, {0.2, 0.5, 0.3});
+
+    EXPECT_EQ(LineKernel<float>(G).parity(), Parity::symmetric);
+    EXPECT_EQ(LineKernel<float>(smooth).parity(), Parity::symmetric);
+    EXPECT_EQ(LineKernel<float>(gradient).parity(), Parity::antisymmetric);
+    EXPECT_EQ(LineKernel<float>(skewed).parity(), Parity::general);
+
+    // the padded kernels have a trailing zero, which is dropped.
+    EXPECT_EQ(smooth.size(), 14u);
+    EXPECT_EQ(LineKernel<float>(smooth).size(), 13u);
+    EXPECT_EQ(LineKernel<float>(smooth).left(), 6u);
+
+    // folded and unfolded convolution give the same result
+    auto noise = std::bind(
+        std::normal_distribution<float>(0.0, 1.0), std::mt19937());
+    NdArray<float, 2> a({37, 23});
+    std::generate(a.begin(), a.end(), noise);
+
+    for (auto const *k : {&G, &smooth, &gradient})
+    {
+        NdArray<float, 2> k2({1, k->size()});
+        std::copy(k->begin(), k->end(), k2.begin());
+        auto expected = numeric::convolve(a, k2);
+
+        NdArray<float, 2> result(a.shape());
+        numeric::convolve_1d(a, LineKernel<float>(*k), result, 1);
+        assert_array_near(result, expected);
+        numeric::convolve_1d(a, LineKernel<float>(*k, Parity::general), result, 1);
+        assert_array_near(result, expected);
+    }
+}
+
+TEST (Algorithms, BoundaryModes)
+{
+    using numeric::NdArray;
+    using numeric::Boundary;
+    using numeric::boundary_t;
+    using numeric::convolve;
+    using numeric::convolve_1d;
+
+    std::vector<Boundary> modes = {
+        Boundary::periodic, Boundary::reflect,
+        Boundary::nearest, Boundary::zero };
+
+    // sum of three neighbours on a short line
+    NdArray<float,1> line({4}, {1, 2, 3, 4}), box({3}, {1, 1, 1});
+    std::vector<NdArray<float,1>> expected = {
+        NdArray<float,1>({4}, {7, 6, 9, 8}),
+        NdArray<float,1>({4}, {4, 6, 9, 11}),
+        NdArray<float,1>({4}, {4, 6, 9, 11}),
+        NdArray<float,1>({4}, {3, 6, 9, 7}) };
+
+    for (unsigned m = 0; m < modes.size(); ++m)
+    {
+        assert_array_near(convolve(line, box, boundary_t<1>{modes[m]}),
+                          expected[m]);
+        assert_array_near(convolve_1d(line, box, 0, modes[m]), expected[m]);
+    }
+
+    // reflection continues beyond the length of the axis
+    EXPECT_EQ(numeric::boundary_index(Boundary::reflect, -5, 4), 3);
+    EXPECT_EQ(numeric::boundary_index(Boundary::reflect, 9, 4), 1);
+    EXPECT_EQ(numeric::boundary_index(Boundary::periodic, -5, 4), 3);
+    EXPECT_EQ(numeric::boundary_index(Boundary::zero, 4, 4), -1);
+
+    // a separable kernel gives the same result as two one dimensional
+    // passes, for any combination of modes; 37 lines along the first
+    // axis make 2 full blocks and 5 more.
+    auto noise = std::bind(
+        std::normal_distribution<float>(0.0, 1.0), std::mt19937());
+    NdArray<float,2> a({37, 11});
+    std::generate(a.begin(), a.end(), noise);
+
+    std::vector<float> u = { 0.1, 0.2, 0.4, -0.3, 0.7 },
+                       v = { 0.3, -0.1, 0.2 };
+    NdArray<float,1> ku({5}), kv({3});
+    std::copy(u.begin(), u.end(), ku.begin());
+    std::copy(v.begin(), v.end(), kv.begin());
+    NdArray<float,2> k2({5, 3});
+    for (unsigned i = 0; i < 5; ++i)
+        for (unsigned j = 0; j < 3; ++j)
+            k2[i + 5 * j] = u[i] * v[j];
+
+    for (Boundary m0 : modes)
+        for (Boundary m1 : modes)
+        {
+            auto expected = convolve(a, k2, boundary_t<2>{m0, m1});
+            auto result = convolve_1d(a, ku, 0, m0);
+            convolve_1d(result, kv, result, 1, m1);
+            assert_array_near(result, expected);
+
+            // along the second axis lines are convolved in blocks
+            result = convolve_1d(a, kv, 1, m1);
+            convolve_1d(result, ku, result, 0, m0);
+            assert_array_near(result, expected);
+        }
+}
@@ -0,0 +1,82 @@
+/* Copyright 2017 Netherlands eScience Center
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#include <gtest/gtest.h>
+
+#include "numeric/edge_mask.hh"
+#include "numeric/ndarray.hh"
+#include "base/pointer_range.hh"
+
+#include <random>
+#include <functional>
+
+using namespace HyperCanny;
+
+TEST (EdgeMask, Storage)
+{
+    using numeric::EdgeMask;
+    using numeric::PackedEdgeMask;
+
+    // 13 * 11 = 143 pixels, so the packed mask ends in a partial word
+    auto coin = std::bind(std::bernoulli_distribution(0.3), std::mt19937(5));
+    numeric::NdArray<bool, 2> reference({13, 11});
+    std::generate(reference.begin(), reference.end(), coin);
+
+    auto bytes = EdgeMask<2>::from(reference);
+    auto packed = PackedEdgeMask<2>::from(reference);
+    size_t count = std::count(reference.begin(), reference.end(), true);
+    EXPECT_EQ(bytes, reference);
+    EXPECT_EQ(packed, reference);
+    EXPECT_EQ(bytes.count(), count);
+    EXPECT_EQ(packed.count(), count);
+    EXPECT_EQ(packed.n_words(), 3u);
+
+    // packing from bytes at an unaligned offset
+    PackedEdgeMask<2> assigned(reference.shape());
+    assigned.assign(0, bytes.bytes(), 5);
+    assigned.assign(5, bytes.bytes() + 5, 138);
+    EXPECT_EQ(assigned, reference);
+
+    // bits beyond the last pixel stay clear
+    PackedEdgeMask<2> full(reference.shape(), true);
+    EXPECT_EQ(full.count(), 143u);
+    full |= packed;
+    EXPECT_EQ(full.count(), 143u);
+    full &= packed;
+    EXPECT_EQ(full, reference);
+
+    EdgeMask<2> inverse(reference.shape(), true);
+    for (size_t i = 0; i < inverse.size(); ++i)
+        inverse.set(i, !reference[i]);
+    EXPECT_FALSE((EdgeMask<2>(bytes) &= inverse).any());
+    EXPECT_EQ((EdgeMask<2>(bytes) |= inverse).count(), 143u);
+
+    // owned ranges cover the mask in whole words; the last part is empty
+    size_t end = 0;
+    for (size_t part = 0; part < 4; ++part)
+    {
+        auto range = packed.owned_range(part, 4);
+        EXPECT_EQ(range.first, end);
+        EXPECT_TRUE(range.first % 64 == 0 || range.first == range.second);
+        end = range.second;
+    }
+    EXPECT_EQ(end, 143u);
+
+    // wrapping memory owned by someone else
+    std::vector<uint64_t> words(3, 0);
+    EdgeMask<2, uint64_t, pointer_range<uint64_t>> view(
+        reference.shape(), pointer_range<uint64_t>(words.data(), words.size()));
+    view.set(70);
+    EXPECT_EQ(words[1], uint64_t(1) << 6);
+}
@@ -0,0 +1,99 @@
+/* Copyright 2017 Netherlands eScience Center
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#include "base.hh"
+#include "numeric/expression.hh"
+
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <numeric>
+#include <random>
+
+using namespace HyperCanny;
+
+TEST (Expression, Arithmetic)
+{
+    using numeric::NdArray;
+
+    auto noise = std::bind(
+        std::normal_distribution<float>(0.0, 1.0), std::mt19937(29));
+    NdArray<float, 3> a({70, 30, 20}), b(a.shape()), c(a.shape()), x(a.shape());
+    std::generate(a.begin(), a.end(), noise);
+    std::generate(b.begin(), b.end(), noise);
+    std::generate(c.begin(), c.end(), noise);
+
+    x = a * b + c;
+    for (size_t i = 0; i < x.size(); ++i)
+        ASSERT_EQ(x[i], a[i] * b[i] + c[i]);
+
+    // scalars on either side, in place, unary minus and map
+    float mean = 0.5f, sigma = 2.0f;
+    x = (x - mean) / sigma;
+    for (size_t i = 0; i < x.size(); ++i)
+        ASSERT_EQ(x[i], ((a[i] * b[i] + c[i]) - mean) / sigma);
+
+    auto y = numeric::evaluate(2.0f - -a * 3);
+    for (size_t i = 0; i < y.size(); ++i)
+        ASSERT_EQ(y[i], 2.0f - (-a[i]) * 3);
+
+    y = numeric::map([] (float v) { return std::abs(v); }, a - b);
+    for (size_t i = 0; i < y.size(); ++i)
+        ASSERT_EQ(y[i], std::abs(a[i] - b[i]));
+
+    NdArray<float, 3> wrong({30, 70, 20});
+    EXPECT_THROW(a + wrong, Exception);
+}
+
+TEST (Expression, Views)
+{
+    using numeric::NdArray;
+
+    NdArray<int, 3> a({8, 8, 8}), b(a.shape());
+    std::iota(a.begin(), a.end(), 0);
+    std::iota(b.begin(), b.end(), 1000);
+
+    // each result is compared with an element-wise copy through iterators
+    auto check = [] (auto target, auto const &expected)
+    {
+        EXPECT_TRUE(std::equal(target.cbegin(), target.cend(), expected.cbegin()));
+    };
+
+    NdArray<int, 3> x(a.shape(), 0);
+    x = a.transpose() + b;
+    NdArray<int, 3> t = a.transpose().copy();
+    check(x, numeric::evaluate(t + b));
+
+    x.sub<0>(2, 6) = a.sub<0>(0, 4) * 2 - b.sub<0>(4, 8).reverse<1>();
+    for (size_t i = 0; i < 4; ++i)
+        for (size_t j = 0; j < 8; ++j)
+            for (size_t k = 0; k < 8; ++k)
+                ASSERT_EQ((x[{i + 2, j, k}]),
+                          (a[{i, j, k}] * 2 - b[{i + 4, 7 - j, k}]));
+
+    NdArray<int, 2> s({8, 8});
+    s = a.sel<1>(3) - a.sel<2>(5) / 2;
+    for (size_t i = 0; i < 8; ++i)
+        for (size_t k = 0; k < 8; ++k)
+            ASSERT_EQ((s[{i, k}]), (a[{i, 3, k}] - a[{i, k, 5}] / 2));
+
+    // sixteen bit storage computes in float
+    NdArray<float, 3> f(a.shape());
+    f = a * 0.25f;
+    NdArray<numeric::half, 3> h(a.shape());
+    h = f * f;
+    for (size_t i = 0; i < h.size(); ++i)
+        ASSERT_EQ(float(h[i]), float(numeric::half(f[i] * f[i])));
+}
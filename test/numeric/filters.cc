@@ -19,6 +19,9 @@
 #include "base.hh"
 #include "save_png.hh"
 #include "numeric/canny.hh"
+#include "numeric/tiled_hysteresis.hh"
+#include "numeric/hysteresis_index.hh"
+#include "numeric/quantized_sobel.hh"
 #include "numeric/rfft.hh"
 #include "numeric/support.hh"
 
@@ -205,3 +208,665 @@ TEST (Filters, Sobel3D)
     ASSERT_NEAR(r2.std(), fft_data.real_space().std(), 1e-4);
     assert_array_equal(r2, fft_data.real_space());
 }
+
+TEST (Filters, RecursiveGaussian)
+{
+    using numeric::NdArray;
+    namespace filter = numeric::filter;
+    using filter::GaussianMethod;
+
+    auto noise = std::bind(
+        std::normal_distribution<double>(0.0, 1.0), std::mt19937());
+
+    NdArray<double, 3>
+        a1({37, 20, 19});
+    std::generate(a1.begin(), a1.end(), noise);
+
+    auto b1 = filter::gaussian(a1, 0, 3.0, GaussianMethod::recursive);
+    ASSERT_NEAR(a1.sum(), b1.sum(), 1e-6);
+
+    // periodic boundaries are exact, so the impulse response does not
+    // depend on the position of the impulse.
+    NdArray<float, 3> d1({37, 20, 19}), d2({37, 20, 19});
+    d1 = 0.0f; d2 = 0.0f;
+    d1[{0, 0, 0}] = 1.0f;
+    d2[{20, 10, 9}] = 1.0f;
+
+    // the recursive filter approximates the Gaussian to within a few
+    // percent of its peak value on each axis.
+    for (double sigma : {2.0, 5.0})
+    {
+        auto r1 = filter::gaussian(d1, 0, sigma, GaussianMethod::recursive);
+        auto r2 = filter::gaussian(d2, 0, sigma, GaussianMethod::recursive);
+        auto direct = filter::gaussian(d1, unsigned(4 * sigma + 1), sigma);
+
+        double peak = direct[{0, 0, 0}];
+        for (size_t i = 0; i < 37; ++i)
+            for (size_t j = 0; j < 20; ++j)
+                for (size_t k = 0; k < 19; ++k)
+                {
+                    float x = r1[{i, j, k}];
+                    ASSERT_NEAR(x, (r2[{(i + 20) % 37, (j + 10) % 20, (k + 9) % 19}]), 1e-6);
+                    ASSERT_NEAR(x, (direct[{i, j, k}]), 0.07 * peak);
+                }
+
+        for (unsigned axis = 0; axis < 3; ++axis)
+        {
+            auto g1 = filter::gaussian_gradient(
+                d1, axis, 0, sigma, GaussianMethod::recursive);
+            auto g2 = filter::gaussian_gradient(
+                d1, axis, unsigned(4 * sigma + 1), sigma);
+            double g_peak = *std::max_element(g2.begin(), g2.end());
+            assert_array_equal(g1, g2, 0.1 * g_peak);
+        }
+    }
+}
+
+TEST (Filters, SobelComponents)
+{
+    using numeric::NdArray;
+    namespace filter = numeric::filter;
+
+    auto noise = std::bind(
+        std::normal_distribution<float>(0.0, 1.0), std::mt19937());
+
+    NdArray<float, 4> a1({18, 7, 5, 6});
+    std::generate(a1.begin(), a1.end(), noise);
+
+    auto G = filter::gaussian_kernel<float>(2, 1.0);
+    NdArray<float, 1> gradient_kernel({3}, {0.5, 0.0, -0.5});
+
+    NdArray<float, 5> result({4, 18, 7, 5, 6});
+    filter::sobel_components(a1, G, gradient_kernel, result);
+
+    for (unsigned k = 0; k < 4; ++k)
+        assert_array_equal(
+            result.sel(0, k), filter::sobel(a1, k, G, gradient_kernel), 1e-5);
+
+    // with a single buffer, the last level is computed in the output
+    NdArray<float, 4> buffer(a1.shape());
+    NdArray<float, 5> result_b({4, 18, 7, 5, 6});
+    filter::sobel_components(a1, G, gradient_kernel, result_b, buffer);
+    assert_array_equal(result_b, result, 1e-5);
+}
+
+TEST (Filters, EdgeBoundary)
+{
+    using numeric::NdArray;
+    using numeric::Boundary;
+    using numeric::boundary_t;
+    namespace filter = numeric::filter;
+
+    // gradients along the first axis; the inverse magnitude is lowest in
+    // the last column, and low in the first.
+    NdArray<float, 3> input({3, 6, 4});
+    for (size_t y = 0; y < 4; ++y)
+        for (size_t x = 0; x < 6; ++x)
+        {
+            size_t i = 3 * (x + 6 * y);
+            input[i] = 1.0;
+            input[i + 1] = 0.0;
+            input[i + 2] = (x == 0 ? 0.5 : (x == 5 ? 0.3 : 1.0));
+        }
+
+    auto periodic = filter::edge_thinning(input);
+    auto zero = filter::edge_thinning(
+        input, boundary_t<2>{Boundary::zero, Boundary::periodic});
+    auto nearest = filter::edge_thinning(
+        input, numeric::uniform_boundary<2>(Boundary::nearest));
+    for (size_t y = 0; y < 4; ++y)
+    {
+        EXPECT_FALSE(periodic[6 * y]);
+        EXPECT_TRUE(periodic[6 * y + 5]);
+        EXPECT_TRUE(zero[6 * y]);
+        EXPECT_TRUE(nearest[6 * y]);
+        EXPECT_FALSE(nearest[6 * y + 1]);
+    }
+
+    // an edge that only reaches the strong pixel across the border
+    std::fill(input.begin(), input.end(), 2.0);
+    input[2] = 0.1;
+    input[3 * 5 + 2] = 0.5;
+    NdArray<bool, 2> mask({6, 4});
+    std::fill(mask.begin(), mask.end(), true);
+
+    auto linked = filter::double_threshold(input, mask, 0.2, 1.0);
+    EXPECT_TRUE(linked[0]);
+    EXPECT_TRUE(linked[5]);
+
+    for (Boundary mode : {Boundary::zero, Boundary::nearest, Boundary::reflect})
+    {
+        auto cut = filter::double_threshold(
+            input, mask, 0.2, 1.0, boundary_t<2>{mode, Boundary::periodic});
+        EXPECT_TRUE(cut[0]);
+        EXPECT_FALSE(cut[5]);
+    }
+
+    // away from the border, the interior path agrees with periodic
+    // neighbour lookup
+    auto noise = std::bind(
+        std::normal_distribution<float>(0.0, 1.0), std::mt19937());
+    NdArray<float, 3> a({19, 8, 7});
+    std::generate(a.begin(), a.end(), noise);
+    auto s = filter::sobel(a);
+    auto thinned = filter::edge_thinning(s);
+
+    numeric::Slice<3> grid(a.shape());
+    for (size_t i = 0; i < grid.size; ++i)
+    {
+        auto x = grid.index(i);
+        float value = s[4 * i + 3];
+        numeric::stride_t<3> down, up;
+        for (unsigned k = 0; k < 3; ++k)
+        {
+            int d = std::round(s[4 * i + k]);
+            down[k] = ptrdiff_t(x[k]) - d;
+            up[k] = ptrdiff_t(x[k]) + d;
+        }
+        bool expected = std::isfinite(value)
+            && value <= s[4 * grid.flat_index(down) + 3]
+            && value <= s[4 * grid.flat_index(up) + 3];
+        EXPECT_EQ(thinned[i], expected);
+    }
+}
+
+TEST (Filters, ThinningMasks)
+{
+    using numeric::NdArray;
+    namespace filter = numeric::filter;
+
+    // in four dimensions all 81 rounded directions occur
+    auto noise = std::bind(
+        std::normal_distribution<float>(0.0, 1.0), std::mt19937(3));
+    NdArray<float, 4> a({11, 6, 5, 4});
+    std::generate(a.begin(), a.end(), noise);
+    auto s = filter::sobel(a);
+
+    numeric::Slice<4> grid(a.shape());
+    auto thinned = filter::edge_thinning(s);
+    numeric::PackedEdgeMask<4> packed(a.shape(), true);
+    filter::edge_thinning(s, packed);
+    EXPECT_EQ(packed, thinned);
+
+    for (size_t i = 0; i < grid.size; ++i)
+    {
+        auto x = grid.index(i);
+        float value = s[5 * i + 4];
+        numeric::stride_t<4> down, up;
+        for (unsigned k = 0; k < 4; ++k)
+        {
+            int d = std::round(s[5 * i + k]);
+            down[k] = ptrdiff_t(x[k]) - d;
+            up[k] = ptrdiff_t(x[k]) + d;
+        }
+        bool expected = std::isfinite(value)
+            && value <= s[5 * grid.flat_index(down) + 4]
+            && value <= s[5 * grid.flat_index(up) + 4];
+        EXPECT_EQ(thinned[i], expected);
+    }
+}
+
+TEST (Filters, InterpolatedThinning)
+{
+    using numeric::NdArray;
+    namespace filter = numeric::filter;
+    using filter::ThinningMethod;
+
+    // a ball of radius 7.3; the edge is a sphere crossing the grid at all
+    // angles
+    numeric::shape_t<3> shape = {24, 22, 20};
+    numeric::Slice<3> grid(shape);
+    NdArray<float, 3> a(shape);
+    for (size_t i = 0; i < grid.size; ++i)
+    {
+        auto x = grid.index(i);
+        double r = std::sqrt(
+            std::pow(x[0] - 11.6, 2) + std::pow(x[1] - 10.2, 2)
+            + std::pow(x[2] - 9.5, 2));
+        a[i] = std::tanh((7.3 - r) / 1.5);
+    }
+    auto s = filter::sobel(a);
+
+    numeric::EdgeMask<3> edges(shape);
+    NdArray<float, 3> offset(shape);
+    filter::edge_thinning(s, edges, offset);
+    EXPECT_EQ(edges, filter::edge_thinning(s, ThinningMethod::interpolated));
+
+    // the sub-voxel positions of strong edges lie on the sphere
+    float strongest = s[3];
+    for (size_t i = 0; i < grid.size; ++i)
+        strongest = std::min(strongest, s[4 * i + 3]);
+    size_t n = 0;
+    double squares = 0;
+    for (size_t i = 0; i < grid.size; ++i)
+    {
+        if (not edges[i] || s[4 * i + 3] > 1.5 * strongest)
+            continue;
+        auto x = grid.index(i);
+        double p[3] = {
+            x[0] + offset[i] * s[4 * i] - 11.6,
+            x[1] + offset[i] * s[4 * i + 1] - 10.2,
+            x[2] + offset[i] * s[4 * i + 2] - 9.5};
+        double r = std::sqrt(p[0] * p[0] + p[1] * p[1] + p[2] * p[2]);
+        EXPECT_NEAR(r, 7.3, 0.25);
+        EXPECT_LE(std::abs(offset[i]), 1.0);
+        squares += (r - 7.3) * (r - 7.3);
+        ++n;
+    }
+    EXPECT_GT(n, 400u);
+    EXPECT_LT(std::sqrt(squares / n), 0.1);
+
+    // along the axes, interpolation only looks at the neighbours that
+    // rounding picks
+    NdArray<float, 3> b(shape);
+    for (size_t i = 0; i < grid.size; ++i)
+        b[i] = std::tanh((grid.index(i)[1] - 10.4) / 1.5);
+    auto t = filter::sobel(b);
+    EXPECT_EQ(filter::edge_thinning(t, ThinningMethod::interpolated),
+              filter::edge_thinning(t));
+}
+
+TEST (Filters, ClassifyEdges)
+{
+    using numeric::NdArray;
+    using numeric::Boundary;
+    namespace filter = numeric::filter;
+    using filter::EdgeClass;
+    using filter::ThinningMethod;
+
+    auto noise = std::bind(
+        std::normal_distribution<float>(0.0, 1.0), std::mt19937(5));
+    NdArray<float, 3> a({37, 13, 9});
+    std::generate(a.begin(), a.end(), noise);
+    auto s = filter::smooth_sobel(a, 4, 1.5);
+    numeric::Slice<3> grid(a.shape());
+
+    // thresholds at the 20th and 60th percentiles of the edges
+    auto thinned = filter::edge_thinning(s);
+    std::vector<float> strength;
+    for (size_t i = 0; i < grid.size; ++i)
+        if (thinned[i])
+            strength.push_back(s[4 * i + 3]);
+    std::sort(strength.begin(), strength.end());
+    double lower = strength[strength.size() / 5],
+           upper = strength[strength.size() * 3 / 5];
+
+    NdArray<uint8_t, 3> classes(a.shape());
+    auto seeds = filter::classify_edges(s, lower, upper, classes);
+    EXPECT_TRUE(std::is_sorted(seeds.begin(), seeds.end()));
+    size_t n_strong = 0;
+    for (size_t i = 0; i < grid.size; ++i)
+    {
+        float value = s[4 * i + 3];
+        EdgeClass expected = (!thinned[i] ? EdgeClass::none
+            : (value <= lower ? EdgeClass::strong
+            : (value <= upper ? EdgeClass::weak : EdgeClass::none)));
+        EXPECT_EQ(classes[i], uint8_t(expected));
+        if (expected == EdgeClass::strong)
+        {
+            ASSERT_LT(n_strong, seeds.size());
+            EXPECT_EQ(seeds[n_strong++], i);
+        }
+    }
+    EXPECT_EQ(n_strong, seeds.size());
+
+    numeric::EdgeMask<3> kept(a.shape());
+    filter::hysteresis(classes, seeds, kept);
+    EXPECT_EQ(kept, filter::double_threshold(s, thinned, lower, upper));
+
+    // thinning is pruned to the pixels at most `upper`, which are sparse
+    // with the first and dense with the second
+    for (double top : {upper, double(strength.back())})
+        for (auto method : {ThinningMethod::rounded, ThinningMethod::interpolated})
+            for (Boundary mode : {Boundary::periodic, Boundary::zero, Boundary::reflect})
+            {
+                auto boundary = numeric::uniform_boundary<3>(mode);
+                auto mask = filter::edge_thinning(s, method, boundary);
+                auto expected = filter::double_threshold(s, mask, lower, top, boundary);
+                EXPECT_EQ(filter::thin_and_threshold(s, lower, top, method, boundary),
+                          expected);
+            }
+}
+
+TEST (Filters, ParallelHysteresis)
+{
+    using numeric::NdArray;
+    using numeric::Boundary;
+    namespace filter = numeric::filter;
+
+    // union-find hysteresis against a serial flood fill
+    auto noise = std::bind(
+        std::normal_distribution<float>(0.0, 1.0), std::mt19937(7));
+    NdArray<float, 4> a({23, 9, 8, 6});
+    std::generate(a.begin(), a.end(), noise);
+    auto s = filter::smooth_sobel(a, 2, 1.0);
+    numeric::Slice<4> grid(a.shape());
+
+    auto thinned = filter::edge_thinning(s);
+    std::vector<float> strength;
+    for (size_t i = 0; i < grid.size; ++i)
+        if (thinned[i])
+            strength.push_back(s[5 * i + 4]);
+    std::sort(strength.begin(), strength.end());
+    auto percentile = [&] (size_t p)
+    {
+        return strength[strength.size() * p / 100];
+    };
+
+    for (Boundary mode : {Boundary::periodic, Boundary::zero, Boundary::nearest})
+        for (auto bounds : {std::make_pair(5, 50), std::make_pair(30, 90),
+                            std::make_pair(50, 50)})
+        {
+            auto boundary = numeric::uniform_boundary<4>(mode);
+            double lower = percentile(bounds.first),
+                   upper = percentile(bounds.second);
+            numeric::EdgeMask<4> expected(a.shape());
+            filter::detail::flood_double_threshold<4>(
+                s, thinned, lower, upper, expected, boundary);
+
+            numeric::PackedEdgeMask<4> packed(a.shape(), true);
+            filter::double_threshold(s, thinned, lower, upper, packed, boundary);
+            EXPECT_EQ(filter::double_threshold(s, thinned, lower, upper, boundary),
+                      expected);
+            EXPECT_EQ(packed, expected);
+        }
+}
+
+TEST (Filters, LabelComponents)
+{
+    using numeric::NdArray;
+    using numeric::Boundary;
+    namespace filter = numeric::filter;
+
+    auto noise = std::bind(
+        std::normal_distribution<float>(0.0, 1.0), std::mt19937(11));
+    NdArray<float, 3> a({31, 12, 10});
+    std::generate(a.begin(), a.end(), noise);
+    auto s = filter::smooth_sobel(a, 2, 1.0);
+    auto mask = filter::edge_thinning(s);
+    numeric::Slice<3> grid(a.shape());
+
+    for (Boundary mode : {Boundary::periodic, Boundary::zero})
+    {
+        NdArray<int32_t, 3> labels(a.shape());
+        auto components = filter::label_components(
+            s, mask, labels, numeric::uniform_boundary<3>(mode));
+
+        // breadth first search from each unlabelled pixel in turn
+        std::vector<int32_t> expected(grid.size, 0);
+        int32_t n = 0;
+        for (size_t start = 0; start < grid.size; ++start)
+        {
+            if (!mask[start] || expected[start])
+                continue;
+            expected[start] = ++n;
+            std::vector<size_t> queue = {start};
+            double magnitude = 0;
+            auto lower = grid.index(start), upper = lower;
+            for (size_t q = 0; q < queue.size(); ++q)
+            {
+                auto x = grid.index(queue[q]);
+                magnitude += 1 / s[4 * queue[q] + 3];
+                for (unsigned k = 0; k < 3; ++k)
+                {
+                    lower[k] = std::min(lower[k], x[k]);
+                    upper[k] = std::max(upper[k], x[k]);
+                }
+                for (int dz = -1; dz <= 1; ++dz)
+                    for (int dy = -1; dy <= 1; ++dy)
+                        for (int dx = -1; dx <= 1; ++dx)
+                        {
+                            ptrdiff_t y[3] = {ptrdiff_t(x[0]) + dx,
+                                              ptrdiff_t(x[1]) + dy,
+                                              ptrdiff_t(x[2]) + dz};
+                            bool outside = false;
+                            for (unsigned k = 0; k < 3; ++k)
+                            {
+                                ptrdiff_t m = ptrdiff_t(grid.shape[k]);
+                                outside = outside || y[k] < 0 || y[k] >= m;
+                                y[k] = (y[k] + m) % m;
+                            }
+                            if (outside && mode == Boundary::zero)
+                                continue;
+                            size_t j = grid.flat_index(
+                                numeric::shape_t<3>{size_t(y[0]), size_t(y[1]), size_t(y[2])});
+                            if (mask[j] && !expected[j])
+                            {
+                                expected[j] = n;
+                                queue.push_back(j);
+                            }
+                        }
+            }
+
+            ASSERT_LE(size_t(n), components.size());
+            auto const &c = components[n - 1];
+            EXPECT_EQ(c.size, queue.size());
+            EXPECT_EQ(c.lower, lower);
+            EXPECT_EQ(c.upper, upper);
+            EXPECT_NEAR(c.magnitude, magnitude / queue.size(), 1e-6 * c.magnitude);
+        }
+
+        EXPECT_EQ(components.size(), size_t(n));
+        for (size_t i = 0; i < grid.size; ++i)
+            EXPECT_EQ(labels[i], expected[i]);
+    }
+}
+
+TEST (Filters, TiledHysteresis)
+{
+    using numeric::NdArray;
+    using numeric::Boundary;
+    namespace filter = numeric::filter;
+
+    auto noise = std::bind(
+        std::normal_distribution<float>(0.0, 1.0), std::mt19937(13));
+    NdArray<float, 3> a({29, 14, 11});
+    std::generate(a.begin(), a.end(), noise);
+    auto s = filter::smooth_sobel(a, 2, 1.0);
+    auto mask = filter::edge_thinning(s);
+    numeric::Slice<3> grid(a.shape());
+
+    std::vector<float> strength;
+    for (size_t i = 0; i < grid.size; ++i)
+        if (mask[i])
+            strength.push_back(s[4 * i + 3]);
+    std::sort(strength.begin(), strength.end());
+    double lower = strength[strength.size() / 10],
+           upper = strength[strength.size() * 8 / 10];
+
+    for (Boundary mode : {Boundary::periodic, Boundary::zero, Boundary::reflect})
+    {
+        auto boundary = numeric::uniform_boundary<3>(mode);
+        auto expected = filter::double_threshold(s, mask, lower, upper, boundary);
+
+        // tiles that divide the volume, that do not, of single pixels
+        // and one tile spanning all
+        for (numeric::shape_t<3> tile : {numeric::shape_t<3>{8, 7, 11},
+                                         numeric::shape_t<3>{5, 4, 3},
+                                         numeric::shape_t<3>{1, 1, 1},
+                                         numeric::shape_t<3>{29, 14, 11}})
+        {
+            numeric::EdgeMask<3> output(a.shape());
+            filter::tiled_double_threshold(s, mask, lower, upper, tile, output, boundary);
+            EXPECT_EQ(output, expected);
+        }
+    }
+}
+
+TEST (Filters, HysteresisIndex)
+{
+    using numeric::NdArray;
+    using numeric::Boundary;
+    namespace filter = numeric::filter;
+
+    auto noise = std::bind(
+        std::normal_distribution<float>(0.0, 1.0), std::mt19937(17));
+    NdArray<float, 3> a({27, 16, 9});
+    std::generate(a.begin(), a.end(), noise);
+    auto s = filter::smooth_sobel(a, 2, 1.0);
+    auto mask = filter::edge_thinning(s);
+    numeric::Slice<3> grid(a.shape());
+
+    std::vector<float> strength;
+    for (size_t i = 0; i < grid.size; ++i)
+        if (mask[i])
+            strength.push_back(s[4 * i + 3]);
+    std::sort(strength.begin(), strength.end());
+    auto percentile = [&] (size_t p)
+    {
+        return strength[std::min(strength.size() - 1, strength.size() * p / 100)];
+    };
+
+    std::vector<std::pair<double, double>> thresholds;
+    for (auto bounds : {std::make_pair(0, 0), std::make_pair(5, 50),
+                        std::make_pair(20, 95), std::make_pair(50, 50),
+                        std::make_pair(30, 100)})
+        thresholds.emplace_back(percentile(bounds.first), percentile(bounds.second));
+    thresholds.emplace_back(0.0, 1e30);
+
+    for (Boundary mode : {Boundary::periodic, Boundary::zero})
+    {
+        auto boundary = numeric::uniform_boundary<3>(mode);
+        filter::HysteresisIndex index(s, mask, boundary);
+        EXPECT_EQ(index.size(), strength.size());
+
+        std::vector<numeric::PackedEdgeMask<3>> outputs(
+            thresholds.size(), numeric::PackedEdgeMask<3>(a.shape()));
+        index(thresholds, outputs);
+
+        for (size_t j = 0; j < thresholds.size(); ++j)
+        {
+            double lower = thresholds[j].first, upper = thresholds[j].second;
+            auto expected = filter::double_threshold(s, mask, lower, upper, boundary);
+
+            numeric::EdgeMask<3> output(a.shape());
+            size_t count = index(lower, upper, output);
+            EXPECT_EQ(output, expected);
+            EXPECT_EQ(outputs[j], expected);
+            EXPECT_EQ(count, size_t(std::count(expected.begin(), expected.end(), true)));
+        }
+    }
+}
+
+TEST (Filters, PlanarLayout)
+{
+    using numeric::NdArray;
+    using numeric::Boundary;
+    namespace filter = numeric::filter;
+    using filter::ThinningMethod;
+    using filter::VectorLayout;
+
+    auto noise = std::bind(
+        std::normal_distribution<float>(0.0, 1.0), std::mt19937(19));
+    NdArray<float, 3> a({35, 12, 10});
+    std::generate(a.begin(), a.end(), noise);
+    numeric::Slice<3> grid(a.shape());
+
+    auto s = filter::smooth_sobel(a, 2, 1.0);
+    auto p = filter::smooth_sobel(
+        a, 2, 1.0, filter::GaussianMethod::direct,
+        numeric::uniform_boundary<3>(), VectorLayout::planar);
+
+    // one plane per component
+    EXPECT_EQ(p.shape(), s.shape());
+    EXPECT_EQ(p.slice().stride[0], ptrdiff_t(grid.size));
+    for (size_t i = 0; i < grid.size; ++i)
+        for (unsigned k = 0; k < 4; ++k)
+            ASSERT_EQ(p[k * grid.size + i], s[4 * i + k]);
+
+    auto q = filter::with_layout(p, VectorLayout::interleaved);
+    EXPECT_TRUE(std::equal(q.begin(), q.end(), s.begin()));
+    auto r = filter::with_layout(s, VectorLayout::planar);
+    EXPECT_TRUE(std::equal(r.container().begin(), r.container().end(),
+                           p.container().begin()));
+
+    std::vector<float> strength;
+    auto thinned = filter::edge_thinning(s);
+    for (size_t i = 0; i < grid.size; ++i)
+        if (thinned[i])
+            strength.push_back(s[4 * i + 3]);
+    std::sort(strength.begin(), strength.end());
+    double lower = strength[strength.size() / 5],
+           upper = strength[strength.size() * 3 / 5];
+
+    for (auto method : {ThinningMethod::rounded, ThinningMethod::interpolated})
+        for (Boundary mode : {Boundary::periodic, Boundary::zero})
+        {
+            auto boundary = numeric::uniform_boundary<3>(mode);
+            auto mask = filter::edge_thinning(s, method, boundary);
+            EXPECT_EQ(filter::edge_thinning(p, method, boundary), mask);
+            auto expected = filter::double_threshold(s, mask, lower, upper, boundary);
+            EXPECT_EQ(filter::double_threshold(p, mask, lower, upper, boundary), expected);
+            EXPECT_EQ(filter::thin_and_threshold(p, lower, upper, method, boundary),
+                      expected);
+        }
+}
+
+TEST (Filters, QuantizedSobel)
+{
+    using numeric::NdArray;
+    using numeric::Boundary;
+    namespace filter = numeric::filter;
+    using filter::GaussianMethod;
+
+    auto noise = std::bind(
+        std::normal_distribution<float>(0.0, 1.0), std::mt19937(23));
+    NdArray<float, 3> a({31, 13, 12});
+    std::generate(a.begin(), a.end(), noise);
+    numeric::Slice<3> grid(a.shape());
+
+    auto check = [&] (auto const &s, auto const &q, Boundary mode)
+    {
+        auto boundary = numeric::uniform_boundary<3>(mode);
+        for (size_t i = 0; i < grid.size; ++i)
+            ASSERT_EQ(float(q.magnitude[i]), float(s[4 * i + 3]));
+
+        auto mask = filter::edge_thinning(s, filter::ThinningMethod::rounded, boundary);
+        EXPECT_EQ(filter::edge_thinning(q, boundary), mask);
+
+        std::vector<float> strength;
+        for (size_t i = 0; i < grid.size; ++i)
+            if (mask[i])
+                strength.push_back(s[4 * i + 3]);
+        std::sort(strength.begin(), strength.end());
+        double lower = strength[strength.size() / 10],
+               upper = strength[strength.size() * 7 / 10];
+
+        auto expected = filter::double_threshold(s, mask, lower, upper, boundary);
+        EXPECT_EQ(filter::double_threshold(q, mask, lower, upper, boundary), expected);
+        EXPECT_EQ(filter::thin_and_threshold(q, lower, upper, boundary), expected);
+    };
+
+    for (auto method : {GaussianMethod::direct, GaussianMethod::recursive})
+    {
+        auto s = filter::smooth_sobel(a, 2, 1.0, method);
+        auto q = filter::smooth_sobel_quantized(a, 2, 1.0, method);
+        for (Boundary mode : {Boundary::periodic, Boundary::zero})
+            check(s, q, mode);
+
+        NdArray<numeric::half, 4> s_half(s.shape());
+        filter::smooth_sobel(a, 2, 1.0, s_half, method);
+        auto q_half = filter::smooth_sobel_quantized<numeric::half>(a, 2, 1.0, method);
+        check(s_half, q_half, Boundary::periodic);
+    }
+
+    // four axes split the components in halves that share smoothing
+    NdArray<float, 4> b({11, 9, 8, 7});
+    std::generate(b.begin(), b.end(), noise);
+    auto q4 = filter::smooth_sobel_quantized<numeric::half>(b, 2, 1.0);
+    NdArray<numeric::half, 5> s4_half({5, 11, 9, 8, 7});
+    filter::smooth_sobel(b, 2, 1.0, s4_half);
+    for (size_t i = 0; i < b.size(); ++i)
+        ASSERT_EQ(float(q4.magnitude[i]), float(s4_half[5 * i + 4]));
+    EXPECT_EQ(filter::edge_thinning(q4),
+              filter::edge_thinning(s4_half, filter::ThinningMethod::rounded));
+
+    // a flat input has no direction and no edges
+    NdArray<float, 3> flat(a.shape());
+    std::fill(flat.begin(), flat.end(), 1.0f);
+    auto q = filter::smooth_sobel_quantized(flat, 2, 1.0);
+    EXPECT_TRUE(std::all_of(q.direction.begin(), q.direction.end(),
+                            [] (uint8_t c) { return c == 13; }));
+    auto none = filter::edge_thinning(q);
+    EXPECT_EQ(std::count(none.begin(), none.end(), true), 0);
+}
@@ -0,0 +1,171 @@
+/* Copyright 2017 Netherlands eScience Center
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#include <gtest/gtest.h>
+
+#include "numeric/half.hh"
+#include "numeric/canny.hh"
+
+#include <cmath>
+#include <limits>
+#include <random>
+#include <functional>
+
+using namespace HyperCanny;
+
+TEST (Half, ScalarConversion)
+{
+    using numeric::half;
+    using numeric::bfloat16;
+
+    // every binary16 value survives a round trip through float
+    for (uint32_t b = 0; b < 0x10000; ++b)
+    {
+        float x = numeric::half_bits_to_float(b);
+        if (std::isnan(x))
+        {
+            EXPECT_TRUE(std::isnan(float(half(x))));
+            continue;
+        }
+        EXPECT_EQ(half(x).bits, b);
+    }
+
+    // round to nearest, ties to even
+    EXPECT_EQ(float(half(1.0f + std::ldexp(1.0f, -11))), 1.0f);
+    EXPECT_EQ(float(half(1.0f + 3 * std::ldexp(1.0f, -11))),
+              1.0f + std::ldexp(1.0f, -9));
+    EXPECT_EQ(float(half(65519.0f)), 65504.0f);
+    EXPECT_TRUE(std::isinf(float(half(65520.0f))));
+    EXPECT_EQ(float(half(std::ldexp(1.0f, -25))), 0.0f);
+    EXPECT_EQ(float(half(3 * std::ldexp(1.0f, -25))), std::ldexp(1.0f, -23));
+    EXPECT_EQ(float(half(-std::ldexp(1.0f, -24))), -std::ldexp(1.0f, -24));
+
+    EXPECT_EQ(float(bfloat16(1.0f + std::ldexp(1.0f, -8))), 1.0f);
+    EXPECT_EQ(float(bfloat16(1.0f + 3 * std::ldexp(1.0f, -8))),
+              1.0f + std::ldexp(1.0f, -6));
+    EXPECT_TRUE(std::isnan(float(bfloat16(
+        std::numeric_limits<float>::quiet_NaN()))));
+    EXPECT_TRUE(std::isinf(float(bfloat16(
+        std::numeric_limits<float>::infinity()))));
+}
+
+TEST (Half, BulkConversion)
+{
+    using numeric::half;
+    using numeric::bfloat16;
+    namespace simd = numeric::simd;
+
+    auto noise = std::bind(
+        std::normal_distribution<float>(0.0, 1.0), std::mt19937());
+
+    // a length that leaves a remainder after the vector loops, with
+    // values of all magnitudes and some special values
+    size_t n = 1003;
+    std::vector<float> x(n);
+    for (size_t i = 0; i < n; ++i)
+        x[i] = noise() * std::ldexp(1.0f, int(i % 48) - 30);
+    x[5] = std::numeric_limits<float>::infinity();
+    x[6] = -std::numeric_limits<float>::infinity();
+    x[7] = std::numeric_limits<float>::quiet_NaN();
+    x[8] = 0.0f;
+    x[9] = -0.0f;
+
+    std::vector<half> h(n), h_ref(n);
+    std::vector<bfloat16> b(n), b_ref(n);
+    simd::convert(x.data(), h.data(), n);
+    simd::convert<float, half>(x.data(), h_ref.data(), n);
+    simd::convert(x.data(), b.data(), n);
+    simd::convert<float, bfloat16>(x.data(), b_ref.data(), n);
+
+    std::vector<float> y(n), y_ref(n);
+    simd::convert(h.data(), y.data(), n);
+    simd::convert<half, float>(h_ref.data(), y_ref.data(), n);
+    for (size_t i = 0; i < n; ++i)
+    {
+        if (std::isnan(x[i]))
+        {
+            EXPECT_TRUE(std::isnan(y[i]));
+            continue;
+        }
+        EXPECT_EQ(h[i].bits, h_ref[i].bits) << "at " << i;
+        EXPECT_EQ(y[i], y_ref[i]);
+    }
+
+    simd::convert(b.data(), y.data(), n);
+    simd::convert<bfloat16, float>(b_ref.data(), y_ref.data(), n);
+    for (size_t i = 0; i < n; ++i)
+    {
+        EXPECT_EQ(b[i].bits, b_ref[i].bits) << "at " << i;
+        if (std::isnan(x[i]))
+            continue;
+        EXPECT_EQ(y[i], y_ref[i]);
+    }
+}
+
+TEST (Half, SobelStorage)
+{
+    using numeric::NdArray;
+    using numeric::half;
+    using numeric::bfloat16;
+    namespace filter = numeric::filter;
+
+    auto noise = std::bind(
+        std::normal_distribution<float>(0.0, 1.0), std::mt19937());
+
+    NdArray<float, 3> a({37, 20, 9});
+    std::generate(a.begin(), a.end(), noise);
+    NdArray<half, 3> a_half(a.shape());
+    std::copy(a.begin(), a.end(), a_half.begin());
+
+    auto s = filter::smooth_sobel(a, 4, 1.5);
+    auto s_half = filter::smooth_sobel(a_half, 4, 1.5);
+    NdArray<bfloat16, 4> s_bf16(s.shape());
+    filter::smooth_sobel(a, 4, 1.5, s_bf16);
+
+    // directions are unit vectors, stored with the precision of the
+    // storage type; the inverse magnitude is compared relatively. Weak
+    // gradients lose more, as passes over the intermediate arrays round
+    // as well.
+    auto rms = [&s] (auto const &t, bool magnitude)
+    {
+        double sum = 0.0, worst = 0.0;
+        size_t n = 0;
+        for (size_t i = 0; i < s.size(); ++i)
+        {
+            if ((i % 4 == 3) != magnitude)
+                continue;
+            double d = float(t[i]) - s[i];
+            if (magnitude)
+                d /= s[i];
+            sum += d * d;
+            worst = std::max(worst, std::abs(d));
+            ++n;
+        }
+        EXPECT_LT(worst, 100 * std::sqrt(sum / n));
+        return std::sqrt(sum / n);
+    };
+
+    EXPECT_LT(rms(s_half, false), 1e-3);
+    EXPECT_LT(rms(s_half, true), 1e-3);
+    EXPECT_LT(rms(s_bf16, false), 1e-2);
+    EXPECT_LT(rms(s_bf16, true), 1e-2);
+
+    // almost all pixels end up on the same side of the thinning
+    auto mask = filter::edge_thinning(s);
+    auto mask_half = filter::edge_thinning(s_half);
+    size_t differ = 0;
+    for (size_t i = 0; i < mask.size(); ++i)
+        differ += (mask[i] != mask_half[i]);
+    EXPECT_LT(differ, mask.size() / 100);
+}
@@ -18,6 +18,8 @@
 #include <gtest/gtest.h>
 #include <algorithm>
 #include <numeric>
+#include <tuple>
+#include <vector>
 
 using namespace HyperCanny;
 
@@ -86,3 +88,132 @@ TEST (NdArray, ThreeDee)
     auto s1 = a.sel<0>(20), s2 = a.sel<2>(42);
     ASSERT_EQ(s1, s2);
 }
+
+TEST (NdArray, TypeErasure)
+{
+    using numeric::NdArray;
+    using numeric::NdArrayRef;
+
+    // arrays carry no virtual table; type erasure is opt-in
+    static_assert(!std::is_polymorphic<NdArray<float, 2>>::value,
+                  "NdArray should not be polymorphic.");
+
+    NdArray<int, 2> a({3, 4});
+    std::iota(a.begin(), a.end(), 0);
+    auto v = a.sub<1>(1, 3);
+
+    NdArrayRef<NdArray<int, 2>> ra(a);
+    NdArrayRef<decltype(v)> rv(v);
+    numeric::NdArrayBase<int, 2> &base = rv;
+
+    ASSERT_EQ(ra.shape(), a.shape());
+    ASSERT_EQ(base.shape(), v.shape());
+    ASSERT_EQ(&base.const_container(), &ra.const_container());
+    base.container()[5] = -1;
+    ASSERT_EQ(a[5], -1);
+}
+
+TEST (NdArray, Runs)
+{
+    using numeric::NdArray;
+
+    NdArray<int, 3> a({6, 5, 4});
+    std::iota(a.begin(), a.end(), 0);
+
+    // a contiguous array is a single run; the runs of a view follow the
+    // order of its iterator
+    size_t n_runs = 0;
+    a.for_each_run([&] (int const *, size_t length, ptrdiff_t stride)
+    {
+        ++n_runs;
+        EXPECT_EQ(length, a.size());
+        EXPECT_EQ(stride, 1);
+    });
+    EXPECT_EQ(n_runs, 1u);
+
+    auto views = std::make_tuple(
+        a.sub<0>(1, 5), a.sub<1>(0, 5, 2), a.sel<0>(3),
+        a.reverse<0>(), a.transpose(), a.sub<2>(1, 2));
+    auto check = [] (auto view)
+    {
+        std::vector<int> flat, runs;
+        std::copy(view.cbegin(), view.cend(), std::back_inserter(flat));
+        view.for_each_run([&] (auto p, size_t length, ptrdiff_t stride)
+        {
+            for (size_t i = 0; i < length; ++i)
+                runs.push_back(p[ptrdiff_t(i) * stride]);
+        });
+        EXPECT_EQ(runs, flat);
+        EXPECT_EQ(view.sum(), std::accumulate(flat.begin(), flat.end(), 0));
+
+        auto copy = view.copy();
+        EXPECT_TRUE(std::equal(copy.begin(), copy.end(), flat.begin()));
+        EXPECT_EQ(copy, view);
+        copy += 1;
+        EXPECT_NE(copy, view);
+    };
+    std::apply([&] (auto... view) { (check(view), ...); }, views);
+
+    // assignment between views of different layout
+    NdArray<int, 2> b({5, 6});
+    b = a.sel<2>(1).transpose();
+    for (size_t i = 0; i < 6; ++i)
+        for (size_t j = 0; j < 5; ++j)
+            ASSERT_EQ((b[{j, i}]), (a[{i, j, 1}]));
+
+    NdArray<bool, 2, std::vector<bool>> mask({5, 6}, false);
+    mask.sub<0>(1, 3) = true;
+    EXPECT_EQ(std::count(mask.begin(), mask.end(), true), 12);
+}
+
+TEST (NdArray, StridedCopy)
+{
+    using numeric::NdArray;
+
+    // large enough to be blocked and shared over threads
+    NdArray<int, 3> a({70, 300, 9});
+    std::iota(a.begin(), a.end(), 0);
+
+    std::array<unsigned, 3> axes = {0, 1, 2};
+    do
+    {
+        auto view = a.permute(axes);
+        NdArray<int, 3> expected(view.shape()), b(view.shape());
+        std::copy(view.cbegin(), view.cend(), expected.begin());
+        b = view;
+        ASSERT_EQ(b, expected);
+        for (size_t i = 0; i < 3; ++i)
+            ASSERT_EQ(b.shape()[i], a.shape()[axes[i]]);
+
+        // into a strided, reversed destination
+        NdArray<int, 3> c(view.shape(), -1);
+        c.reverse<0>().sub<2>(0, view.shape()[2]) = view;
+        ASSERT_EQ(c.reverse<0>(), expected);
+    } while (std::next_permutation(axes.begin(), axes.end()));
+
+    EXPECT_THROW(a.permute({0, 0, 1}), Exception);
+
+    // 2-D transposes of odd sizes, and a reversed copy
+    NdArray<float, 2> p({517, 263}), q({263, 517});
+    std::iota(p.begin(), p.end(), 0.0f);
+    q = p.transpose();
+    for (size_t i = 0; i < 517; ++i)
+        for (size_t j = 0; j < 263; ++j)
+            ASSERT_EQ((q[{j, i}]), (p[{i, j}]));
+    NdArray<float, 2> r = p.reverse_all().copy();
+    ASSERT_EQ(r[0], p[p.size() - 1]);
+
+    // writing through a periodic view equals writing element by element
+    NdArray<int, 2> s({5, 6});
+    std::iota(s.begin(), s.end(), 100);
+    for (auto offset : {numeric::stride_t<2>{0, 0}, numeric::stride_t<2>{-2, 3},
+                        numeric::stride_t<2>{4, -1}})
+    {
+        NdArray<int, 2> x({5, 6}, 0), y({5, 6}, 0);
+        auto src = s.sub<0>(1, 4).sub<1>(0, 6, 2);
+        x.periodic_view(offset, src.shape()) = src;
+        auto view = y.periodic_view(offset, src.shape());
+        std::copy(src.cbegin(), src.cend(), view.begin());
+        ASSERT_EQ(x, y);
+    }
+}